@@ -15,12 +15,15 @@
  */
 
 #include <assert.h>
+#include <sys/stat.h>
 #include <uv.h>
 #include <contrib/cleanup.h>
 #include <libknot/descriptor.h>
+#include <zscanner/scanner.h>
 
 #include "lib/cache.h"
 #include "lib/cdb.h"
+#include "lib/generic/suffix.h"
 #include "daemon/bindings.h"
 #include "daemon/worker.h"
 #include "daemon/tls.h"
@@ -262,6 +265,44 @@ static int net_close(lua_State *L)
 	return 1;
 }
 
+/** Redirect plain DNS on interface to AF_XDP socket. */
+static int net_xdp(lua_State *L)
+{
+	/* Check parameters */
+	int n = lua_gettop(L);
+	if (n < 1 || n > 3 || !lua_isstring(L, 1)) {
+		format_error(L, "expected one to three arguments; usage:\n"
+			"net.xdp(interface, [port = 53, flags = {queue = 0, generic = false}])\n");
+		lua_error(L);
+	}
+
+	int port = KR_DNS_PORT;
+	if (n > 1 && lua_isnumber(L, 2)) {
+		port = lua_tointeger(L, 2);
+	}
+
+	int queue = 0;
+	bool generic = false;
+	if (n > 2 && lua_istable(L, 3)) {
+		generic = table_get_flag(L, 3, "generic", generic);
+		lua_getfield(L, 3, "queue");
+		if (lua_isnumber(L, -1)) {
+			queue = lua_tointeger(L, -1);
+		}
+		lua_pop(L, 1);
+	}
+
+	struct engine *engine = engine_luaget(L);
+	const char *ifname = lua_tostring(L, 1);
+	int ret = network_xdp(&engine->net, ifname, port, queue, generic);
+	if (ret != 0) {
+		kr_log_info("[system] xdp on '%s' queue %d %s\n",
+				ifname, queue, kr_strerror(ret));
+	}
+	lua_pushboolean(L, ret == 0);
+	return 1;
+}
+
 /** List available interfaces. */
 static int net_interfaces(lua_State *L)
 {
@@ -400,6 +441,7 @@ int lib_net(lua_State *L)
 		{ "list",         net_list },
 		{ "listen",       net_listen },
 		{ "close",        net_close },
+		{ "xdp",          net_xdp },
 		{ "interfaces",   net_interfaces },
 		{ "bufsize",      net_bufsize },
 		{ "tcp_pipeline", net_pipeline },
@@ -498,6 +540,7 @@ static int cache_open(lua_State *L)
 
 	/* Close if already open */
 	kr_cache_close(&engine->resolver.cache);
+	kr_zonecut_cache_clear(engine->resolver.cache_cut);
 
 	/* Reopen cache */
 	struct kr_cdb_opts opts = {
@@ -533,6 +576,7 @@ static int cache_close(lua_State *L)
 	}
 
 	kr_cache_close(cache);
+	kr_zonecut_cache_clear(engine->resolver.cache_cut);
 	lua_getglobal(L, "cache");
 	lua_pushstring(L, "current_size");
 	lua_pushnumber(L, 0);
@@ -640,6 +684,7 @@ static int cache_clear(lua_State *L)
 	}
 
 	/* Clear a sub-tree in cache. */
+	kr_zonecut_cache_clear(engine->resolver.cache_cut);
 	if (args && strlen(args) > 0) {
 		int ret = cache_remove_prefix(cache, args);
 		if (ret < 0) {
@@ -1089,6 +1134,12 @@ static int wrk_stats(lua_State *L)
 	lua_setfield(L, -2, "dropped");
 	lua_pushnumber(L, worker->stats.timeout);
 	lua_setfield(L, -2, "timeout");
+	lua_pushnumber(L, worker->stats.gc_time);
+	lua_setfield(L, -2, "gc_time");
+	lua_pushnumber(L, worker->stats.gc_pause);
+	lua_setfield(L, -2, "gc_pause");
+	lua_pushnumber(L, worker->stats.trims);
+	lua_setfield(L, -2, "trims");
 	/* Add subset of rusage that represents counters. */
 	uv_rusage_t rusage;
 	if (uv_getrusage(&rusage) == 0) {
@@ -1112,11 +1163,160 @@ static int wrk_stats(lua_State *L)
 	return 1;
 }
 
+/** @internal Response policy zone loaded in the thread pool, see wrk_rpz_load(). */
+struct rpz_load {
+	uv_work_t req;
+	char *path;
+	time_t mtime;          /**< Skip loading if the file wasn't modified since */
+	struct kr_rpz *rpz;    /**< Loaded rules or NULL */
+	const char *err;       /**< Error message or NULL */
+	int err_no;            /**< System error, formatted on the loop thread */
+	unsigned unsupported;  /**< Number of records with unsupported action */
+	int cb_ref;
+};
+
+/** @internal Map RPZ action (CNAME target) to action index, see policy.rpz() */
+static int rpz_action(const uint8_t *rdata, uint32_t len)
+{
+	static const struct { const char *target; uint32_t len; int id; } actions[] = {
+		{ "\0", 1, 1 },                        /* NXDOMAIN */
+		{ "\1*\0", 3, 1 },                     /* NODATA, deviates from RPZ spec */
+		{ "\x0c" "rpz-passthru\0", 14, 2 },
+		{ "\x08" "rpz-drop\0", 10, 3 },
+		{ "\x0c" "rpz-tcp-only\0", 14, 4 },
+	};
+	for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); ++i) {
+		if (len == actions[i].len && memcmp(rdata, actions[i].target, len) == 0) {
+			return actions[i].id;
+		}
+	}
+	return 0;
+}
+
+/** @internal Parse the zone file, runs in the thread pool and doesn't touch Lua state. */
+static void rpz_load_work(uv_work_t *req)
+{
+	struct rpz_load *load = req->data;
+	struct stat st;
+	if (stat(load->path, &st) != 0) {
+		load->err_no = errno;
+		return;
+	}
+	if (load->mtime != 0 && st.st_mtime == load->mtime) {
+		return; /* Not modified */
+	}
+	load->mtime = st.st_mtime;
+	zs_scanner_t *zs = malloc(sizeof(*zs));
+	if (!zs || zs_init(zs, ".", KNOT_CLASS_IN, 0) != 0) {
+		free(zs);
+		load->err = "not enough memory";
+		return;
+	}
+	load->rpz = kr_rpz_new();
+	if (!load->rpz) {
+		load->err = "not enough memory";
+	} else if (zs_set_input_file(zs, load->path) != 0) {
+		load->err = zs_strerror(zs->error.code);
+	} else {
+		while (zs_parse_record(zs) == 0 && zs->state == ZS_STATE_DATA) {
+			int id = rpz_action(zs->r_data, zs->r_data_length);
+			if (id > 0 && kr_rpz_add(load->rpz, zs->r_owner, id) != 0) {
+				load->err = "not enough memory";
+				break;
+			} else if (id == 0 && zs->r_owner_length > 1) {
+				load->unsupported += 1;
+			}
+		}
+		/* Anything but the end of file (e.g. $INCLUDE) leaves the zone incomplete. */
+		if (!load->err && zs->state != ZS_STATE_EOF) {
+			if (zs->state == ZS_STATE_ERROR) {
+				load->err = zs_strerror(zs->error.code);
+			} else if (zs->state == ZS_STATE_INCLUDE) {
+				load->err = "$INCLUDE is not supported";
+			} else {
+				load->err = "incomplete zone";
+			}
+		}
+	}
+	zs_deinit(zs);
+	free(zs);
+	if (load->err || load->err_no) {
+		kr_rpz_free(load->rpz);
+		load->rpz = NULL;
+	}
+}
+
+/** @internal Hand the loaded rules over to the Lua callback in the event loop. */
+static void rpz_load_done(uv_work_t *req, int status)
+{
+	struct rpz_load *load = req->data;
+	struct worker_ctx *worker = req->loop->data;
+	lua_State *L = worker->engine->L;
+	if (load->unsupported > 0) {
+		kr_log_info("[ rpz ] %s: %u records with unsupported policy action\n", load->path, load->unsupported);
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, load->cb_ref);
+	luaL_unref(L, LUA_REGISTRYINDEX, load->cb_ref);
+	if (load->rpz) {
+		lua_pushlightuserdata(L, load->rpz);
+	} else {
+		lua_pushnil(L);
+	}
+	if (status != 0) {
+		lua_pushstring(L, uv_strerror(status));
+	} else if (load->err_no) {
+		lua_pushstring(L, strerror(load->err_no));
+	} else if (load->err) {
+		lua_pushstring(L, load->err);
+	} else {
+		lua_pushnil(L);
+	}
+	lua_pushnumber(L, load->mtime);
+	(void) execute_callback(L, 3);
+	free(load->path);
+	free(load);
+}
+
+/** Load response policy zone in the thread pool. */
+static int wrk_rpz_load(lua_State *L)
+{
+	/* Check parameters */
+	int n = lua_gettop(L);
+	if (n < 2 || !lua_isstring(L, 1) || !lua_isfunction(L, 2)) {
+		format_error(L, "expected 'rpz_load(string path, function callback[, number mtime])'");
+		lua_error(L);
+	}
+	struct rpz_load *load = calloc(1, sizeof(*load));
+	if (load) {
+		load->path = strdup(lua_tostring(L, 1));
+	}
+	if (!load || !load->path) {
+		free(load);
+		format_error(L, "out of memory");
+		lua_error(L);
+	}
+	load->mtime = lua_isnumber(L, 3) ? lua_tonumber(L, 3) : 0;
+	load->req.data = load;
+	lua_pushvalue(L, 2);
+	load->cb_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	int ret = uv_queue_work(uv_default_loop(), &load->req, rpz_load_work, rpz_load_done);
+	if (ret != 0) {
+		luaL_unref(L, LUA_REGISTRYINDEX, load->cb_ref);
+		free(load->path);
+		free(load);
+		format_error(L, uv_strerror(ret));
+		lua_error(L);
+	}
+	lua_pushboolean(L, true);
+	return 1;
+}
+
 int lib_worker(lua_State *L)
 {
 	static const luaL_Reg lib[] = {
 		{ "resolve",  wrk_resolve },
 		{ "stats",    wrk_stats },
+		{ "rpz_load", wrk_rpz_load },
 		{ NULL, NULL }
 	};
 	register_lib(L, "worker", lib);
@@ -6,9 +6,10 @@ kresd_SOURCES := \
 	daemon/bindings.c    \
 	daemon/ffimodule.c   \
 	daemon/tls.c         \
+	daemon/xdp.c         \
 	daemon/main.c
 
-kresd_DIST := daemon/lua/kres.lua daemon/lua/trust_anchors.lua
+kresd_DIST := daemon/lua/kres.lua daemon/lua/trust_anchors.lua daemon/lua/histogram.lua
 
 # Embedded resources
 %.inc: %.lua
@@ -37,6 +38,11 @@ kresd_CFLAGS += -DHAS_SYSTEMD
 kresd_LIBS += $(libsystemd_LIBS)
 endif
 
+# Enable AF_XDP
+ifeq ($(HAS_xdp), yes)
+kresd_CFLAGS += -DENABLE_XDP
+endif
+
 # Make binary
 ifeq ($(HAS_lua)|$(HAS_libuv), yes|yes)
 $(eval $(call make_sbin,kresd,daemon,yes))
@@ -30,7 +30,10 @@
 #include "lib/cache.h"
 #include "lib/defines.h"
 #include "lib/cdb_lmdb.h"
+#include "lib/dnssec.h"
 #include "lib/dnssec/ta.h"
+#include "lib/dnssec/signature.h"
+#include "lib/dnssec/nsec3.h"
 
 /** @internal Compatibility wrapper for Lua < 5.2 */
 #if LUA_VERSION_NUM < 502
@@ -64,6 +67,7 @@ static int l_help(lua_State *L)
 		"hostname()\n    hostname\n"
 		"user(name[, group])\n    change process user (and group)\n"
 		"verbose(true|false)\n    toggle verbose mode\n"
+		"nsec3_max_iterations([n])\n    get/set NSEC3 iteration limit\n"
 		"option(opt[, new_val])\n    get/set server option\n"
 		"mode(strict|normal|permissive)\n    set resolver strictness level\n"
 		"reorder_RR([true|false])\n    set/get reordering of RRs within RRsets\n"
@@ -147,6 +151,26 @@ static int l_verbose(lua_State *L)
 	return 1;
 }
 
+/** Get/set NSEC3 iteration limit. */
+static int l_nsec3_max_iterations(lua_State *L)
+{
+	struct engine *engine = engine_luaget(L);
+	struct kr_nsec3_cache *cache = engine->resolver.cache_nsec3;
+	if (!cache) {
+		return 0;
+	}
+	if (lua_isnumber(L, 1)) {
+		lua_Number n = lua_tonumber(L, 1);
+		if (n < 0 || n > UINT16_MAX) {
+			lua_pushstring(L, "nsec3_max_iterations takes a number in range 0-65535");
+			lua_error(L);
+		}
+		cache->max_iterations = n;
+	}
+	lua_pushnumber(L, cache->max_iterations);
+	return 1;
+}
+
 char *engine_get_hostname(struct engine *engine) {
 	static char hostname_str[KNOT_DNAME_MAXLEN];
 	if (!engine) {
@@ -489,6 +513,10 @@ static int init_resolver(struct engine *engine)
 	/* Open NS rtt + reputation cache */
 	lru_create(&engine->resolver.cache_rtt, LRU_RTT_SIZE, engine->pool, NULL);
 	lru_create(&engine->resolver.cache_rep, LRU_REP_SIZE, engine->pool, NULL);
+	engine->resolver.cache_cut = kr_zonecut_cache_create(LRU_CUT_SIZE);
+	engine->resolver.cache_sig = kr_sigcache_create(LRU_SIG_SIZE);
+	engine->resolver.cache_dnskey = kr_dnssec_keycache_create(LRU_DNSKEY_SIZE);
+	engine->resolver.cache_nsec3 = kr_nsec3_cache_create(LRU_NSEC3_SIZE, KR_NSEC3_MAX_ITERATIONS);
 	lru_create(&engine->resolver.cache_cookie, LRU_COOKIES_SIZE, engine->pool, NULL);
 
 	/* Load basic modules */
@@ -519,6 +547,8 @@ static int init_state(struct engine *engine)
 	lua_setglobal(engine->L, "hostname");
 	lua_pushcfunction(engine->L, l_verbose);
 	lua_setglobal(engine->L, "verbose");
+	lua_pushcfunction(engine->L, l_nsec3_max_iterations);
+	lua_setglobal(engine->L, "nsec3_max_iterations");
 	lua_pushcfunction(engine->L, l_option);
 	lua_setglobal(engine->L, "option");
 	lua_pushcfunction(engine->L, l_setuser);
@@ -543,16 +573,20 @@ static int init_state(struct engine *engine)
 }
 
 static enum lru_apply_do update_stat_item(const char *key, uint len,
-						unsigned *rtt, void *baton)
+						struct kr_nsrep_rtt *rtt, void *baton)
 {
-	return *rtt > KR_NS_LONG ? LRU_APPLY_DO_EVICT : LRU_APPLY_DO_NOTHING;
+	return rtt->score > KR_NS_LONG ? LRU_APPLY_DO_EVICT : LRU_APPLY_DO_NOTHING;
 }
 /** @internal Walk RTT table, clearing all entries with bad score
- *    to compensate for intermittent network issues or temporary bad behaviour. */
+ *    to compensate for intermittent network issues or temporary bad behaviour.
+ *    The remaining NS tables are saved to cache, so they survive restart. */
 static void update_state(uv_timer_t *handle)
 {
 	struct engine *engine = handle->data;
 	lru_apply(engine->resolver.cache_rtt, update_stat_item, NULL);
+	if (kr_cache_is_open(&engine->resolver.cache)) {
+		kr_nsrep_save(&engine->resolver, time(NULL));
+	}
 }
 
 int engine_init(struct engine *engine, knot_mm_t *pool)
@@ -604,12 +638,19 @@ void engine_deinit(struct engine *engine)
 	 * no need to clean up mempool. */
 	network_deinit(&engine->net);
 	kr_zonecut_deinit(&engine->resolver.root_hints);
+	if (kr_cache_is_open(&engine->resolver.cache)) {
+		kr_nsrep_save(&engine->resolver, time(NULL));
+	}
 	kr_cache_close(&engine->resolver.cache);
 
 	/* The lru keys are currently malloc-ated and need to be freed. */
 	lru_free(engine->resolver.cache_rtt);
 	lru_free(engine->resolver.cache_rep);
 	lru_free(engine->resolver.cache_cookie);
+	kr_zonecut_cache_free(engine->resolver.cache_cut);
+	kr_sigcache_free(engine->resolver.cache_sig);
+	kr_dnssec_keycache_free(engine->resolver.cache_dnskey);
+	kr_nsec3_cache_free(engine->resolver.cache_nsec3);
 
 	/* Clear IPC pipes */
 	for (size_t i = 0; i < engine->ipc_set.len; ++i) {
@@ -626,6 +667,7 @@ void engine_deinit(struct engine *engine)
 
 	/* Free data structures */
 	array_clear(engine->modules);
+	kr_resolve_layers(&engine->resolver);
 	array_clear(engine->backends);
 	array_clear(engine->ipc_set);
 	kr_ta_clear(&engine->resolver.trust_anchors);
@@ -727,6 +769,11 @@ int engine_start(struct engine *engine, const char *config_path)
 		return ret;
 	}
 
+	/* Restore NS tables saved by previous run */
+	if (kr_cache_is_open(&engine->resolver.cache)) {
+		kr_nsrep_load(&engine->resolver, time(NULL));
+	}
+
 	/* Clean up stack and restart GC */
 	lua_settop(engine->L, 0);
 	lua_gc(engine->L, LUA_GCCOLLECT, 0);
@@ -848,6 +895,11 @@ int engine_register(struct engine *engine, const char *name, const char *precede
 			arr[emplacement] = module;
 		}
 	}
+	/* Rebuild layer tables */
+	ret = kr_resolve_layers(&engine->resolver);
+	if (ret != 0) {
+		return ret;
+	}
 
 	/* Register properties */
 	if (module->props || module->config) {
@@ -864,7 +916,7 @@ int engine_unregister(struct engine *engine, const char *name)
 	if (found < mod_list->len) {
 		engine_unload(engine, mod_list->at[found]);
 		array_del(*mod_list, found);
-		return kr_ok();
+		return kr_resolve_layers(&engine->resolver);
 	}
 
 	return kr_error(ENOENT);
@@ -23,11 +23,29 @@
 #ifndef LRU_REP_SIZE
 #define LRU_REP_SIZE (LRU_RTT_SIZE / 4) /**< NS reputation cache size */
 #endif
+#ifndef LRU_CUT_SIZE
+#define LRU_CUT_SIZE 4096 /**< Zone cut cache size */
+#endif
+#ifndef LRU_SIG_SIZE
+#define LRU_SIG_SIZE 16384 /**< Signature verification results cache size */
+#endif
+#ifndef LRU_DNSKEY_SIZE
+#define LRU_DNSKEY_SIZE 1024 /**< Parsed DNSKEY cache size */
+#endif
+#ifndef LRU_NSEC3_SIZE
+#define LRU_NSEC3_SIZE 4096 /**< NSEC3 hash cache size */
+#endif
 #ifndef LRU_COOKIES_SIZE
 #define LRU_COOKIES_SIZE LRU_RTT_SIZE /**< DNS cookies cache size. */
 #endif
+#ifndef LRU_TFO_SIZE
+#define LRU_TFO_SIZE (LRU_RTT_SIZE / 16) /**< Outgoing TCP Fast Open status cache size */
+#endif
 #ifndef MP_FREELIST_SIZE
-#define MP_FREELIST_SIZE 64 /**< Maximum length of the worker mempool freelist */
+#define MP_FREELIST_SIZE 64 /**< Length of the worker freelists, lower bound for the mempool freelist */
+#endif
+#ifndef MP_FREELIST_MAX
+#define MP_FREELIST_MAX (16 * MP_FREELIST_SIZE) /**< Maximum length of the worker mempool freelist */
 #endif
 #ifndef RECVMMSG_BATCH
 #define RECVMMSG_BATCH 4
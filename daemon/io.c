@@ -15,6 +15,7 @@
  */
 
 #include <string.h>
+#include <unistd.h>
 #include <libknot/errcode.h>
 #include <contrib/ucw/lib.h>
 #include <contrib/ucw/mempool.h>
@@ -46,11 +47,17 @@ static void check_bufsize(uv_handle_t* handle)
 
 #undef negotiate_bufsize
 
+/* Stream buffer starts at the former fixed read size and grows with the incoming data rate,
+ * it's bounded to fit a few maximum-sized messages. */
+#define SESSION_WIREBUF_MIN 4096
+#define SESSION_WIREBUF_MAX (4 * (KNOT_WIRE_MAX_PKTSIZE + sizeof(uint16_t)))
+
 static void session_clear(struct session *s)
 {
 	assert(s->outgoing || s->tasks.len == 0);
 	array_clear(s->tasks);
 	tls_free(s->tls_ctx);
+	free(s->wire_buf);
 	memset(s, 0, sizeof(*s));
 }
 
@@ -67,6 +74,54 @@ struct session *session_new(void)
 	return calloc(1, sizeof(struct session));
 }
 
+int session_wirebuf_reserve(struct session *s, size_t want)
+{
+	want = MAX(want, SESSION_WIREBUF_MIN);
+	/* Everything is processed, rewind to the beginning. */
+	if (s->wire_buf_start == s->wire_buf_end) {
+		s->wire_buf_start = 0;
+		s->wire_buf_end = 0;
+	}
+	if (s->wire_buf_size - s->wire_buf_end >= want) {
+		return kr_ok();
+	}
+	/* Move the unprocessed part (at most one incomplete message) to the front. */
+	if (s->wire_buf_start > 0) {
+		size_t pending = s->wire_buf_end - s->wire_buf_start;
+		memmove(s->wire_buf, s->wire_buf + s->wire_buf_start, pending);
+		s->wire_buf_start = 0;
+		s->wire_buf_end = pending;
+		if (s->wire_buf_size - s->wire_buf_end >= want) {
+			return kr_ok();
+		}
+	}
+	size_t size = MAX(s->wire_buf_size, SESSION_WIREBUF_MIN);
+	while (size - s->wire_buf_end < want) {
+		size *= 2;
+	}
+	if (size > SESSION_WIREBUF_MAX) {
+		return kr_error(ENOBUFS);
+	}
+	uint8_t *buf = realloc(s->wire_buf, size);
+	if (!buf) {
+		return kr_error(ENOMEM);
+	}
+	s->wire_buf = buf;
+	s->wire_buf_size = size;
+	return kr_ok();
+}
+
+void session_wirebuf_adapt(struct session *s, size_t nread, size_t avail)
+{
+	/* Read filled all available space, there's likely more data pending. */
+	if (nread >= avail) {
+		s->wire_buf_want = MIN(MAX(2 * s->wire_buf_want, SESSION_WIREBUF_MIN), SESSION_WIREBUF_MAX / 2);
+	/* Traffic slowed down, shrink the read size. */
+	} else if (nread < s->wire_buf_want / 4) {
+		s->wire_buf_want = MAX(s->wire_buf_want / 2, SESSION_WIREBUF_MIN);
+	}
+}
+
 static struct session *session_borrow(struct worker_ctx *worker)
 {
 	struct session *s = NULL;
@@ -107,7 +162,7 @@ static uv_stream_t *handle_alloc(uv_loop_t *loop)
 static void handle_getbuf(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
 {
 	/* Worker has single buffer which is reused for all incoming
-	 * datagrams / stream reads, the content of the buffer is
+	 * datagrams / TLS records, the content of the buffer is
 	 * guaranteed to be unchanged only for the duration of
 	 * udp_read() and tcp_read().
 	 */
@@ -115,9 +170,19 @@ static void handle_getbuf(uv_handle_t* handle, size_t suggested_size, uv_buf_t*
 	uv_loop_t *loop = handle->loop;
 	struct worker_ctx *worker = loop->data;
 	buf->base = (char *)worker->wire_buf;
-	/* Limit TCP stream buffer size to 4K for granularity in batches of incoming queries. */
-	if (handle->type == UV_TCP) {
-		buf->len = MIN(suggested_size, 4096);
+	/* Plain TCP streams are read directly into the session buffer,
+	 * so that complete messages can be parsed in place. */
+	if (handle->type == UV_TCP && !session->has_tls) {
+		if (session_wirebuf_reserve(session, session->wire_buf_want) != 0) {
+			buf->base = NULL; /* Read callback gets UV_ENOBUFS */
+			buf->len = 0;
+			return;
+		}
+		buf->base = (char *)session->wire_buf + session->wire_buf_end;
+		buf->len = session->wire_buf_size - session->wire_buf_end;
+	/* TLS records are decrypted into the session buffer in tls_process(). */
+	} else if (handle->type == UV_TCP) {
+		buf->len = sizeof(worker->wire_buf);
 	/* Regular buffer size for subrequests. */
 	} else if (session->outgoing) {
 		buf->len = suggested_size;
@@ -210,6 +275,9 @@ static void tcp_recv(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf)
 	if (s->has_tls) {
 		ret = tls_process(worker, handle, (const uint8_t *)buf->base, nread);
 	} else {
+		if (nread > 0) {
+			session_wirebuf_adapt(s, nread, buf->len);
+		}
 		ret = worker_process_tcp(worker, handle, (const uint8_t *)buf->base, nread);
 	}
 	if (ret < 0) {
@@ -281,6 +349,47 @@ static int set_tcp_option(uv_handle_t *handle, int option, int val)
 	return 0; /* N/A */
 }
 
+int io_tcp_fastopen(uv_handle_t *handle, int family)
+{
+#ifdef TCP_FASTOPEN_CONNECT
+	/* Socket must exist before connect(), the first write is then sent in SYN
+	 * if the kernel has a cookie for the peer, or a cookie is requested otherwise. */
+	int fd = socket(family, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return kr_error(errno);
+	}
+	int ret = 0;
+	int on = 1;
+	if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on)) != 0) {
+		ret = kr_error(errno);
+	} else {
+		ret = uv_tcp_open((uv_tcp_t *)handle, (uv_os_sock_t) fd);
+	}
+	if (ret != 0) {
+		close(fd);
+	}
+	return ret;
+#else
+	return kr_error(ENOTSUP);
+#endif
+}
+
+int io_tcp_fastopen_acked(uv_handle_t *handle)
+{
+#if defined(TCP_INFO) && defined(TCPI_OPT_SYN_DATA)
+	uv_os_fd_t fd = 0;
+	struct tcp_info info;
+	socklen_t info_len = sizeof(info);
+	if (uv_fileno(handle, &fd) != 0 ||
+	    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) != 0) {
+		return kr_error(EBADF);
+	}
+	return (info.tcpi_options & TCPI_OPT_SYN_DATA) ? 1 : 0;
+#else
+	return kr_error(ENOTSUP);
+#endif
+}
+
 static int tcp_bind_finalize(uv_handle_t *handle)
 {
 	/* TCP_FASTOPEN enables 1 RTT connection resumptions. */
@@ -403,6 +512,8 @@ int io_start_read(uv_handle_t *handle)
 {
 	if (handle->type == UV_UDP) {
 		return uv_udp_recv_start((uv_udp_t *)handle, &handle_getbuf, &udp_recv);
+	} else if (handle->type == UV_POLL) {
+		return kr_ok(); /* XDP rings are polled all the time, see xdp.c */
 	} else {
 		return uv_read_start((uv_stream_t *)handle, &handle_getbuf, &tcp_recv);
 	}
@@ -412,6 +523,8 @@ int io_stop_read(uv_handle_t *handle)
 {
 	if (handle->type == UV_UDP) {
 		return uv_udp_recv_stop((uv_udp_t *)handle);
+	} else if (handle->type == UV_POLL) {
+		return kr_ok();
 	} else {
 		return uv_read_stop((uv_stream_t *)handle);
 	}
@@ -30,15 +30,33 @@ struct session {
 	bool outgoing;
 	bool throttled;
 	bool has_tls;
+	bool fastopen;
 	uv_timer_t timeout;
-	struct qr_task *buffering;
 	struct tls_ctx_t *tls_ctx;
 	array_t(struct qr_task *) tasks;
+	union {
+		struct sockaddr_in ip4;
+		struct sockaddr_in6 ip6;
+	} peer; /* Remote address of outgoing stream */
+	/* Stream reassembly buffer, data between start and end is not processed yet. */
+	uint8_t *wire_buf;
+	uint32_t wire_buf_size;
+	uint32_t wire_buf_start;
+	uint32_t wire_buf_end;
+	uint32_t wire_buf_want; /* Adaptive read size */
 };
 
 void session_free(struct session *s);
 struct session *session_new(void);
 
+/** Make room for at least 'want' bytes at the end of session stream buffer.
+  * Processed data is discarded and the buffer grows up to a hard limit.
+  * @return 0 or an error code */
+int session_wirebuf_reserve(struct session *s, size_t want);
+
+/** Adapt the next read size to the amount of data read into 'avail' bytes of space. */
+void session_wirebuf_adapt(struct session *s, size_t nread, size_t avail);
+
 int udp_bind(uv_udp_t *handle, struct sockaddr *addr);
 int udp_bindfd(uv_udp_t *handle, int fd);
 int tcp_bind(uv_tcp_t *handle, struct sockaddr *addr);
@@ -50,5 +68,12 @@ void io_create(uv_loop_t *loop, uv_handle_t *handle, int type);
 void io_deinit(uv_handle_t *handle);
 void io_free(uv_handle_t *handle);
 
+/** Open outgoing TCP socket with client-side TCP Fast Open, must be called before uv_tcp_connect().
+  * @return 0 or an error code (the handle is left intact and may connect without TFO) */
+int io_tcp_fastopen(uv_handle_t *handle, int family);
+/** Check if the peer acknowledged data sent in SYN.
+  * @return 1 if acknowledged, 0 if not, or an error code */
+int io_tcp_fastopen_acked(uv_handle_t *handle);
+
 int io_start_read(uv_handle_t *handle);
 int io_stop_read(uv_handle_t *handle);
@@ -0,0 +1,25 @@
+-- Helpers for latency histograms exported by stats module, see stats.latency()
+local M = {}
+
+-- Merge histogram from a worker, buckets are keyed by their maximum
+function M.merge(t, hist)
+	t.count = (t.count or 0) + hist.count
+	t.sum = (t.sum or 0) + hist.sum
+	t.buckets = t.buckets or {}
+	for _, b in ipairs(hist.buckets) do
+		t.buckets[b[1]] = (t.buckets[b[1]] or 0) + b[2]
+	end
+	return t
+end
+
+-- Return sorted bucket maximums of a merged histogram
+function M.bounds(hist)
+	local bounds = {}
+	for max in pairs(hist.buckets or {}) do
+		table.insert(bounds, max)
+	end
+	table.sort(bounds)
+	return bounds
+end
+
+return M
@@ -112,6 +112,7 @@ struct query_flag {
 	static const int BADCOOKIE_AGAIN = 1 << 22;
 	static const int CNAME       = 1 << 23;
 	static const int REORDER_RR  = 1 << 24;
+	static const int DNS64_MARK  = 1 << 25;
 };
 
 /*
@@ -185,6 +186,10 @@ typedef struct {
 	map_free_f free;
 	void *baton;
 } map_t;
+typedef struct {
+	struct lpm_node *root;
+	void *pool;
+} lpm_t;
 
 /* libkres */
 typedef struct {
@@ -225,6 +230,7 @@ struct kr_request {
 		const struct sockaddr *dst_addr;
 		const knot_pkt_t *packet;
 		const knot_rrset_t *opt;
+		bool tcp;
 	} qsource;
 	struct {
 	    unsigned rtt;
@@ -303,6 +309,26 @@ int kr_straddr_subnet(void *dst, const char *addr);
 int kr_bitcmp(const char *a, const char *b, int bits);
 int kr_family_len(int family);
 int kr_rrarray_add(rr_array_t *array, const knot_rrset_t *rr, void *pool);
+map_t *kr_suffix_new(void);
+void kr_suffix_free(map_t *set);
+int kr_suffix_add(map_t *set, const knot_dname_t *name);
+const knot_dname_t *kr_suffix_match(map_t *set, const knot_dname_t *name);
+int lpm_insert(lpm_t *tree, const uint8_t *key, unsigned bits, void *val);
+void *lpm_match(const lpm_t *tree, const uint8_t *key, unsigned bits, unsigned *match_bits);
+int lpm_match_all(const lpm_t *tree, const uint8_t *key, unsigned bits, void **vals, int max);
+void lpm_clear(lpm_t *tree);
+struct kr_rpz *kr_rpz_new(void);
+void kr_rpz_free(struct kr_rpz *rpz);
+int kr_rpz_add(struct kr_rpz *rpz, const knot_dname_t *owner, int action);
+int kr_rpz_match(struct kr_rpz *rpz, const knot_dname_t *name);
+struct kr_ruleset *kr_ruleset_new(void);
+void kr_ruleset_free(struct kr_ruleset *rs);
+int kr_ruleset_add(struct kr_ruleset *rs, int id, const knot_dname_t *qname,
+                   const char *src, const char *dst);
+int kr_ruleset_and(struct kr_ruleset *rs, int id, const knot_dname_t *qname,
+                   const char *src, const char *dst);
+int kr_ruleset_match(struct kr_ruleset *rs, const knot_dname_t *qname,
+                     const struct sockaddr *src, const struct sockaddr *dst, int *ids, int max);
 /* Trust anchors */
 knot_rrset_t *kr_ta_get(map_t *trust_anchors, const knot_dname_t *name);
 int kr_ta_add(map_t *trust_anchors, const knot_dname_t *name, uint16_t type,
@@ -17,6 +17,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <sched.h>
+#include <poll.h>
 #include <uv.h>
 #include <assert.h>
 #include <contrib/cleanup.h>
@@ -46,6 +48,7 @@
  */
 static bool g_quiet = false;
 static bool g_interactive = true;
+static bool g_pin = false;
 
 /*
  * TTY control
@@ -254,12 +257,14 @@ static const char *set_addr(char *addr, int *port)
  * Server operation.
  */
 
-static int fork_workers(fd_array_t *ipc_set, int forks)
+static int fork_workers(fd_array_t *ipc_set, fd_array_t *sync_set, int forks)
 {
 	/* Fork subprocesses if requested */
 	while (--forks > 0) {
 		int sv[2] = {-1, -1};
-		if (socketpair(AF_LOCAL, SOCK_STREAM, 0, sv) < 0) {
+		int sync_sv[2] = {-1, -1};
+		if (socketpair(AF_LOCAL, SOCK_STREAM, 0, sv) < 0 ||
+		    socketpair(AF_LOCAL, SOCK_STREAM, 0, sync_sv) < 0) {
 			perror("[system] socketpair");
 			return kr_error(errno);
 		}
@@ -274,18 +279,158 @@ static int fork_workers(fd_array_t *ipc_set, int forks)
 			array_clear(*ipc_set);
 			array_push(*ipc_set, sv[0]);
 			close(sv[1]);
+			/* Do not keep startup pipes of other forks open, so they see the leader's EOF. */
+			for (size_t i = 0; i < sync_set->len; ++i) {
+				close(sync_set->at[i]);
+			}
+			array_clear(*sync_set);
+			array_push(*sync_set, sync_sv[0]);
+			close(sync_sv[1]);
 			return forks;
 		/* Parent process */
 		} else {
 			array_push(*ipc_set, sv[1]);
+			array_push(*sync_set, sync_sv[1]);
 			/* Do not share parent-end with other forks. */
 			(void) fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+			(void) fcntl(sync_sv[1], F_SETFD, FD_CLOEXEC);
 			close(sv[0]);
+			close(sync_sv[0]);
 		}
 	}
 	return 0;
 }
 
+/** Pin the process to the n-th CPU it's allowed to run on (modulo CPU count).
+  * @return number of allowed CPUs or an error code */
+static int pin_cpu(int n)
+{
+#ifdef CPU_SET
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+		return kr_error(errno);
+	}
+	int count = CPU_COUNT(&set);
+	if (count <= 0) {
+		return kr_error(EINVAL);
+	}
+	int skip = n % count;
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (!CPU_ISSET(cpu, &set) || skip-- > 0) {
+			continue;
+		}
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+			return kr_error(errno);
+		}
+		return count;
+	}
+	return kr_error(EINVAL);
+#else
+	return kr_error(ENOTSUP);
+#endif
+}
+
+/** Check that CPUs 0..forks-1 are allowed, i.e. the n-th allowed CPU is the CPU n for each fork.
+  * Steering maps the id of the receiving CPU to the socket index, so it must match the pinned fork.
+  * @note Call it before pin_cpu(), as pinning changes the allowed set. */
+static bool cpu_ids_allowed(int forks)
+{
+#ifdef CPU_SET
+	cpu_set_t set;
+	if (forks > CPU_SETSIZE || sched_getaffinity(0, sizeof(set), &set) != 0) {
+		return false;
+	}
+	for (int cpu = 0; cpu < forks; ++cpu) {
+		if (!CPU_ISSET(cpu, &set)) {
+			return false;
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* @internal Startup handshake for CPU steering over dedicated pipes (the IPC pipes carry framed
+ * expressions later, so stray tokens must not end up there). Each step is answered even if the
+ * fork fails, and all reads time out, so a failed fork can't stall the startup. */
+#define SYNC_TIMEOUT (10 * 1000) /* ms */
+enum { SYNC_NO = 0, SYNC_YES = 1 };
+
+static int sync_read(int fd, int timeout)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	for (;;) {
+		int ret = poll(&pfd, 1, timeout);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return kr_error(ret == 0 ? ETIMEDOUT : errno);
+		}
+		char token = SYNC_NO;
+		ssize_t rb = read(fd, &token, sizeof(token));
+		if (rb == sizeof(token)) {
+			return token;
+		} else if (rb == 0) {
+			return kr_error(EPIPE);
+		} else if (errno != EINTR && errno != EAGAIN) {
+			return kr_error(errno);
+		}
+	}
+}
+
+static bool sync_write(int fd, bool yes)
+{
+	const char token = yes ? SYNC_YES : SYNC_NO;
+	return send(fd, &token, sizeof(token), MSG_NOSIGNAL) == sizeof(token);
+}
+
+/* @internal All sockets in the SO_REUSEPORT group must steer or none, so forks vote whether they
+ * can steer and the leader broadcasts the verdict, which is to steer only if everyone can. */
+static bool sync_steering(fd_array_t *sync_set, bool leader, int forks, bool vote)
+{
+	if (!leader) {
+		if (!sync_write(sync_set->at[0], vote)) {
+			return false;
+		}
+		return sync_read(sync_set->at[0], (forks + 1) * SYNC_TIMEOUT) == SYNC_YES;
+	}
+	bool verdict = vote;
+	for (size_t i = 0; i < sync_set->len; ++i) {
+		if (sync_read(sync_set->at[i], SYNC_TIMEOUT) != SYNC_YES) {
+			verdict = false;
+		}
+	}
+	for (size_t i = 0; i < sync_set->len; ++i) {
+		(void) sync_write(sync_set->at[i], verdict);
+	}
+	return verdict;
+}
+
+/* @internal Forks must join SO_REUSEPORT groups in order of their IDs for CPU steering,
+ * so the leader binds first and then lets forks bind one by one. */
+static void sync_bind_release(fd_array_t *sync_set)
+{
+	/* Forks were created in descending order of IDs. */
+	for (size_t i = sync_set->len; i--;) {
+		if (!sync_write(sync_set->at[i], true) || sync_read(sync_set->at[i], SYNC_TIMEOUT) != SYNC_YES) {
+			kr_log_error("[system] fork %zu failed to bind in order, CPU steering is not reliable\n",
+			             sync_set->len - i);
+		}
+	}
+}
+
+static void sync_close(fd_array_t *sync_set)
+{
+	for (size_t i = 0; i < sync_set->len; ++i) {
+		close(sync_set->at[i]);
+	}
+	array_clear(*sync_set);
+}
+
 static void help(int argc, char *argv[])
 {
 	printf("Usage: %s [parameters] [rundir]\n", argv[0]);
@@ -297,6 +442,7 @@ static void help(int argc, char *argv[])
 	       " -c, --config=[path]  Config file path (relative to [rundir]) (default: config).\n"
 	       " -k, --keyfile=[path] File containing trust anchors (DS or DNSKEY).\n"
 	       " -f, --forks=N        Start N forks sharing the configuration.\n"
+	       " -p, --pin            Pin fork N to CPU N and steer datagrams to the fork on the receiving CPU.\n"
 	       " -q, --quiet          Quiet output, no prompt in interactive mode.\n"
 	       " -v, --verbose        Run in verbose mode.\n"
 	       " -V, --version        Print version of the server.\n"
@@ -390,13 +536,14 @@ int main(int argc, char **argv)
 		{"config", required_argument, 0, 'c'},
 		{"keyfile",required_argument, 0, 'k'},
 		{"forks",required_argument,   0, 'f'},
+		{"pin",        no_argument,   0, 'p'},
 		{"verbose",    no_argument,   0, 'v'},
 		{"quiet",      no_argument,   0, 'q'},
 		{"version",   no_argument,    0, 'V'},
 		{"help",      no_argument,    0, 'h'},
 		{0, 0, 0, 0}
 	};
-	while ((c = getopt_long(argc, argv, "a:t:S:T:c:f:k:vqVh", opts, &li)) != -1) {
+	while ((c = getopt_long(argc, argv, "a:t:S:T:c:f:k:pvqVh", opts, &li)) != -1) {
 		switch (c)
 		{
 		case 'a':
@@ -423,6 +570,9 @@ int main(int argc, char **argv)
 				return EXIT_FAILURE;
 			}
 			break;
+		case 'p':
+			g_pin = true;
+			break;
 		case 'k':
 			keyfile_buf = malloc(PATH_MAX);
 			if (!keyfile_buf) {
@@ -528,13 +678,31 @@ int main(int argc, char **argv)
 #endif
 
 	/* Connect forks with local socket */
-	fd_array_t ipc_set;
+	fd_array_t ipc_set, sync_set;
 	array_init(ipc_set);
+	array_init(sync_set);
 	/* Fork subprocesses if requested */
-	int fork_id = fork_workers(&ipc_set, forks);
+	int fork_id = fork_workers(&ipc_set, &sync_set, forks);
 	if (fork_id < 0) {
 		return EXIT_FAILURE;
 	}
+	/* Pin forks to CPUs, steering is possible only if each fork N runs on the CPU N. */
+	bool steering = false;
+	if (g_pin) {
+		bool vote = (forks > 1 && cpu_ids_allowed(forks));
+		ret = pin_cpu(fork_id);
+		if (ret < 0) {
+			kr_log_error("[system] failed to pin fork %d: %s\n", fork_id, kr_strerror(ret));
+			vote = false;
+		}
+		if (forks > 1) {
+			steering = sync_steering(&sync_set, fork_id == 0, forks, vote);
+			if (!steering && fork_id == 0) {
+				kr_log_info("[system] CPU steering disabled, forks can't be pinned to CPUs 0-%d\n", forks - 1);
+			}
+		}
+		ret = 0;
+	}
 
 	kr_crypto_init();
 
@@ -549,6 +717,9 @@ int main(int argc, char **argv)
 		kr_log_error("[system] failed to initialize engine: %s\n", kr_strerror(ret));
 		return EXIT_FAILURE;
 	}
+	if (steering) {
+		engine.net.cpu_steering = forks;
+	}
 	/* Create worker */
 	struct worker_ctx *worker = worker_create(&engine, &pool, fork_id, forks);
 	if (!worker) {
@@ -573,6 +744,10 @@ int main(int argc, char **argv)
 			break;
 		}
 	}
+	/* Wait for the turn to bind, see sync_bind_release() */
+	if (steering && fork_id > 0 && sync_read(sync_set.at[0], forks * SYNC_TIMEOUT) != SYNC_YES) {
+		kr_log_error("[system] failed to bind in order, CPU steering is not reliable\n");
+	}
 	/* Bind to sockets and run */
 	if (ret == 0) {
 		for (size_t i = 0; i < addr_set.len; ++i) {
@@ -612,24 +787,37 @@ int main(int argc, char **argv)
 	loop->data = worker;
 	if (ret == 0) {
 		ret = engine_start(&engine, config ? config : "config");
-		if (ret == 0) {
-			if (keyfile) {
-				auto_free char *cmd = afmt("trust_anchors.config('%s')", keyfile);
-				if (!cmd) {
-					kr_log_error("[system] not enough memory\n");
-					return EXIT_FAILURE;
-				}
-				engine_cmd(engine.L, cmd, false);
-				lua_settop(engine.L, 0);
+		if (ret == 0 && keyfile) {
+			auto_free char *cmd = afmt("trust_anchors.config('%s')", keyfile);
+			if (!cmd) {
+				kr_log_error("[system] not enough memory\n");
+				return EXIT_FAILURE;
 			}
-			/* Run the event loop */
-			ret = run_worker(loop, &engine, &ipc_set, fork_id == 0, control_fd);
+			engine_cmd(engine.L, cmd, false);
+			lua_settop(engine.L, 0);
 		}
 		if (ret != 0) {
 			perror("[system] worker failed");
 			ret = EXIT_FAILURE;
 		}
 	}
+	/* Configuration is loaded and sockets bound (or failed to), let the next fork bind. */
+	if (steering) {
+		if (fork_id == 0) {
+			sync_bind_release(&sync_set);
+		} else {
+			(void) sync_write(sync_set.at[0], ret == 0);
+		}
+	}
+	sync_close(&sync_set);
+	/* Run the event loop */
+	if (ret == 0) {
+		ret = run_worker(loop, &engine, &ipc_set, fork_id == 0, control_fd);
+		if (ret != 0) {
+			perror("[system] worker failed");
+			ret = EXIT_FAILURE;
+		}
+	}
 	/* Cleanup. */
 	free(keyfile);
 	engine_deinit(&engine);
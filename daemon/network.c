@@ -16,10 +16,14 @@
 
 #include <unistd.h>
 #include <assert.h>
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
 #include "daemon/network.h"
 #include "daemon/worker.h"
 #include "daemon/io.h"
 #include "daemon/tls.h"
+#include "daemon/xdp.h"
 
 /* libuv 1.7.0+ is able to support SO_REUSEPORT for loadbalancing */
 #if defined(UV_VERSION_HEX)
@@ -51,6 +55,7 @@ void network_init(struct network *net, uv_loop_t *loop)
 	if (net != NULL) {
 		net->loop = loop;
 		net->endpoints = map_make();
+		array_init(net->xdp);
 	}
 }
 
@@ -105,6 +110,10 @@ void network_deinit(struct network *net)
 		map_walk(&net->endpoints, close_key, 0);
 		map_walk(&net->endpoints, free_key, 0);
 		map_clear(&net->endpoints);
+		for (size_t i = 0; i < net->xdp.len; ++i) {
+			xdp_close(net->xdp.at[i]);
+		}
+		array_clear(net->xdp);
 		tls_credentials_free(net->tls_credentials);
 		net->tls_credentials = NULL;
 	}
@@ -133,6 +142,34 @@ static int insert_endpoint(struct network *net, const char *addr, struct endpoin
 	return kr_ok();
 }
 
+/** Steer datagrams to the socket with the same index in the SO_REUSEPORT group as the receiving CPU.
+  * @note Forks join the group in order of their IDs and fork N is pinned to the CPU N (steering is enabled
+  *       only if all forks could be pinned so), so the datagram is delivered to the fork pinned to that CPU. */
+static int udp_steer_cpu(uv_udp_t *handle, unsigned nsocks)
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	uv_os_fd_t fd = 0;
+	if (uv_fileno((uv_handle_t *)handle, &fd) != 0) {
+		return kr_error(EBADF);
+	}
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD  | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nsocks),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code
+	};
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0) {
+		return kr_error(errno);
+	}
+	return kr_ok();
+#else
+	return kr_error(ENOTSUP);
+#endif
+}
+
 /** Open endpoint protocols. */
 static int open_endpoint(struct network *net, struct endpoint *ep, struct sockaddr *sa, uint32_t flags)
 {
@@ -148,6 +185,13 @@ static int open_endpoint(struct network *net, struct endpoint *ep, struct sockad
 		if (ret != 0) {
 			return ret;
 		}
+		if (net->cpu_steering > 1) {
+			ret = udp_steer_cpu(ep->udp, net->cpu_steering);
+			if (ret != 0) {
+				kr_log_info("[system] CPU steering: %s\n", kr_strerror(ret));
+				ret = 0;
+			}
+		}
 		ep->flags |= NET_UDP;
 	}
 	if (flags & NET_TCP) {
@@ -345,3 +389,17 @@ int network_close(struct network *net, const char *addr, uint16_t port)
 
 	return kr_ok();
 }
+
+int network_xdp(struct network *net, const char *ifname, uint16_t port, uint32_t queue, bool generic)
+{
+	struct xdp_ctx *ctx = NULL;
+	int ret = xdp_open(&ctx, net->loop, ifname, queue, port, generic);
+	if (ret != 0) {
+		return ret;
+	}
+	if (array_push(net->xdp, ctx) < 0) {
+		xdp_close(ctx);
+		return kr_error(ENOMEM);
+	}
+	return kr_ok();
+}
@@ -40,10 +40,14 @@ struct endpoint {
 typedef array_t(struct endpoint*) endpoint_array_t;
 /* @endcond */
 
+struct xdp_ctx;
+
 struct network {
 	uv_loop_t *loop;
 	map_t endpoints;
 	struct tls_credentials *tls_credentials;
+	unsigned cpu_steering; /**< Steer datagrams among N forks by receiving CPU, 0 = off */
+	array_t(struct xdp_ctx *) xdp; /**< AF_XDP sockets bypassing the kernel UDP stack */
 };
 
 void network_init(struct network *net, uv_loop_t *loop);
@@ -51,5 +55,6 @@ void network_deinit(struct network *net);
 int network_listen_fd(struct network *net, int fd, bool use_tls);
 int network_listen(struct network *net, const char *addr, uint16_t port, uint32_t flags);
 int network_close(struct network *net, const char *addr, uint16_t port);
+int network_xdp(struct network *net, const char *ifname, uint16_t port, uint32_t queue, bool generic);
 int network_set_tls_cert(struct network *net, const char *cert);
 int network_set_tls_key(struct network *net, const char *key);
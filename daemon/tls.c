@@ -48,7 +48,6 @@ struct tls_ctx_t {
 	const uint8_t *buf;
 	ssize_t nread;
 	ssize_t consumed;
-	uint8_t recv_buf[4096];
 	struct tls_credentials *credentials;
 };
 
@@ -245,7 +244,14 @@ int tls_process(struct worker_ctx *worker, uv_stream_t *handle, const uint8_t *b
 
 	int submitted = 0;
 	while (true) {
-		ssize_t count = gnutls_record_recv(tls_p->session, tls_p->recv_buf, sizeof(tls_p->recv_buf));
+		/* Decrypt directly into the session stream buffer, worker parses messages in place. */
+		int ret = session_wirebuf_reserve(session, session->wire_buf_want);
+		if (ret != 0) {
+			return ret;
+		}
+		uint8_t *dst = session->wire_buf + session->wire_buf_end;
+		size_t avail = session->wire_buf_size - session->wire_buf_end;
+		ssize_t count = gnutls_record_recv(tls_p->session, dst, avail);
 		if (count == GNUTLS_E_AGAIN) {
 			break;    /* No data available */
 		} else if (count == GNUTLS_E_INTERRUPTED) {
@@ -256,7 +262,8 @@ int tls_process(struct worker_ctx *worker, uv_stream_t *handle, const uint8_t *b
 			return kr_error(EIO);
 		}
 		DEBUG_MSG("[tls] submitting %zd data to worker\n", count);
-		int ret = worker_process_tcp(worker, handle, tls_p->recv_buf, count);
+		session_wirebuf_adapt(session, count, avail);
+		ret = worker_process_tcp(worker, handle, dst, count);
 		if (ret < 0) {
 			return ret;
 		}
@@ -34,6 +34,7 @@
 #include "daemon/engine.h"
 #include "daemon/io.h"
 #include "daemon/tls.h"
+#include "daemon/xdp.h"
 
 /* @internal Union of various libuv objects for freelist. */
 struct req
@@ -195,13 +196,14 @@ static inline struct mempool *pool_borrow(struct worker_ctx *worker)
 static inline void pool_release(struct worker_ctx *worker, struct mempool *mp)
 {
 	/* Return mempool to ring or free it if it's full */
-	if (worker->pool_mp.len < MP_FREELIST_SIZE) {
+	if (worker->pool_mp.len < worker->gc.pool_max) {
 		mp_flush(mp);
-		array_push(worker->pool_mp, mp);
-		mp_poison(mp, 1);
-	} else {
-		mp_delete(mp);
+		if (array_push(worker->pool_mp, mp) >= 0) {
+			mp_poison(mp, 1);
+			return;
+		}
 	}
+	mp_delete(mp);
 }
 
 /** @internal Get key from current outgoing subrequest. */
@@ -245,7 +247,6 @@ static struct qr_task *qr_task_create(struct worker_ctx *worker, uv_handle_t *ha
 	array_init(task->waiting);
 	task->addrlist = NULL;
 	task->pending_count = 0;
-	task->bytes_remaining = 0;
 	task->iter_count = 0;
 	task->timeouts = 0;
 	task->refs = 1;
@@ -261,6 +262,7 @@ static struct qr_task *qr_task_create(struct worker_ctx *worker, uv_handle_t *ha
 	task->req.qsource.dst_addr = NULL;
 	task->req.qsource.packet = NULL;
 	task->req.qsource.opt = NULL;
+	task->req.qsource.tcp = handle && handle->type == UV_TCP;
 	/* Remember query source addr */
 	if (addr) {
 		size_t addr_len = sizeof(struct sockaddr_in);
@@ -284,9 +286,14 @@ static struct qr_task *qr_task_create(struct worker_ctx *worker, uv_handle_t *ha
 			if (uv_tcp_getsockname((uv_tcp_t *)handle, dst_addr, &addr_len) == 0) {
 				task->req.qsource.dst_addr = dst_addr;
 			}
+		} else if (handle->type == UV_POLL) {
+			if (xdp_getsockname(handle, dst_addr) == 0) {
+				task->req.qsource.dst_addr = dst_addr;
+			}
 		}
 	}
 	worker->stats.concurrent += 1;
+	worker->gc.peak = MAX(worker->gc.peak, worker->stats.concurrent);
 	return task;
 }
 
@@ -318,15 +325,7 @@ static void qr_task_free(struct qr_task *task)
 	/* Return mempool to ring or free it if it's full */
 	pool_release(worker, task->req.pool.ctx);
 	/* @note The 'task' is invalidated from now on. */
-	/* Decommit memory every once in a while */
-	static int mp_delete_count = 0;
-	if (++mp_delete_count == 100000) {
-		lua_gc(worker->engine->L, LUA_GCCOLLECT, 0);
-#if defined(__GLIBC__) && defined(_GNU_SOURCE)
-		malloc_trim(0);
-#endif
-		mp_delete_count = 0;
-	}
+	worker->gc.freed += 1;
 }
 
 static int qr_task_start(struct qr_task *task, knot_pkt_t *query)
@@ -338,6 +337,10 @@ static int qr_task_start(struct qr_task *task, knot_pkt_t *query)
 	} else if (knot_pkt_has_edns(query)) { /* EDNS */
 		answer_max = MAX(knot_edns_get_payload(query->opt_rr), KNOT_WIRE_MIN_PKTSIZE);
 	}
+	/* XDP answers must fit a single frame, larger answers are truncated. */
+	if (task->source.handle && task->source.handle->type == UV_POLL) {
+		answer_max = MIN(answer_max, xdp_payload_max(task->source.handle, task->source.addr.ip4.sin_family));
+	}
 
 	knot_pkt_t *answer = knot_pkt_new(NULL, answer_max, &task->req.pool);
 	if (!answer) {
@@ -461,6 +464,11 @@ static int qr_task_send(struct qr_task *task, uv_handle_t *handle, struct sockad
 		int ret = tls_push(task, handle, pkt);
 		return qr_task_on_send(task, handle, ret);
 	}
+	/* Answers over XDP are written directly to the transmit ring. */
+	if (handle->type == UV_POLL) {
+		int ret = xdp_send(handle, (struct sockaddr *)&task->source.dst_addr, addr, pkt);
+		return qr_task_on_send(task, handle, ret);
+	}
 
 	int ret = 0;
 	struct req *send_req = req_borrow(task->worker);
@@ -522,6 +530,29 @@ static int qr_task_send(struct qr_task *task, uv_handle_t *handle, struct sockad
 	return ret;
 }
 
+/** @internal Check if the server is not known to refuse data in SYN. */
+static bool tfo_allowed(struct worker_ctx *worker, const struct sockaddr *addr)
+{
+	uint8_t *fails = lru_get_try(worker->tcp_fastopen, kr_inaddr(addr), kr_inaddr_len(addr));
+	return !fails || *fails < TFO_MAX_FAILS;
+}
+
+/** @internal Track whether the server accepted data in SYN (i.e. it has issued a valid cookie).
+  * The first connection only acquires the cookie, so a few failures are tolerated. */
+static void tfo_update(struct worker_ctx *worker, uv_handle_t *handle)
+{
+	struct session *session = handle->data;
+	int acked = io_tcp_fastopen_acked(handle);
+	if (acked < 0) {
+		return;
+	}
+	const struct sockaddr *addr = (const struct sockaddr *)&session->peer;
+	uint8_t *fails = lru_get_new(worker->tcp_fastopen, kr_inaddr(addr), kr_inaddr_len(addr));
+	if (fails) {
+		*fails = acked ? 0 : MIN(*fails + 1, TFO_MAX_FAILS);
+	}
+}
+
 static void on_connect(uv_connect_t *req, int status)
 {
 	struct worker_ctx *worker = get_worker();
@@ -529,10 +560,10 @@ static void on_connect(uv_connect_t *req, int status)
 	uv_stream_t *handle = req->handle;
 	if (qr_valid_handle(task, (uv_handle_t *)req->handle)) {
 		if (status == 0) {
-			struct sockaddr_storage addr;
-			int addr_len = sizeof(addr);
-			uv_tcp_getpeername((uv_tcp_t *)handle, (struct sockaddr *)&addr, &addr_len);
-			qr_task_send(task, (uv_handle_t *)handle, (struct sockaddr *)&addr, task->pktbuf);
+			/* Use the connect() target, the peer name isn't available
+			 * until the handshake completes with TCP Fast Open. */
+			struct session *session = handle->data;
+			qr_task_send(task, (uv_handle_t *)handle, (struct sockaddr *)&session->peer, task->pktbuf);
 		} else {
 			qr_task_step(task, task->addrlist, NULL);
 		}
@@ -567,7 +598,12 @@ static void on_timeout(uv_timer_t *req)
 			}
 			kr_nsrep_update_rtt(&qry->ns, choice, KR_NS_TIMEOUT,
 					    worker->engine->resolver.cache_rtt, KR_NS_UPDATE);
+			kr_resolve_timeout(&task->req, choice);
 		}
+	} else if (task->pending_count > 0) {
+		/* Connection isn't shared, its target is kept in the session. */
+		struct session *session = task->pending[0]->data;
+		kr_resolve_timeout(&task->req, (struct sockaddr *)&session->peer);
 	}
 	/* Release timer handle */
 	task->timeout = NULL;
@@ -593,6 +629,27 @@ static bool retransmit(struct qr_task *task)
 	return false;
 }
 
+/** @internal Retransmission timeout of the address the last datagram was sent to. */
+static uint64_t retransmit_rto(struct qr_task *task)
+{
+	kr_nsrep_rtt_lru_t *cache = task->worker->engine->resolver.cache_rtt;
+	size_t last = (task->addrlist_turn + task->addrlist_count - 1) % task->addrlist_count;
+	struct sockaddr_in6 *choice = &((struct sockaddr_in6 *)task->addrlist)[last];
+	return kr_nsrep_rto(cache, (struct sockaddr *)choice);
+}
+
+/** @internal Largest retransmission timeout of the tried addresses. */
+static uint64_t retransmit_rto_max(struct qr_task *task)
+{
+	kr_nsrep_rtt_lru_t *cache = task->worker->engine->resolver.cache_rtt;
+	uint64_t rto = 0;
+	for (uint16_t i = 0; i < task->addrlist_count; ++i) {
+		struct sockaddr_in6 *choice = &((struct sockaddr_in6 *)task->addrlist)[i];
+		rto = MAX(rto, kr_nsrep_rto(cache, (struct sockaddr *)choice));
+	}
+	return rto;
+}
+
 static void on_retransmit(uv_timer_t *req)
 {
 	struct qr_task *task = req->data;
@@ -600,12 +657,15 @@ static void on_retransmit(uv_timer_t *req)
 	assert(task->timeout != NULL);
 
 	uv_timer_stop(req);
-	if (!retransmit(req->data)) {
-		/* Not possible to spawn request, start timeout timer with remaining deadline. */
-		uint64_t timeout = KR_CONN_RTT_MAX - task->pending_count * KR_CONN_RETRY;
-		uv_timer_start(req, on_timeout, timeout, 0);
+	uint64_t elapsed = uv_now(task->worker->loop) - task->send_time;
+	uint64_t remaining = (elapsed < KR_CONN_RTT_MAX) ? KR_CONN_RTT_MAX - elapsed : 0;
+	if (remaining == 0 || !retransmit(task)) {
+		/* Not possible to spawn request, give the slowest server one more RTO
+		 * (at least the default retry interval) within the remaining deadline. */
+		uint64_t timeout = MAX(retransmit_rto_max(task), KR_CONN_RETRY);
+		uv_timer_start(req, on_timeout, MIN(timeout, remaining), 0);
 	} else {
-		uv_timer_start(req, on_retransmit, KR_CONN_RETRY, 0);
+		uv_timer_start(req, on_retransmit, MIN(retransmit_rto(task), remaining), 0);
 	}
 }
 
@@ -750,21 +810,12 @@ static int qr_task_step(struct qr_task *task, const struct sockaddr *packet_sour
 		if (subreq_enqueue(task)) {
 			return kr_ok(); /* Will be notified when outgoing query finishes. */
 		}
-		/* Check current query NSLIST */
-		struct kr_query *qry = array_tail(task->req.rplan.pending);
 		/* Start transmitting */
+		task->send_time = uv_now(task->worker->loop);
 		if (retransmit(task)) {
-			assert(qry != NULL);
-			/* Retransmit at default interval, or more frequently if the mean
-			 * RTT of the server is better. If the server is glued, use default rate. */
-			size_t timeout = qry->ns.score;
-			if (timeout > KR_NS_GLUED) {
-				/* We don't have information about variance in RTT, expect +10ms */
-				timeout = MIN(qry->ns.score + 10, KR_CONN_RETRY);
-			} else {
-				timeout = KR_CONN_RETRY;
-			}
-			ret = timer_start(task, on_retransmit, timeout, 0);
+			/* Retransmit after the RTO of the server derived from its RTT variance,
+			 * or at default interval if the server RTT isn't known yet. */
+			ret = timer_start(task, on_retransmit, retransmit_rto(task), 0);
 		} else {
 			return qr_task_step(task, NULL, NULL);
 		}
@@ -783,7 +834,17 @@ static int qr_task_step(struct qr_task *task, const struct sockaddr *packet_sour
 			return qr_task_step(task, NULL, NULL);
 		}
 		conn->data = task;
-		if (uv_tcp_connect(conn, (uv_tcp_t *)client, packet_source?packet_source:task->addrlist, on_connect) != 0) {
+		const struct sockaddr *addr = packet_source ? packet_source : task->addrlist;
+		struct session *session = client->data;
+		memcpy(&session->peer, addr, kr_inaddr_family(addr) == AF_INET6 ?
+		       sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		/* Send the query in SYN unless the server is known to refuse it,
+		 * this saves a round trip on fallbacks to TCP. */
+		if (tfo_allowed(task->worker, addr) &&
+		    io_tcp_fastopen(client, addr->sa_family) == 0) {
+			session->fastopen = true;
+		}
+		if (uv_tcp_connect(conn, (uv_tcp_t *)client, addr, on_connect) != 0) {
 			req_release(task->worker, (struct req *)conn);
 			return qr_task_step(task, NULL, NULL);
 		}
@@ -862,15 +923,6 @@ static int msg_size(const uint8_t *msg)
 		return wire_read_u16(msg);
 }
 
-/* If buffering, close last task as it isn't live yet. */
-static void discard_buffered(struct session *session)
-{
-	if (session->buffering) {
-		qr_task_free(session->buffering);
-		session->buffering = NULL;
-	}
-}
-
 int worker_end_tcp(struct worker_ctx *worker, uv_handle_t *handle)
 {
 	if (!worker || !handle) {
@@ -882,12 +934,58 @@ int worker_end_tcp(struct worker_ctx *worker, uv_handle_t *handle)
 	struct session *session = handle->data;
 	if (session->outgoing) {
 		worker_submit(worker, (uv_handle_t *)handle, NULL, NULL);	
-	} else {
-		discard_buffered(session);
 	}
 	return 0;
 }
 
+/** @internal Process a complete DNS/TCP message, 'wire' points into the session buffer. */
+static int process_tcp_msg(struct worker_ctx *worker, uv_stream_t *handle, uint8_t *wire, uint16_t len)
+{
+	struct session *session = handle->data;
+	/* Message is parsed in place, the buffer is valid until the next read. */
+	knot_pkt_t *pkt = knot_pkt_new(wire, len, &worker->pkt_pool);
+	if (!pkt) {
+		return kr_error(ENOMEM);
+	}
+	int ret = parse_packet(pkt);
+	if (ret != 0) {
+		return ret;
+	}
+	struct qr_task *task = NULL;
+	if (!session->outgoing) {
+		/* Get TCP peer name, keep zeroed address if it fails. */
+		struct sockaddr_storage addr;
+		memset(&addr, 0, sizeof(addr));
+		int addr_len = sizeof(addr);
+		uv_tcp_getpeername((uv_tcp_t *)handle, (struct sockaddr *)&addr, &addr_len);
+		task = qr_task_create(worker, (uv_handle_t *)handle, (struct sockaddr *)&addr);
+		if (!task) {
+			return kr_error(ENOMEM);
+		}
+		ret = qr_task_start(task, pkt);
+		if (ret != 0) {
+			qr_task_free(task);
+			return ret;
+		}
+		ret = qr_task_register(task, session);
+		if (ret != 0) {
+			qr_task_free(task);
+			return ret;
+		}
+	} else {
+		assert(session->tasks.len > 0);
+		task = array_tail(session->tasks);
+		if (session->fastopen) {
+			tfo_update(worker, (uv_handle_t *)handle);
+		}
+	}
+	ret = qr_task_step(task, NULL, pkt);
+	if (ret != 0) {
+		return ret;
+	}
+	return session->outgoing ? 0 : 1;
+}
+
 int worker_process_tcp(struct worker_ctx *worker, uv_stream_t *handle, const uint8_t *msg, ssize_t len)
 {
 	if (!worker || !handle) {
@@ -911,100 +1009,30 @@ int worker_process_tcp(struct worker_ctx *worker, uv_stream_t *handle, const uin
 		return kr_error(ECONNRESET);
 	}
 
-	int submitted = 0;
-	ssize_t nbytes = 0;
-	struct qr_task *task = session->buffering;
+	/* Data is read directly past the end of the session buffer, just claim it. */
+	assert(msg == session->wire_buf + session->wire_buf_end);
+	assert(session->wire_buf_end + len <= session->wire_buf_size);
+	session->wire_buf_end += len;
 
-	/* If this is a new query, create a new task that we can use
-	 * to buffer incoming message until it's complete. */
-	if (!session->outgoing) {
-		if (!task) {
-			/* Get TCP peer name, keep zeroed address if it fails. */
-			struct sockaddr_storage addr;
-			memset(&addr, 0, sizeof(addr));
-			int addr_len = sizeof(addr);
-			uv_tcp_getpeername((uv_tcp_t *)handle, (struct sockaddr *)&addr, &addr_len);
-			task = qr_task_create(worker, (uv_handle_t *)handle, (struct sockaddr *)&addr);
-			if (!task) {
-				return kr_error(ENOMEM);
-			}
-			session->buffering = task;
-		}
-	} else {
-		assert(session->tasks.len > 0);
-		task = array_tail(session->tasks);
-	}
-	/* At this point session must have either created new task or it's already assigned. */
-	assert(task);
-	assert(len > 0);
-	/* Start reading DNS/TCP message length */
-	knot_pkt_t *pkt_buf = task->pktbuf;
-	if (task->bytes_remaining == 0 && pkt_buf->size == 0) {
-		knot_pkt_clear(pkt_buf);
-		/* Read only one byte as TCP fragment may end at a 1B boundary
-		 * which would lead to OOB read or improper reassembly length. */
-		pkt_buf->size = 1;
-		pkt_buf->wire[0] = msg[0];
-		len -= 1;
-		msg += 1;
-		if (len == 0) {
-			return 0;
-		}
-	}
-	/* Finish reading DNS/TCP message length. */
-	if (task->bytes_remaining == 0 && pkt_buf->size == 1) {
-		pkt_buf->wire[1] = msg[0];
-		nbytes = msg_size(pkt_buf->wire);
-		len -= 1;
-		msg += 1;
-		/* Cut off fragment length and start reading DNS message. */
-		pkt_buf->size = 0;
-		task->bytes_remaining = nbytes;
-	}
-	/* Message is too long, can't process it. */
-	ssize_t to_read = MIN(len, task->bytes_remaining);
-	if (pkt_buf->size + to_read > pkt_buf->max_size) {
-		pkt_buf->size = 0;
-		task->bytes_remaining = 0;
-		return kr_error(EMSGSIZE);
-	}
-	/* Buffer message and check if it's complete */
-	memcpy(pkt_buf->wire + pkt_buf->size, msg, to_read);
-	pkt_buf->size += to_read;
-	if (to_read >= task->bytes_remaining) {
-		task->bytes_remaining = 0;
-		/* Parse the packet and start resolving complete query */
-		int ret = parse_packet(pkt_buf);
-		if (ret == 0 && !session->outgoing) {
-			ret = qr_task_start(task, pkt_buf);
-			if (ret != 0) {
-				return ret;
-			}
-			ret = qr_task_register(task, session);
-			if (ret != 0) {
-				return ret;
-			}
-			/* Task is now registered in session, clear temporary. */
-			session->buffering = NULL;
-			submitted += 1;
-		}
-		/* Start only new queries, not subrequests that are already pending */
-		if (ret == 0) {
-			ret = qr_task_step(task, NULL, pkt_buf);
+	/* Process all complete messages, incomplete remainder is kept for the next read. */
+	int submitted = 0;
+	while (session->wire_buf_end - session->wire_buf_start >= sizeof(uint16_t)) {
+		uint8_t *wire = session->wire_buf + session->wire_buf_start;
+		uint16_t msg_len = msg_size(wire);
+		if (session->wire_buf_end - session->wire_buf_start < sizeof(uint16_t) + msg_len) {
+			break;
 		}
-		/* Process next message part in the stream if no error so far */
-		if (ret != 0) {
+		session->wire_buf_start += sizeof(uint16_t) + msg_len;
+		int ret = process_tcp_msg(worker, handle, wire + sizeof(uint16_t), msg_len);
+		if (ret < 0) {
 			return ret;
 		}
-		if (len - to_read > 0 && !session->outgoing) {
-			ret = worker_process_tcp(worker, handle, msg + to_read, len - to_read);
-			if (ret < 0) {
-				return ret;
-			}
-			submitted += ret;
+		submitted += ret;
+		/* Subrequest connection carries a single answer, ignore the rest. */
+		if (session->outgoing) {
+			session->wire_buf_start = session->wire_buf_end;
+			break;
 		}
-	} else {
-		task->bytes_remaining -= to_read;	
 	}
 	return submitted;
 }
@@ -1032,6 +1060,76 @@ int worker_resolve(struct worker_ctx *worker, knot_pkt_t *query, unsigned option
 	return qr_task_step(task, NULL, query);
 }
 
+/** @internal Account time spent reclaiming memory. */
+static void gc_account(struct worker_ctx *worker, uint64_t begin)
+{
+	size_t elapsed = (uv_hrtime() - begin) / 1000; /* usec */
+	worker->stats.gc_time += elapsed;
+	worker->stats.gc_pause = MAX(worker->stats.gc_pause, elapsed);
+}
+
+/** @internal Make a small incremental Lua GC step after each busy loop iteration,
+  * instead of stopping the world for a full collection every once in a while. */
+static void on_gc_check(uv_check_t *handle)
+{
+	struct worker_ctx *worker = handle->data;
+	if (worker->gc.freed == 0) {
+		return;
+	}
+	uint64_t begin = uv_hrtime();
+	lua_gc(worker->engine->L, LUA_GCSTEP, 0);
+	worker->gc.freed = 0;
+	gc_account(worker, begin);
+}
+
+/** @internal Periodically resize mempool freelist and decommit memory under pressure. */
+static void on_gc_timer(uv_timer_t *handle)
+{
+	struct worker_ctx *worker = handle->data;
+	uint64_t begin = uv_hrtime();
+	/* Keep as many mempools as was the peak concurrency in the last period. */
+	worker->gc.pool_max = MIN(MAX(worker->gc.peak, MP_FREELIST_SIZE), MP_FREELIST_MAX);
+	worker->gc.peak = worker->stats.concurrent;
+	while (worker->pool_mp.len > worker->gc.pool_max) {
+		struct mempool *mp = array_tail(worker->pool_mp);
+		array_pop(worker->pool_mp);
+		mp_poison(mp, 0);
+		mp_delete(mp);
+	}
+	/* Trim heap only when RSS grows over the high watermark,
+	 * the watermark follows the RSS measured after the last trim. */
+	size_t rss = 0;
+	if (uv_resident_set_memory(&rss) != 0) {
+		rss = 0;
+	} else if (rss > worker->gc.rss_watermark) {
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+		if (worker->gc.rss_watermark > 0) {
+			malloc_trim(0);
+			worker->stats.trims += 1;
+			(void) uv_resident_set_memory(&rss);
+		}
+#endif
+		worker->gc.rss_watermark = rss + rss / 2;
+	} else if (rss + rss / 2 < worker->gc.rss_watermark) {
+		worker->gc.rss_watermark = rss + rss / 2;
+	}
+	gc_account(worker, begin);
+}
+
+/** @internal Start memory reclamation in the worker loop. */
+static void worker_gc_start(struct worker_ctx *worker, uv_loop_t *loop)
+{
+	worker->gc.pool_max = MP_FREELIST_SIZE;
+	uv_check_init(loop, &worker->gc.check);
+	worker->gc.check.data = worker;
+	uv_check_start(&worker->gc.check, on_gc_check);
+	uv_unref((uv_handle_t *)&worker->gc.check);
+	uv_timer_init(loop, &worker->gc.timer);
+	worker->gc.timer.data = worker;
+	uv_timer_start(&worker->gc.timer, on_gc_timer, GC_INTERVAL, GC_INTERVAL);
+	uv_unref((uv_handle_t *)&worker->gc.timer);
+}
+
 /** Reserve worker buffers */
 static int worker_reserve(struct worker_ctx *worker, size_t ring_maxlen)
 {
@@ -1046,6 +1144,10 @@ static int worker_reserve(struct worker_ctx *worker, size_t ring_maxlen)
 	worker->pkt_pool.ctx = mp_new (4 * sizeof(knot_pkt_t));
 	worker->pkt_pool.alloc = (knot_mm_alloc_t) mp_alloc;
 	worker->outgoing = map_make();
+	lru_create(&worker->tcp_fastopen, LRU_TFO_SIZE, NULL, NULL);
+	if (!worker->tcp_fastopen) {
+		return kr_error(ENOMEM);
+	}
 	worker->tcp_pipeline_max = MAX_PIPELINED;
 	return kr_ok();
 }
@@ -1066,6 +1168,8 @@ void worker_reclaim(struct worker_ctx *worker)
 	mp_delete(worker->pkt_pool.ctx);
 	worker->pkt_pool.ctx = NULL;
 	map_clear(&worker->outgoing);
+	lru_free(worker->tcp_fastopen);
+	worker->tcp_fastopen = NULL;
 }
 
 struct worker_ctx *worker_create(struct engine *engine, knot_mm_t *pool,
@@ -1088,6 +1192,7 @@ struct worker_ctx *worker_create(struct engine *engine, knot_mm_t *pool,
 	worker->count = worker_count;
 	worker->engine = engine;
 	worker_reserve(worker, MP_FREELIST_SIZE);
+	worker_gc_start(worker, uv_default_loop());
 	/* Register worker in Lua thread */
 	lua_pushlightuserdata(engine->L, worker);
 	lua_setglobal(engine->L, "__worker");
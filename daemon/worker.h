@@ -19,6 +19,7 @@
 #include "daemon/engine.h"
 #include "lib/generic/array.h"
 #include "lib/generic/map.h"
+#include "lib/generic/lru.h"
 
 
 /** Worker state (opaque). */
@@ -39,8 +40,8 @@ int worker_submit(struct worker_ctx *worker, uv_handle_t *handle, knot_pkt_t *qu
 
 /**
  * Process incoming DNS/TCP message fragment(s).
- * If the fragment contains only a partial message, it is buffered.
- * If the fragment contains a complete query or completes current fragment, execute it.
+ * The fragment must be read at the end of the session stream buffer (see session_wirebuf_reserve()),
+ * complete messages are parsed in place and partial message is kept in the buffer.
  * @return 0 or an error code
  */
 int worker_process_tcp(struct worker_ctx *worker, uv_stream_t *handle,
@@ -68,9 +69,18 @@ void worker_reclaim(struct worker_ctx *worker);
 /** Number of request within timeout window. */
 #define MAX_PENDING KR_NSREP_MAXADDR
 
+/** Interval of periodic memory reclamation (in milliseconds). */
+#define GC_INTERVAL 1000
+
 /** Freelist of available mempools. */
 typedef array_t(void *) mp_freelist_t;
 
+/** Number of consecutive failures to deliver data in SYN before TCP Fast Open is disabled for a server. */
+#define TFO_MAX_FAILS 3
+
+/** Outgoing TCP Fast Open failures, keyed by server address. */
+typedef lru_t(uint8_t) tfo_lru_t;
+
 /** \details Worker state is meant to persist during the whole life of daemon. */
 struct worker_ctx {
 	struct engine *engine;
@@ -92,8 +102,20 @@ struct worker_ctx {
 		size_t queries;
 		size_t dropped;
 		size_t timeout;
+		size_t gc_time;
+		size_t gc_pause;
+		size_t trims;
 	} stats;
+	struct {
+		uv_check_t check;
+		uv_timer_t timer;
+		size_t freed;
+		size_t peak;
+		size_t pool_max;
+		size_t rss_watermark;
+	} gc;
 	map_t outgoing;
+	tfo_lru_t *tcp_fastopen;
 	mp_freelist_t pool_mp;
 	mp_freelist_t pool_ioreq;
 	mp_freelist_t pool_sessions;
@@ -114,8 +136,8 @@ struct qr_task
 	uint16_t addrlist_turn;
 	uint16_t timeouts;
 	uint16_t iter_count;
-	uint16_t bytes_remaining;
 	struct sockaddr *addrlist;
+	uint64_t send_time;
 	uv_timer_t *timeout;
 	worker_cb_t on_complete;
 	void *baton;
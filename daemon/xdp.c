@@ -0,0 +1,734 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "daemon/xdp.h"
+#include "lib/defines.h"
+
+#if defined(ENABLE_XDP)
+
+#include <errno.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <contrib/ucw/lib.h>
+#include <contrib/ucw/mempool.h>
+
+#include "lib/utils.h"
+#include "lib/generic/lru.h"
+#include "daemon/io.h"
+#include "daemon/worker.h"
+
+/* One frame per datagram, first half of the UMEM is for receiving, second half for sending. */
+#define XDP_FRAME_SIZE 4096
+#define XDP_RING_SIZE 2048
+#define XDP_FRAME_COUNT (2 * XDP_RING_SIZE)
+#define XDP_L2_CACHE_SIZE 65536
+#define XDP_TTL 64
+
+struct xdp_ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	void *desc;
+	void *map;
+	size_t map_len;
+};
+
+/** Link-layer addresses of a client, replies are sent back the way the query came. */
+struct xdp_l2 {
+	uint8_t remote[ETH_ALEN];
+	uint8_t local[ETH_ALEN];
+};
+
+typedef lru_t(struct xdp_l2) xdp_l2_lru_t;
+
+struct xdp_ctx {
+	uv_poll_t handle; /* Must be first, the handle is cast to the context. */
+	int fd;
+	int map_fd;
+	int prog_fd;
+	int ifindex;
+	uint32_t queue;
+	uint32_t xdp_flags;
+	uint16_t port;
+	bool attached;
+	size_t mtu;
+	uint8_t *umem;
+	struct xdp_ring fill, comp, rx, tx;
+	uint64_t *tx_free;
+	uint32_t tx_free_len;
+	xdp_l2_lru_t *l2;
+	union {
+		struct sockaddr_in ip4;
+		struct sockaddr_in6 ip6;
+	} local; /* Destination address of the datagram being processed. */
+};
+
+static inline uint32_t ring_load(const uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store(uint32_t *ptr, uint32_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/** Sum 16-bit big-endian words (RFC 1071). */
+static uint32_t csum_add(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	for (; len > 1; len -= 2, p += 2) {
+		sum += (p[0] << 8) | p[1];
+	}
+	if (len > 0) {
+		sum += p[0] << 8;
+	}
+	return sum;
+}
+
+static uint16_t csum_fold(uint32_t sum)
+{
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum & 0xffff;
+}
+
+static int ring_map(struct xdp_ring *ring, int fd, const struct xdp_ring_offset *off, size_t desc_size, off_t pgoff)
+{
+	ring->map_len = off->desc + XDP_RING_SIZE * desc_size;
+	ring->map = mmap(NULL, ring->map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, pgoff);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return kr_error(errno);
+	}
+	ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+	ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+	ring->desc = (uint8_t *)ring->map + off->desc;
+	return kr_ok();
+}
+
+static void ring_unmap(struct xdp_ring *ring)
+{
+	if (ring->map) {
+		munmap(ring->map, ring->map_len);
+		ring->map = NULL;
+	}
+}
+
+/** Fetch interface MTU, answers must fit a single frame. */
+static int link_mtu(const char *ifname, size_t *mtu)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return kr_error(errno);
+	}
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	int ret = ioctl(fd, SIOCGIFMTU, &ifr);
+	if (ret == 0) {
+		*mtu = ifr.ifr_mtu;
+	} else {
+		ret = kr_error(errno);
+	}
+	close(fd);
+	return ret;
+}
+
+/** Attach XDP program to interface (or detach with prog_fd -1) over rtnetlink. */
+static int link_set_xdp(int ifindex, int prog_fd, uint32_t flags)
+{
+	struct {
+		struct nlmsghdr nh;
+		struct ifinfomsg ifinfo;
+		char attrbuf[64];
+	} req;
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req.nh.nlmsg_flags = NLM_F_REQUEST|NLM_F_ACK;
+	req.nh.nlmsg_type = RTM_SETLINK;
+	req.ifinfo.ifi_family = AF_UNSPEC;
+	req.ifinfo.ifi_index = ifindex;
+	/* IFLA_XDP { IFLA_XDP_FD, IFLA_XDP_FLAGS } */
+	struct nlattr *nest = (struct nlattr *)((uint8_t *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+	nest->nla_type = NLA_F_NESTED|IFLA_XDP;
+	nest->nla_len = NLA_HDRLEN;
+	struct nlattr *attr = (struct nlattr *)((uint8_t *)nest + nest->nla_len);
+	attr->nla_type = IFLA_XDP_FD;
+	attr->nla_len = NLA_HDRLEN + sizeof(prog_fd);
+	memcpy((uint8_t *)attr + NLA_HDRLEN, &prog_fd, sizeof(prog_fd));
+	nest->nla_len += NLA_ALIGN(attr->nla_len);
+	attr = (struct nlattr *)((uint8_t *)nest + nest->nla_len);
+	attr->nla_type = IFLA_XDP_FLAGS;
+	attr->nla_len = NLA_HDRLEN + sizeof(flags);
+	memcpy((uint8_t *)attr + NLA_HDRLEN, &flags, sizeof(flags));
+	nest->nla_len += NLA_ALIGN(attr->nla_len);
+	req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + nest->nla_len;
+
+	int fd = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		return kr_error(errno);
+	}
+	int ret = kr_ok();
+	if (send(fd, &req, req.nh.nlmsg_len, 0) < 0) {
+		ret = kr_error(errno);
+	} else {
+		struct {
+			struct nlmsghdr nh;
+			struct nlmsgerr err;
+			char attrbuf[256];
+		} ack;
+		ssize_t len = recv(fd, &ack, sizeof(ack), 0);
+		if (len < 0) {
+			ret = kr_error(errno);
+		} else if (len < (ssize_t)NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+			ret = kr_error(EIO);
+		} else if (ack.nh.nlmsg_type == NLMSG_ERROR) {
+			ret = ack.err.error; /* Already negative errno. */
+		}
+	}
+	close(fd);
+	return ret;
+}
+
+#define INSN(code_, dst_, src_, off_, imm_) \
+	((struct bpf_insn) { .code = (code_), .dst_reg = (dst_), .src_reg = (src_), .off = (off_), .imm = (imm_) })
+#define JUMP(pc, label) ((label) - (pc) - 1)
+
+/** Load program redirecting UDP datagrams for given port to the socket in XSKMAP.
+ *  Datagrams with IPv4 options, fragments and everything else is passed to the kernel. */
+static int xdp_prog_load(int map_fd, uint16_t port)
+{
+	enum { L_IPV6 = 9, L_IPV4 = 17, L_REDIRECT = 29, L_PASS = 35 };
+	const int eth_len = sizeof(struct ethhdr);
+	const int ip4_len = sizeof(struct iphdr);
+	const int ip6_len = sizeof(struct ip6_hdr);
+	const int udp_len = sizeof(struct udphdr);
+	struct bpf_insn prog[] = {
+		/* 0: r6 = ctx, r2 = data, r3 = data_end */
+		INSN(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+		INSN(BPF_LDX|BPF_MEM|BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0),
+		INSN(BPF_LDX|BPF_MEM|BPF_W, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0),
+		/* 3: Ethernet header */
+		INSN(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+		INSN(BPF_ALU64|BPF_ADD|BPF_K, BPF_REG_4, 0, 0, eth_len),
+		INSN(BPF_JMP|BPF_JGT|BPF_X, BPF_REG_4, BPF_REG_3, JUMP(5, L_PASS), 0),
+		INSN(BPF_LDX|BPF_MEM|BPF_H, BPF_REG_5, BPF_REG_2, offsetof(struct ethhdr, h_proto), 0),
+		INSN(BPF_JMP|BPF_JEQ|BPF_K, BPF_REG_5, 0, JUMP(7, L_IPV4), htons(ETH_P_IP)),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(8, L_PASS), htons(ETH_P_IPV6)),
+		/* 9: IPv6, UDP must immediately follow */
+		INSN(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+		INSN(BPF_ALU64|BPF_ADD|BPF_K, BPF_REG_4, 0, 0, eth_len + ip6_len + udp_len),
+		INSN(BPF_JMP|BPF_JGT|BPF_X, BPF_REG_4, BPF_REG_3, JUMP(11, L_PASS), 0),
+		INSN(BPF_LDX|BPF_MEM|BPF_B, BPF_REG_5, BPF_REG_2, eth_len + offsetof(struct ip6_hdr, ip6_nxt), 0),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(13, L_PASS), IPPROTO_UDP),
+		INSN(BPF_LDX|BPF_MEM|BPF_H, BPF_REG_5, BPF_REG_2, eth_len + ip6_len + offsetof(struct udphdr, dest), 0),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(15, L_PASS), htons(port)),
+		INSN(BPF_JMP|BPF_JA, 0, 0, JUMP(16, L_REDIRECT), 0),
+		/* 17: IPv4 without options, not fragmented */
+		INSN(BPF_ALU64|BPF_MOV|BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+		INSN(BPF_ALU64|BPF_ADD|BPF_K, BPF_REG_4, 0, 0, eth_len + ip4_len + udp_len),
+		INSN(BPF_JMP|BPF_JGT|BPF_X, BPF_REG_4, BPF_REG_3, JUMP(19, L_PASS), 0),
+		INSN(BPF_LDX|BPF_MEM|BPF_B, BPF_REG_5, BPF_REG_2, eth_len, 0),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(21, L_PASS), 0x45),
+		INSN(BPF_LDX|BPF_MEM|BPF_B, BPF_REG_5, BPF_REG_2, eth_len + offsetof(struct iphdr, protocol), 0),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(23, L_PASS), IPPROTO_UDP),
+		INSN(BPF_LDX|BPF_MEM|BPF_H, BPF_REG_5, BPF_REG_2, eth_len + offsetof(struct iphdr, frag_off), 0),
+		INSN(BPF_ALU64|BPF_AND|BPF_K, BPF_REG_5, 0, 0, htons(IP_MF|IP_OFFMASK)),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(26, L_PASS), 0),
+		INSN(BPF_LDX|BPF_MEM|BPF_H, BPF_REG_5, BPF_REG_2, eth_len + ip4_len + offsetof(struct udphdr, dest), 0),
+		INSN(BPF_JMP|BPF_JNE|BPF_K, BPF_REG_5, 0, JUMP(28, L_PASS), htons(port)),
+		/* 29: return bpf_redirect_map(xskmap, rx_queue_index, XDP_PASS) */
+		INSN(BPF_LDX|BPF_MEM|BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0),
+		INSN(BPF_LD|BPF_DW|BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+		INSN(0, 0, 0, 0, 0),
+		INSN(BPF_ALU64|BPF_MOV|BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+		INSN(BPF_JMP|BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+		INSN(BPF_JMP|BPF_EXIT, 0, 0, 0, 0),
+		/* 35: return XDP_PASS */
+		INSN(BPF_ALU64|BPF_MOV|BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+		INSN(BPF_JMP|BPF_EXIT, 0, 0, 0, 0),
+	};
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uintptr_t)prog;
+	attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+	attr.license = (uintptr_t)"GPL";
+	int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+	return fd < 0 ? kr_error(errno) : fd;
+}
+
+#undef JUMP
+#undef INSN
+
+static int xdp_socket_open(struct xdp_ctx *ctx, bool generic)
+{
+	ctx->fd = socket(AF_XDP, SOCK_RAW|SOCK_CLOEXEC, 0);
+	if (ctx->fd < 0) {
+		return kr_error(errno);
+	}
+	const size_t umem_len = (size_t)XDP_FRAME_COUNT * XDP_FRAME_SIZE;
+	ctx->umem = mmap(NULL, umem_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (ctx->umem == MAP_FAILED) {
+		ctx->umem = NULL;
+		return kr_error(errno);
+	}
+	struct xdp_umem_reg reg = {
+		.addr = (uintptr_t)ctx->umem,
+		.len = umem_len,
+		.chunk_size = XDP_FRAME_SIZE,
+		.headroom = 0
+	};
+	if (setsockopt(ctx->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) != 0) {
+		return kr_error(errno);
+	}
+	static const int rings[] = { XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING };
+	const int ring_size = XDP_RING_SIZE;
+	for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); ++i) {
+		if (setsockopt(ctx->fd, SOL_XDP, rings[i], &ring_size, sizeof(ring_size)) != 0) {
+			return kr_error(errno);
+		}
+	}
+	struct xdp_mmap_offsets off;
+	socklen_t optlen = sizeof(off);
+	if (getsockopt(ctx->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+		return kr_error(errno);
+	}
+	if (optlen != sizeof(off)) { /* Ring layout before Linux 5.4 */
+		return kr_error(ENOTSUP);
+	}
+	int ret = ring_map(&ctx->fill, ctx->fd, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING);
+	if (ret == 0) {
+		ret = ring_map(&ctx->comp, ctx->fd, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING);
+	}
+	if (ret == 0) {
+		ret = ring_map(&ctx->rx, ctx->fd, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING);
+	}
+	if (ret == 0) {
+		ret = ring_map(&ctx->tx, ctx->fd, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+	}
+	if (ret != 0) {
+		return ret;
+	}
+	/* Hand all receive frames to the kernel, keep the transmit frames on a freelist. */
+	ctx->tx_free = malloc(XDP_RING_SIZE * sizeof(uint64_t));
+	if (!ctx->tx_free) {
+		return kr_error(ENOMEM);
+	}
+	uint64_t *fill = ctx->fill.desc;
+	for (uint32_t i = 0; i < XDP_RING_SIZE; ++i) {
+		fill[i] = (uint64_t)i * XDP_FRAME_SIZE;
+		ctx->tx_free[i] = (uint64_t)(XDP_RING_SIZE + i) * XDP_FRAME_SIZE;
+	}
+	ctx->tx_free_len = XDP_RING_SIZE;
+	ring_store(ctx->fill.producer, XDP_RING_SIZE);
+
+	struct sockaddr_xdp sxdp = {
+		.sxdp_family = AF_XDP,
+		.sxdp_ifindex = ctx->ifindex,
+		.sxdp_queue_id = ctx->queue,
+		.sxdp_flags = generic ? XDP_COPY : 0
+	};
+	if (bind(ctx->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) != 0) {
+		return kr_error(errno);
+	}
+	return kr_ok();
+}
+
+static int xdp_prog_attach(struct xdp_ctx *ctx, bool generic)
+{
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(uint32_t);
+	attr.value_size = sizeof(int);
+	attr.max_entries = ctx->queue + 1;
+	ctx->map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+	if (ctx->map_fd < 0) {
+		return kr_error(errno);
+	}
+	uint32_t key = ctx->queue;
+	int val = ctx->fd;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = ctx->map_fd;
+	attr.key = (uintptr_t)&key;
+	attr.value = (uintptr_t)&val;
+	attr.flags = BPF_ANY;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+		return kr_error(errno);
+	}
+	ctx->prog_fd = xdp_prog_load(ctx->map_fd, ctx->port);
+	if (ctx->prog_fd < 0) {
+		return ctx->prog_fd;
+	}
+	/* Don't replace a program installed by someone else. */
+	ctx->xdp_flags = generic ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+	int ret = link_set_xdp(ctx->ifindex, ctx->prog_fd, ctx->xdp_flags|XDP_FLAGS_UPDATE_IF_NOEXIST);
+	ctx->attached = (ret == 0);
+	return ret;
+}
+
+static void xdp_teardown(struct xdp_ctx *ctx)
+{
+	if (ctx->attached) {
+		link_set_xdp(ctx->ifindex, -1, ctx->xdp_flags);
+		ctx->attached = false;
+	}
+	if (ctx->prog_fd >= 0) {
+		close(ctx->prog_fd);
+	}
+	if (ctx->map_fd >= 0) {
+		close(ctx->map_fd);
+	}
+	ring_unmap(&ctx->fill);
+	ring_unmap(&ctx->comp);
+	ring_unmap(&ctx->rx);
+	ring_unmap(&ctx->tx);
+	if (ctx->fd >= 0) {
+		close(ctx->fd);
+	}
+	ctx->fd = ctx->map_fd = ctx->prog_fd = -1;
+	if (ctx->umem) {
+		munmap(ctx->umem, (size_t)XDP_FRAME_COUNT * XDP_FRAME_SIZE);
+		ctx->umem = NULL;
+	}
+	free(ctx->tx_free);
+	ctx->tx_free = NULL;
+	ctx->tx_free_len = 0;
+	lru_free(ctx->l2);
+	ctx->l2 = NULL;
+}
+
+/** Return sent frames to the transmit freelist. */
+static void xdp_tx_reclaim(struct xdp_ctx *ctx)
+{
+	uint32_t cons = *ctx->comp.consumer;
+	uint32_t avail = ring_load(ctx->comp.producer) - cons;
+	const uint64_t *comp = ctx->comp.desc;
+	for (uint32_t i = 0; i < avail; ++i) {
+		ctx->tx_free[ctx->tx_free_len++] = comp[(cons + i) & (XDP_RING_SIZE - 1)];
+	}
+	ring_store(ctx->comp.consumer, cons + avail);
+}
+
+/** Strip link, network and transport headers and submit the DNS message. */
+static void xdp_process(struct xdp_ctx *ctx, struct worker_ctx *worker, uint8_t *frame, uint32_t len)
+{
+	if (len < sizeof(struct ethhdr)) {
+		return;
+	}
+	const struct ethhdr *eth = (const struct ethhdr *)frame;
+	const uint8_t *l3 = frame + sizeof(*eth);
+	size_t l3_len = len - sizeof(*eth);
+	const struct udphdr *udp = NULL;
+	size_t udp_max = 0;
+	union {
+		struct sockaddr_in ip4;
+		struct sockaddr_in6 ip6;
+	} src;
+	memset(&src, 0, sizeof(src));
+	memset(&ctx->local, 0, sizeof(ctx->local));
+	if (eth->h_proto == htons(ETH_P_IP)) {
+		const struct iphdr *ip = (const struct iphdr *)l3;
+		if (l3_len < sizeof(*ip) || ip->ihl != 5 || ntohs(ip->tot_len) > l3_len) {
+			return;
+		}
+		udp = (const struct udphdr *)(l3 + sizeof(*ip));
+		udp_max = ntohs(ip->tot_len) - sizeof(*ip); /* Ignore Ethernet padding. */
+		src.ip4.sin_family = AF_INET;
+		src.ip4.sin_addr.s_addr = ip->saddr;
+		ctx->local.ip4.sin_family = AF_INET;
+		ctx->local.ip4.sin_addr.s_addr = ip->daddr;
+	} else if (eth->h_proto == htons(ETH_P_IPV6)) {
+		const struct ip6_hdr *ip6 = (const struct ip6_hdr *)l3;
+		if (l3_len < sizeof(*ip6) || ip6->ip6_nxt != IPPROTO_UDP ||
+		    ntohs(ip6->ip6_plen) > l3_len - sizeof(*ip6)) {
+			return;
+		}
+		udp = (const struct udphdr *)(l3 + sizeof(*ip6));
+		udp_max = ntohs(ip6->ip6_plen);
+		src.ip6.sin6_family = AF_INET6;
+		memcpy(&src.ip6.sin6_addr, &ip6->ip6_src, sizeof(src.ip6.sin6_addr));
+		ctx->local.ip6.sin6_family = AF_INET6;
+		memcpy(&ctx->local.ip6.sin6_addr, &ip6->ip6_dst, sizeof(ctx->local.ip6.sin6_addr));
+	} else {
+		return;
+	}
+	if (udp_max < sizeof(*udp) || ntohs(udp->len) < sizeof(*udp) || ntohs(udp->len) > udp_max) {
+		return;
+	}
+	/* Ports share the offset in both address families. */
+	src.ip4.sin_port = udp->source;
+	ctx->local.ip4.sin_port = udp->dest;
+	const struct sockaddr *addr = (const struct sockaddr *)&src;
+
+	/* Remember link-layer addresses for the answer. */
+	struct xdp_l2 *l2 = lru_get_new(ctx->l2, kr_inaddr(addr), kr_inaddr_len(addr));
+	if (l2) {
+		memcpy(l2->remote, eth->h_source, ETH_ALEN);
+		memcpy(l2->local, eth->h_dest, ETH_ALEN);
+	}
+	uint8_t *wire = (uint8_t *)(udp + 1);
+	knot_pkt_t *query = knot_pkt_new(wire, ntohs(udp->len) - sizeof(*udp), &worker->pkt_pool);
+	if (query) {
+		worker_submit(worker, (uv_handle_t *)&ctx->handle, query, addr);
+	}
+}
+
+static void xdp_recv(uv_poll_t *handle, int status, int events)
+{
+	struct xdp_ctx *ctx = (struct xdp_ctx *)handle;
+	struct worker_ctx *worker = handle->loop->data;
+	if (status != 0 || ctx->fd < 0) {
+		return;
+	}
+	xdp_tx_reclaim(ctx);
+	/* Receive frames are returned to the fill ring right after processing,
+	 * answers are copied to transmit frames. */
+	const struct xdp_desc *desc = ctx->rx.desc;
+	uint64_t *fill = ctx->fill.desc;
+	uint32_t cons = *ctx->rx.consumer;
+	uint32_t prod = *ctx->fill.producer;
+	uint32_t avail = ring_load(ctx->rx.producer) - cons;
+	for (uint32_t i = 0; i < avail; ++i) {
+		const struct xdp_desc *d = &desc[(cons + i) & (XDP_RING_SIZE - 1)];
+		xdp_process(ctx, worker, ctx->umem + d->addr, d->len);
+		fill[(prod + i) & (XDP_RING_SIZE - 1)] = d->addr & ~(uint64_t)(XDP_FRAME_SIZE - 1);
+	}
+	ring_store(ctx->rx.consumer, cons + avail);
+	ring_store(ctx->fill.producer, prod + avail);
+	mp_flush(worker->pkt_pool.ctx);
+}
+
+int xdp_open(struct xdp_ctx **out, uv_loop_t *loop, const char *ifname, uint32_t queue, uint16_t port, bool generic)
+{
+	if (!out || !loop || !ifname) {
+		return kr_error(EINVAL);
+	}
+	int ifindex = if_nametoindex(ifname);
+	if (ifindex == 0) {
+		return kr_error(ENODEV);
+	}
+	struct xdp_ctx *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		return kr_error(ENOMEM);
+	}
+	ctx->fd = ctx->map_fd = ctx->prog_fd = -1;
+	ctx->ifindex = ifindex;
+	ctx->queue = queue;
+	ctx->port = port;
+	lru_create(&ctx->l2, XDP_L2_CACHE_SIZE, NULL, NULL);
+	int ret = ctx->l2 ? link_mtu(ifname, &ctx->mtu) : kr_error(ENOMEM);
+	if (ret == 0) {
+		ret = xdp_socket_open(ctx, generic);
+	}
+	if (ret == 0) {
+		ret = xdp_prog_attach(ctx, generic);
+	}
+	if (ret == 0) {
+		ret = uv_poll_init(loop, &ctx->handle, ctx->fd);
+	}
+	if (ret != 0) {
+		xdp_teardown(ctx);
+		free(ctx);
+		return ret;
+	}
+	ctx->handle.data = session_new();
+	ret = ctx->handle.data ? uv_poll_start(&ctx->handle, UV_READABLE, xdp_recv) : kr_error(ENOMEM);
+	if (ret != 0) {
+		xdp_close(ctx);
+		return ret;
+	}
+	*out = ctx;
+	return kr_ok();
+}
+
+void xdp_close(struct xdp_ctx *ctx)
+{
+	if (!ctx) {
+		return;
+	}
+	/* Detach right away, the context is freed when the loop closes the handle
+	 * (the handle is the first member of the context). */
+	uv_close((uv_handle_t *)&ctx->handle, (uv_close_cb) free);
+	xdp_teardown(ctx);
+	session_free(ctx->handle.data);
+	ctx->handle.data = NULL;
+}
+
+int xdp_getsockname(uv_handle_t *handle, struct sockaddr *addr)
+{
+	const struct xdp_ctx *ctx = (const struct xdp_ctx *)handle;
+	const struct sockaddr *local = (const struct sockaddr *)&ctx->local;
+	if (local->sa_family != AF_INET && local->sa_family != AF_INET6) {
+		return kr_error(EINVAL);
+	}
+	memcpy(addr, local, local->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+	return kr_ok();
+}
+
+size_t xdp_payload_max(uv_handle_t *handle, int family)
+{
+	const struct xdp_ctx *ctx = (const struct xdp_ctx *)handle;
+	size_t l3_max = MIN(ctx->mtu, XDP_FRAME_SIZE - sizeof(struct ethhdr));
+	size_t l3_hdr = (family == AF_INET6) ? sizeof(struct ip6_hdr) : sizeof(struct iphdr);
+	return l3_max - l3_hdr - sizeof(struct udphdr);
+}
+
+int xdp_send(uv_handle_t *handle, const struct sockaddr *src, const struct sockaddr *dst, const knot_pkt_t *pkt)
+{
+	struct xdp_ctx *ctx = (struct xdp_ctx *)handle;
+	if (ctx->fd < 0) {
+		return kr_error(EIO);
+	}
+	if (!src || !dst || src->sa_family != dst->sa_family) {
+		return kr_error(EINVAL);
+	}
+	if (pkt->size > xdp_payload_max(handle, dst->sa_family)) {
+		return kr_error(EMSGSIZE);
+	}
+	const struct xdp_l2 *l2 = lru_get_try(ctx->l2, kr_inaddr(dst), kr_inaddr_len(dst));
+	if (!l2) {
+		return kr_error(EHOSTUNREACH);
+	}
+	if (ctx->tx_free_len == 0) {
+		xdp_tx_reclaim(ctx);
+		if (ctx->tx_free_len == 0) {
+			return kr_error(ENOBUFS);
+		}
+	}
+	/* There are as many transmit frames as ring slots, a free frame means a free slot. */
+	uint32_t prod = *ctx->tx.producer;
+	uint64_t frame_addr = ctx->tx_free[--ctx->tx_free_len];
+	uint8_t *frame = ctx->umem + frame_addr;
+
+	struct ethhdr *eth = (struct ethhdr *)frame;
+	memcpy(eth->h_dest, l2->remote, ETH_ALEN);
+	memcpy(eth->h_source, l2->local, ETH_ALEN);
+	size_t len = sizeof(*eth);
+	const uint16_t udp_len = sizeof(struct udphdr) + pkt->size;
+	struct udphdr *udp = NULL;
+	if (dst->sa_family == AF_INET) {
+		const struct sockaddr_in *src4 = (const struct sockaddr_in *)src;
+		const struct sockaddr_in *dst4 = (const struct sockaddr_in *)dst;
+		eth->h_proto = htons(ETH_P_IP);
+		struct iphdr *ip = (struct iphdr *)(frame + len);
+		memset(ip, 0, sizeof(*ip));
+		ip->version = 4;
+		ip->ihl = 5;
+		ip->tot_len = htons(sizeof(*ip) + udp_len);
+		ip->frag_off = htons(IP_DF);
+		ip->ttl = XDP_TTL;
+		ip->protocol = IPPROTO_UDP;
+		ip->saddr = src4->sin_addr.s_addr;
+		ip->daddr = dst4->sin_addr.s_addr;
+		ip->check = htons(csum_fold(csum_add(0, ip, sizeof(*ip))));
+		len += sizeof(*ip);
+		udp = (struct udphdr *)(frame + len);
+		udp->source = src4->sin_port;
+		udp->dest = dst4->sin_port;
+		udp->len = htons(udp_len);
+		udp->check = 0; /* Optional over IPv4. */
+		memcpy(udp + 1, pkt->wire, pkt->size);
+	} else {
+		const struct sockaddr_in6 *src6 = (const struct sockaddr_in6 *)src;
+		const struct sockaddr_in6 *dst6 = (const struct sockaddr_in6 *)dst;
+		eth->h_proto = htons(ETH_P_IPV6);
+		struct ip6_hdr *ip6 = (struct ip6_hdr *)(frame + len);
+		memset(ip6, 0, sizeof(*ip6));
+		ip6->ip6_flow = htonl(6 << 28);
+		ip6->ip6_plen = htons(udp_len);
+		ip6->ip6_nxt = IPPROTO_UDP;
+		ip6->ip6_hlim = XDP_TTL;
+		memcpy(&ip6->ip6_src, &src6->sin6_addr, sizeof(ip6->ip6_src));
+		memcpy(&ip6->ip6_dst, &dst6->sin6_addr, sizeof(ip6->ip6_dst));
+		len += sizeof(*ip6);
+		udp = (struct udphdr *)(frame + len);
+		udp->source = src6->sin6_port;
+		udp->dest = dst6->sin6_port;
+		udp->len = htons(udp_len);
+		udp->check = 0;
+		memcpy(udp + 1, pkt->wire, pkt->size);
+		/* Mandatory over IPv6, covers the pseudo-header and the whole datagram. */
+		uint32_t sum = csum_add(0, &ip6->ip6_src, 2 * sizeof(struct in6_addr));
+		sum += udp_len + IPPROTO_UDP;
+		uint16_t check = csum_fold(csum_add(sum, udp, udp_len));
+		udp->check = htons(check ? check : 0xffff);
+	}
+	len += udp_len;
+
+	struct xdp_desc *desc = ctx->tx.desc;
+	desc[prod & (XDP_RING_SIZE - 1)].addr = frame_addr;
+	desc[prod & (XDP_RING_SIZE - 1)].len = len;
+	desc[prod & (XDP_RING_SIZE - 1)].options = 0;
+	ring_store(ctx->tx.producer, prod + 1);
+	/* Copy mode transmits only on syscall, the kernel may be busy with previous batch. */
+	if (sendto(ctx->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+		return kr_error(errno);
+	}
+	return kr_ok();
+}
+
+#else /* ENABLE_XDP */
+
+int xdp_open(struct xdp_ctx **ctx, uv_loop_t *loop, const char *ifname, uint32_t queue, uint16_t port, bool generic)
+{
+	return kr_error(ENOTSUP);
+}
+
+void xdp_close(struct xdp_ctx *ctx)
+{
+}
+
+int xdp_getsockname(uv_handle_t *handle, struct sockaddr *addr)
+{
+	return kr_error(ENOTSUP);
+}
+
+size_t xdp_payload_max(uv_handle_t *handle, int family)
+{
+	return 0;
+}
+
+int xdp_send(uv_handle_t *handle, const struct sockaddr *src, const struct sockaddr *dst, const knot_pkt_t *pkt)
+{
+	return kr_error(ENOTSUP);
+}
+
+#endif /* ENABLE_XDP */
@@ -0,0 +1,49 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <uv.h>
+#include <stdbool.h>
+#include <libknot/packet/pkt.h>
+
+/*
+ * AF_XDP fast path for plain DNS over UDP.
+ *
+ * A small XDP program redirects UDP datagrams for the given port to an AF_XDP
+ * socket, everything else continues to the kernel stack. Received frames are
+ * fed to the worker as if they came from a UDP socket (the socket is watched
+ * by an uv_poll_t handle carrying a regular session), answers are written
+ * directly to the transmit ring.
+ */
+
+struct xdp_ctx;
+
+/*! Attach to interface queue and redirect UDP datagrams for port to it.
+ *  The generic (SKB) mode works with any driver including veth. */
+int xdp_open(struct xdp_ctx **ctx, uv_loop_t *loop, const char *ifname, uint32_t queue, uint16_t port, bool generic);
+
+/*! Detach from interface, the context is freed once the event loop closes its handle. */
+void xdp_close(struct xdp_ctx *ctx);
+
+/*! Return local address of the datagram being processed. */
+int xdp_getsockname(uv_handle_t *handle, struct sockaddr *addr);
+
+/*! Return the largest DNS message that fits into a single frame. */
+size_t xdp_payload_max(uv_handle_t *handle, int family);
+
+/*! Transmit a DNS message from src to dst, the call doesn't block. */
+int xdp_send(uv_handle_t *handle, const struct sockaddr *src, const struct sockaddr *dst, const knot_pkt_t *pkt);
@@ -131,7 +131,9 @@ static size_t cache_key(uint8_t *buf, uint8_t tag, const knot_dname_t *name, uin
 	return name_len + KEY_HSIZE;
 }
 
-static struct kr_cache_entry *lookup(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name, uint16_t type)
+/** @internal Look up entry, the entry data size is returned in 'size' if not NULL. */
+static struct kr_cache_entry *lookup(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name, uint16_t type,
+                                     size_t *size)
 {
 	if (!name || !cache) {
 		return NULL;
@@ -144,9 +146,12 @@ static struct kr_cache_entry *lookup(struct kr_cache *cache, uint8_t tag, const
 	knot_db_val_t key = { keybuf, key_len };
 	knot_db_val_t val = { NULL, 0 };
 	int ret = cache_op(cache, read, &key, &val, 1);
-	if (ret != 0) {
+	if (ret != 0 || val.len < sizeof(struct kr_cache_entry)) {
 		return NULL;
 	}
+	if (size) {
+		*size = val.len - sizeof(struct kr_cache_entry);
+	}
 
 	return (struct kr_cache_entry *)val.data;
 }
@@ -172,13 +177,13 @@ static int check_lifetime(struct kr_cache_entry *found, uint32_t *timestamp)
 }
 
 int kr_cache_peek(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name, uint16_t type,
-                  struct kr_cache_entry **entry, uint32_t *timestamp)
+                  struct kr_cache_entry **entry, size_t *size, uint32_t *timestamp)
 {
 	if (!cache_isvalid(cache) || !name || !entry) {
 		return kr_error(EINVAL);
 	}
 
-	struct kr_cache_entry *found = lookup(cache, tag, name, type);
+	struct kr_cache_entry *found = lookup(cache, tag, name, type, size);
 	if (!found) {
 		cache->stats.miss += 1;
 		return kr_error(ENOENT);
@@ -195,6 +200,55 @@ int kr_cache_peek(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name,
 	return ret;
 }
 
+int kr_cache_peek_closest(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name, uint16_t type,
+                          struct kr_cache_entry **entry, size_t *size, uint32_t *timestamp,
+                          const knot_dname_t **closest)
+{
+	if (!cache_isvalid(cache) || !name || !entry || !closest) {
+		return kr_error(EINVAL);
+	}
+
+	uint8_t keybuf[KEY_SIZE];
+	size_t key_len = cache_key(keybuf, tag, name, type);
+	if (key_len == 0) {
+		return kr_error(EILSEQ);
+	}
+
+	/* Key of an ancestor is a prefix of the name key (labels are reversed),
+	 * so just cut off the leading labels one by one and rewrite the type. */
+	int ret = kr_error(ENOENT);
+	size_t name_len = key_len - KEY_HSIZE;
+	while (true) {
+		memcpy(keybuf + sizeof(uint8_t) + name_len, &type, sizeof(uint16_t));
+		knot_db_val_t key = { keybuf, name_len + KEY_HSIZE };
+		knot_db_val_t val = { NULL, 0 };
+		if (cache_op(cache, read, &key, &val, 1) == 0 && val.len >= sizeof(struct kr_cache_entry)) {
+			struct kr_cache_entry *found = val.data;
+			ret = check_lifetime(found, timestamp);
+			if (ret == 0) {
+				*entry = found;
+				*closest = name;
+				if (size) {
+					*size = val.len - sizeof(struct kr_cache_entry);
+				}
+				break;
+			}
+		}
+		if (name[0] == '\0') {
+			break;
+		}
+		name_len -= name[0] + 1;
+		name = knot_wire_next_label(name, NULL);
+	}
+
+	if (ret == 0) {
+		cache->stats.hit += 1;
+	} else {
+		cache->stats.miss += 1;
+	}
+	return ret;
+}
+
 static void entry_write(struct kr_cache_entry *dst, struct kr_cache_entry *header, knot_db_val_t data)
 {
 	memcpy(dst, header, sizeof(*header));
@@ -296,7 +350,7 @@ int kr_cache_peek_rr(struct kr_cache *cache, knot_rrset_t *rr, uint8_t *rank, ui
 
 	/* Check if the RRSet is in the cache. */
 	struct kr_cache_entry *entry = NULL;
-	int ret = kr_cache_peek(cache, KR_CACHE_RR, rr->owner, rr->type, &entry, timestamp);
+	int ret = kr_cache_peek(cache, KR_CACHE_RR, rr->owner, rr->type, &entry, NULL, timestamp);
 	if (ret != 0) {
 		return ret;
 	}
@@ -316,7 +370,7 @@ int kr_cache_peek_rank(struct kr_cache *cache, uint8_t tag, const knot_dname_t *
 	if (!cache_isvalid(cache) || !name) {
 		return kr_error(EINVAL);
 	}
-	struct kr_cache_entry *found = lookup(cache, tag, name, type);
+	struct kr_cache_entry *found = lookup(cache, tag, name, type, NULL);
 	if (!found) {
 		return kr_error(ENOENT);
 	}
@@ -419,7 +473,7 @@ int kr_cache_peek_rrsig(struct kr_cache *cache, knot_rrset_t *rr, uint8_t *rank,
 
 	/* Check if the RRSet is in the cache. */
 	struct kr_cache_entry *entry = NULL;
-	int ret = kr_cache_peek(cache, KR_CACHE_SIG, rr->owner, rr->type, &entry, timestamp);
+	int ret = kr_cache_peek(cache, KR_CACHE_SIG, rr->owner, rr->type, &entry, NULL, timestamp);
 	if (ret != 0) {
 		return ret;
 	}
@@ -26,6 +26,7 @@ enum kr_cache_tag {
 	KR_CACHE_RR   = 'R',
 	KR_CACHE_PKT  = 'P',
 	KR_CACHE_SIG  = 'G',
+	KR_CACHE_INFRA = 'I',
 	KR_CACHE_USER = 0x80
 };
 
@@ -124,12 +125,32 @@ static inline bool kr_cache_is_open(struct kr_cache *cache)
  * @param name asset name
  * @param type asset type
  * @param entry cache entry, will be set to valid pointer or NULL
+ * @param size [out] size of the entry data following the header (may be NULL)
  * @param timestamp current time (will be replaced with drift if successful)
  * @return 0 or an errcode
  */
 KR_EXPORT
 int kr_cache_peek(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name, uint16_t type,
-                  struct kr_cache_entry **entry, uint32_t *timestamp);
+                  struct kr_cache_entry **entry, size_t *size, uint32_t *timestamp);
+
+/**
+ * Peek the cache for asset (name or its closest ancestor, type, tag)
+ * @note Lookup starts at the name itself and strips leading labels until the root, so the entry
+ *       of the longest matching name is returned. Stale entries are skipped.
+ * @param cache cache structure
+ * @param tag  asset tag
+ * @param name asset name
+ * @param type asset type
+ * @param entry cache entry, will be set to valid pointer
+ * @param size [out] size of the entry data following the header (may be NULL)
+ * @param timestamp current time (will be replaced with drift if successful)
+ * @param closest set to the suffix of name where the entry was found
+ * @return 0 or an errcode
+ */
+KR_EXPORT
+int kr_cache_peek_closest(struct kr_cache *cache, uint8_t tag, const knot_dname_t *name, uint16_t type,
+                          struct kr_cache_entry **entry, size_t *size, uint32_t *timestamp,
+                          const knot_dname_t **closest);
 
 
 
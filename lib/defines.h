@@ -52,10 +52,12 @@ static inline int __attribute__((__cold__)) kr_error(int x) {
  */
 #define KR_CONN_RTT_MAX 3000 /* Timeout for network activity */
 #define KR_CONN_RETRY 250    /* Retry interval for network activity */
+#define KR_CONN_RTO_MIN 20   /* Minimum retransmission timeout */
 #define KR_ITER_LIMIT 50     /* Built-in iterator limit */
 #define KR_CNAME_CHAIN_LIMIT 40 /* Built-in maximum CNAME chain length */
 #define KR_TIMEOUT_LIMIT 4   /* Maximum number of retries after timeout. */
 #define KR_QUERY_NSRETRY_LIMIT 4 /* Maximum number of retries per query. */
+#define KR_NSEC3_MAX_ITERATIONS 150 /* NSEC3 proofs with more iterations are insecure. */
 
 /*
  * Defines.
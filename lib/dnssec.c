@@ -19,6 +19,7 @@
 #include <dnssec/crypto.h>
 #include <dnssec/error.h>
 #include <dnssec/key.h>
+#include <dnssec/keytag.h>
 #include <dnssec/sign.h>
 #include <libknot/descriptor.h>
 #include <libknot/packet/wire.h>
@@ -28,6 +29,7 @@
 #include <libknot/rrtype/nsec.h>
 #include <libknot/rrtype/rrsig.h>
 #include <contrib/wire.h>
+#include <contrib/murmurhash3/murmurhash3.h>
 
 #include "lib/defines.h"
 #include "lib/dnssec/nsec.h"
@@ -53,6 +55,13 @@ void kr_crypto_reinit(void)
 }
 
 #define FLG_WILDCARD_EXPANSION 0x01 /**< Possibly generated by using wildcard expansion. */
+#define MAX_COVERING_SIGS 16 /**< Signatures considered per RRSet, the rest is ignored. */
+
+/** Signature covering the validated RRSet. */
+struct covering_sig {
+	const knot_rrset_t *rrsig;
+	uint16_t pos;
+};
 
 /**
  * Check the RRSIG RR validity according to RFC4035 5.3.1 .
@@ -129,31 +138,68 @@ static int wildcard_radix_len_diff(const knot_dname_t *expanded,
 	return knot_dname_labels(expanded, NULL) - knot_rrsig_labels(&rrsigs->rrs, sig_pos);
 }
 
-int kr_rrset_validate(kr_rrset_validation_ctx_t *vctx, const knot_rrset_t *covered)
+/**
+ * Gather signatures covering the RRSet, so the section is walked only once
+ * instead of once for every key.
+ * @param sigs    Array of MAX_COVERING_SIGS signatures.
+ * @param sec     Section containing the signatures.
+ * @param covered Covered RRSet.
+ * @return        Number of gathered signatures.
+ */
+static size_t gather_sigs(struct covering_sig *sigs, const knot_pktsection_t *sec,
+                          const knot_rrset_t *covered)
 {
-	if (!vctx) {
-		return kr_error(EINVAL);
-	}
-	if (!vctx->pkt || !covered || !vctx->keys || !vctx->zone_name) {
-		return kr_error(EINVAL);
+	size_t count = 0;
+	for (unsigned i = 0; i < sec->count; ++i) {
+		/* Consider every RRSIG that matches owner and covers the class/type. */
+		const knot_rrset_t *rrsig = knot_pkt_rr(sec, i);
+		if (rrsig->type != KNOT_RRTYPE_RRSIG) {
+			continue;
+		}
+		if ((covered->rclass != rrsig->rclass) || !knot_dname_is_equal(covered->owner, rrsig->owner)) {
+			continue;
+		}
+		for (uint16_t j = 0; j < rrsig->rrs.rr_count; ++j) {
+			if (knot_rrsig_type_covered(&rrsig->rrs, j) != covered->type) {
+				continue;
+			}
+			if (count == MAX_COVERING_SIGS) {
+				return count;
+			}
+			sigs[count].rrsig = rrsig;
+			sigs[count].pos = j;
+			++count;
+		}
 	}
+	return count;
+}
 
-	for (unsigned i = 0; i < vctx->keys->rrs.rr_count; ++i) {
-		int ret = kr_rrset_validate_with_key(vctx, covered, i, NULL);
-		if (ret == 0) {
-			return ret;
+/** Check whether any of the signatures refers to the key (by key tag and algorithm). */
+static bool sigs_refer_key(const struct covering_sig *sigs, size_t count,
+                           const knot_rrset_t *keys, size_t key_pos)
+{
+	const knot_rdata_t *krr = knot_rdataset_at(&keys->rrs, key_pos);
+	dnssec_binary_t rdata = { knot_rdata_rdlen(krr), knot_rdata_data(krr) };
+	uint16_t keytag = 0;
+	if (dnssec_keytag(&rdata, &keytag) != DNSSEC_EOK) {
+		return false;
+	}
+	uint8_t algorithm = knot_dnskey_alg(&keys->rrs, key_pos);
+	for (size_t i = 0; i < count; ++i) {
+		const knot_rdataset_t *rrs = &sigs[i].rrsig->rrs;
+		if ((knot_rrsig_key_tag(rrs, sigs[i].pos) == keytag) &&
+		    (knot_rrsig_algorithm(rrs, sigs[i].pos) == algorithm)) {
+			return true;
 		}
 	}
-
-	return kr_error(ENOENT);
+	return false;
 }
 
-int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
-				const knot_rrset_t *covered,
-				size_t key_pos, const struct dseckey *key)
+static int validate_with_sigs(kr_rrset_validation_ctx_t *vctx, const knot_rrset_t *covered,
+                              const struct covering_sig *sigs, size_t sig_count,
+                              size_t key_pos, const struct dseckey *key)
 {
 	const knot_pkt_t *pkt         = vctx->pkt;
-	knot_section_t section_id     = vctx->section_id;
 	const knot_rrset_t *keys      = vctx->keys;
 	const knot_dname_t *zone_name = vctx->zone_name;
 	uint32_t timestamp            = vctx->timestamp;
@@ -161,8 +207,8 @@ int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 	struct dseckey *created_key = NULL;
 	if (key == NULL) {
 		const knot_rdata_t *krr = knot_rdataset_at(&keys->rrs, key_pos);
-		int ret = kr_dnssec_key_from_rdata(&created_key, keys->owner,
-			                       knot_rdata_data(krr), knot_rdata_rdlen(krr));
+		int ret = kr_dnssec_key_get(vctx->keycache, &created_key, keys->owner,
+			                    knot_rdata_data(krr), knot_rdata_rdlen(krr));
 		if (ret != 0) {
 			vctx->result = ret;
 			return vctx->result;
@@ -176,60 +222,87 @@ int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 		--covered_labels;
 	}
 
-	const knot_pktsection_t *sec = knot_pkt_section(pkt, section_id);
-	for (unsigned i = 0; i < sec->count; ++i) {
-		/* Consider every RRSIG that matches owner and covers the class/type. */
-		const knot_rrset_t *rrsig = knot_pkt_rr(sec, i);
-		if (rrsig->type != KNOT_RRTYPE_RRSIG) {
+	for (size_t i = 0; i < sig_count; ++i) {
+		const knot_rrset_t *rrsig = sigs[i].rrsig;
+		uint16_t j = sigs[i].pos;
+		int val_flgs = 0;
+		int trim_labels = 0;
+		if (validate_rrsig_rr(&val_flgs, covered_labels, rrsig, j,
+		                      keys, key_pos, keytag,
+		                      zone_name, timestamp) != 0) {
 			continue;
 		}
-		if ((covered->rclass != rrsig->rclass) || !knot_dname_is_equal(covered->owner, rrsig->owner)) {
-			continue;
-		}
-		for (uint16_t j = 0; j < rrsig->rrs.rr_count; ++j) {
-			int val_flgs = 0;
-			int trim_labels = 0;
-			if (knot_rrsig_type_covered(&rrsig->rrs, j) != covered->type) {
+		if (val_flgs & FLG_WILDCARD_EXPANSION) {
+			trim_labels = wildcard_radix_len_diff(covered->owner, rrsig, j);
+			if (trim_labels < 0) {
 				continue;
 			}
-			if (validate_rrsig_rr(&val_flgs, covered_labels, rrsig, j,
-			                      keys, key_pos, keytag,
-			                      zone_name, timestamp) != 0) {
-				continue;
-			}
-			if (val_flgs & FLG_WILDCARD_EXPANSION) {
-				trim_labels = wildcard_radix_len_diff(covered->owner, rrsig, j);
-				if (trim_labels < 0) {
-					break;
-				}
+		}
+		if (kr_check_signature(rrsig, j, (dnssec_key_t *) key, covered, trim_labels, vctx->sigcache) != 0) {
+			continue;
+		}
+		if (val_flgs & FLG_WILDCARD_EXPANSION) {
+			int ret = 0;
+			if (!has_nsec3) {
+				ret = kr_nsec_wildcard_answer_response_check(pkt, KNOT_AUTHORITY, covered->owner);
+			} else {
+				ret = kr_nsec3_wildcard_answer_response_check(pkt, KNOT_AUTHORITY, covered->owner, trim_labels - 1,
+				                                              vctx->nsec3cache);
 			}
-			if (kr_check_signature(rrsig, j, (dnssec_key_t *) key, covered, trim_labels) != 0) {
+			if (ret != 0) {
 				continue;
 			}
-			if (val_flgs & FLG_WILDCARD_EXPANSION) {
-				int ret = 0;
-				if (!has_nsec3) {
-					ret = kr_nsec_wildcard_answer_response_check(pkt, KNOT_AUTHORITY, covered->owner);
-				} else {
-					ret = kr_nsec3_wildcard_answer_response_check(pkt, KNOT_AUTHORITY, covered->owner, trim_labels - 1);
-				}
-				if (ret != 0) {
-					continue;
-				}
-				vctx->flags |= KR_DNSSEC_VFLG_WEXPAND;
-			}
-			/* Validated with current key, OK */
-			kr_dnssec_key_free(&created_key);
-			vctx->result = kr_ok();
-			return vctx->result;
+			vctx->flags |= KR_DNSSEC_VFLG_WEXPAND;
 		}
+		/* Validated with current key, OK */
+		kr_dnssec_key_put(vctx->keycache, &created_key);
+		vctx->result = kr_ok();
+		return vctx->result;
 	}
 	/* No applicable key found, cannot be validated. */
-	kr_dnssec_key_free(&created_key);
+	kr_dnssec_key_put(vctx->keycache, &created_key);
 	vctx->result = kr_error(ENOENT);
 	return vctx->result;
 }
 
+int kr_rrset_validate(kr_rrset_validation_ctx_t *vctx, const knot_rrset_t *covered)
+{
+	if (!vctx) {
+		return kr_error(EINVAL);
+	}
+	if (!vctx->pkt || !covered || !vctx->keys || !vctx->zone_name) {
+		return kr_error(EINVAL);
+	}
+
+	/* Gather the signatures once and try only the keys they refer to,
+	 * so that keys which can't match are neither parsed nor used. */
+	struct covering_sig sigs[MAX_COVERING_SIGS];
+	const knot_pktsection_t *sec = knot_pkt_section(vctx->pkt, vctx->section_id);
+	size_t sig_count = gather_sigs(sigs, sec, covered);
+	for (unsigned i = 0; sig_count > 0 && i < vctx->keys->rrs.rr_count; ++i) {
+		if (!sigs_refer_key(sigs, sig_count, vctx->keys, i)) {
+			continue;
+		}
+		int ret = validate_with_sigs(vctx, covered, sigs, sig_count, i, NULL);
+		if (ret == 0) {
+			return ret;
+		}
+	}
+
+	vctx->result = kr_error(ENOENT);
+	return vctx->result;
+}
+
+int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
+				const knot_rrset_t *covered,
+				size_t key_pos, const struct dseckey *key)
+{
+	struct covering_sig sigs[MAX_COVERING_SIGS];
+	const knot_pktsection_t *sec = knot_pkt_section(vctx->pkt, vctx->section_id);
+	size_t sig_count = gather_sigs(sigs, sec, covered);
+	return validate_with_sigs(vctx, covered, sigs, sig_count, key_pos, key);
+}
+
 int kr_dnskeys_trusted(kr_rrset_validation_ctx_t *vctx, const knot_rrset_t *ta)
 {
 	const knot_pkt_t *pkt         = vctx->pkt;
@@ -252,18 +325,18 @@ int kr_dnskeys_trusted(kr_rrset_validation_ctx_t *vctx, const knot_rrset_t *ta)
 		}
 		
 		struct dseckey *key;
-		if (kr_dnssec_key_from_rdata(&key, keys->owner, key_data, knot_rdata_rdlen(krr)) != 0) {
+		if (kr_dnssec_key_get(vctx->keycache, &key, keys->owner, key_data, knot_rdata_rdlen(krr)) != 0) {
 			continue;
 		}
 		if (kr_authenticate_referral(ta, (dnssec_key_t *) key) != 0) {
-			kr_dnssec_key_free(&key);
+			kr_dnssec_key_put(vctx->keycache, &key);
 			continue;
 		}
 		if (kr_rrset_validate_with_key(vctx, keys, i, key) != 0) {
-			kr_dnssec_key_free(&key);
+			kr_dnssec_key_put(vctx->keycache, &key);
 			continue;
 		}
-		kr_dnssec_key_free(&key);
+		kr_dnssec_key_put(vctx->keycache, &key);
 		assert (vctx->result == 0);
 		return vctx->result;
 	}
@@ -379,5 +452,117 @@ void kr_dnssec_key_free(struct dseckey **key)
 	*key = NULL;
 }
 
+/*
+ * Cache of parsed keys, 2-way set associative with LRU replacement within a set.
+ * Entries are matched on the exact owner and RDATA, the hash only selects a set.
+ */
+#define KEY_CACHE_WAYS 2
+
+struct key_entry {
+	dnssec_key_t *key;
+	uint16_t rdlen;
+	uint8_t owner_len;
+	uint8_t data[]; /* owner, rdata */
+};
+
+struct kr_keycache {
+	uint32_t mask;
+	struct key_entry *slots[];
+};
+
+static void key_entry_free(struct key_entry *entry)
+{
+	if (entry) {
+		dnssec_key_free(entry->key);
+		free(entry);
+	}
+}
+
+static bool key_entry_match(const struct key_entry *entry, const knot_dname_t *kown, size_t kown_len,
+                            const uint8_t *rdata, size_t rdlen)
+{
+	return entry && entry->owner_len == kown_len && entry->rdlen == rdlen &&
+	       memcmp(entry->data, kown, kown_len) == 0 &&
+	       memcmp(entry->data + kown_len, rdata, rdlen) == 0;
+}
+
+struct kr_keycache *kr_dnssec_keycache_create(size_t size)
+{
+	size_t buckets = 1;
+	while (buckets * KEY_CACHE_WAYS < size) {
+		buckets <<= 1;
+	}
+	struct kr_keycache *kc = calloc(1, sizeof(*kc) + buckets * KEY_CACHE_WAYS * sizeof(kc->slots[0]));
+	if (kc) {
+		kc->mask = buckets - 1;
+	}
+	return kc;
+}
+
+void kr_dnssec_keycache_free(struct kr_keycache *kc)
+{
+	if (!kc) {
+		return;
+	}
+	for (size_t i = 0; i < (kc->mask + 1) * KEY_CACHE_WAYS; ++i) {
+		key_entry_free(kc->slots[i]);
+	}
+	free(kc);
+}
+
+int kr_dnssec_key_get(struct kr_keycache *kc, struct dseckey **key, const knot_dname_t *kown,
+                      const uint8_t *rdata, size_t rdlen)
+{
+	if (!kc) {
+		return kr_dnssec_key_from_rdata(key, kown, rdata, rdlen);
+	}
+	if (!key || !kown || !rdata || rdlen == 0 || rdlen > UINT16_MAX) {
+		return kr_error(EINVAL);
+	}
+
+	/* Look up the set, most recently used entry is kept first. */
+	const size_t kown_len = knot_dname_size(kown);
+	uint32_t h = hash((const char *)rdata, rdlen) ^ hash((const char *)kown, kown_len);
+	struct key_entry **bucket = &kc->slots[(h & kc->mask) * KEY_CACHE_WAYS];
+	for (unsigned i = 0; i < KEY_CACHE_WAYS; ++i) {
+		if (key_entry_match(bucket[i], kown, kown_len, rdata, rdlen)) {
+			struct key_entry *found = bucket[i];
+			memmove(bucket + 1, bucket, i * sizeof(*bucket));
+			bucket[0] = found;
+			*key = (struct dseckey *)found->key;
+			return kr_ok();
+		}
+	}
+
+	/* Parse the key and replace the least recently used entry. */
+	struct key_entry *entry = malloc(sizeof(*entry) + kown_len + rdlen);
+	if (!entry) {
+		return kr_error(ENOMEM);
+	}
+	int ret = kr_dnssec_key_from_rdata((struct dseckey **)&entry->key, kown, rdata, rdlen);
+	if (ret != 0) {
+		free(entry);
+		return ret;
+	}
+	entry->rdlen = rdlen;
+	entry->owner_len = kown_len;
+	memcpy(entry->data, kown, kown_len);
+	memcpy(entry->data + kown_len, rdata, rdlen);
+	key_entry_free(bucket[KEY_CACHE_WAYS - 1]);
+	memmove(bucket + 1, bucket, (KEY_CACHE_WAYS - 1) * sizeof(*bucket));
+	bucket[0] = entry;
+	*key = (struct dseckey *)entry->key;
+	return kr_ok();
+}
+
+void kr_dnssec_key_put(struct kr_keycache *kc, struct dseckey **key)
+{
+	if (!kc) {
+		kr_dnssec_key_free(key);
+	} else {
+		*key = NULL;
+	}
+}
+
 #undef DEBUG_MSG
 
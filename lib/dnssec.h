@@ -40,6 +40,9 @@ void kr_crypto_reinit(void);
 
 /** Opaque DNSSEC key pointer. */
 struct dseckey;
+struct kr_sigcache;
+struct kr_keycache;
+struct kr_nsec3_cache;
 
 #define KR_DNSSEC_VFLG_WEXPAND 0x01
 
@@ -51,6 +54,9 @@ struct kr_rrset_validation_ctx {
         const knot_dname_t *zone_name;	/*!< Name of the zone containing the RRSIG RRSet. */
 	uint32_t timestamp;		/*!< Validation time. */
         bool has_nsec3;			/*!< Whether to use NSEC3 validation. */
+	struct kr_sigcache *sigcache;	/*!< Cache of verification results (optional). */
+	struct kr_keycache *keycache;	/*!< Cache of parsed keys (optional). */
+	struct kr_nsec3_cache *nsec3cache; /*!< Cache of NSEC3 hashes (optional). */
 	uint32_t flags;			/*!< Output - Flags. */
 	int result;			/*!< Output - 0 or error code. */
 };
@@ -133,3 +139,38 @@ int kr_dnssec_key_from_rdata(struct dseckey **key, const knot_dname_t *kown, con
  * @param key Pointer to freed key.
  */
 void kr_dnssec_key_free(struct dseckey **key);
+
+/**
+ * Create cache of parsed DNSSEC keys.
+ * @param size Maximum number of cached keys.
+ * @return     New cache or NULL.
+ */
+KR_EXPORT
+struct kr_keycache *kr_dnssec_keycache_create(size_t size);
+
+/**
+ * Free the cache including all cached keys.
+ * @param kc Cache (may be NULL).
+ */
+KR_EXPORT
+void kr_dnssec_keycache_free(struct kr_keycache *kc);
+
+/**
+ * Get a parsed DNSSEC key from the cache, or construct and cache it.
+ * @note The key is owned by the cache and it is valid until the next call with the same cache,
+ *       without cache this is equivalent to kr_dnssec_key_from_rdata().
+ * @param kc    Cache of parsed keys (may be NULL).
+ * @param key   Pointer to be set to the DNSSEC key.
+ * @param kown  DNSKEY owner name.
+ * @param rdata DNSKEY RDATA
+ * @param rdlen DNSKEY RDATA length
+ */
+int kr_dnssec_key_get(struct kr_keycache *kc, struct dseckey **key, const knot_dname_t *kown,
+                      const uint8_t *rdata, size_t rdlen);
+
+/**
+ * Release the DNSSEC key acquired by kr_dnssec_key_get().
+ * @param kc  Cache of parsed keys (may be NULL).
+ * @param key Pointer to released key.
+ */
+void kr_dnssec_key_put(struct kr_keycache *kc, struct dseckey **key);
@@ -24,12 +24,14 @@
 #include <contrib/base32hex.h>
 #include <libknot/rrset.h>
 #include <libknot/rrtype/nsec3.h>
+#include <contrib/wire.h>
 
 #include "lib/defines.h"
 #include "lib/dnssec/nsec.h"
 #include "lib/dnssec/nsec3.h"
 
 #define OPT_OUT_BIT 0x01
+#define MAX_HASH_BYTES 64
 
 //#define FLG_CLOSEST_ENCLOSER (1 << 0)
 #define FLG_CLOSEST_PROVABLE_ENCLOSER (1 << 1)
@@ -69,15 +71,16 @@ static int nsec3_parameters(dnssec_nsec3_params_t *params, const knot_rrset_t *n
 
 /**
  * Computes a hash of a given domain name.
- * @param hash   Resulting hash, must be freed.
+ * @param hash   Resulting hash, data must point to a buffer of MAX_HASH_BYTES.
  * @param params NSEC3 parameters.
  * @param name   Domain name to be hashed.
+ * @param cache  Hashing context (optional).
  * @return       0 or error code.
  */
 static int hash_name(dnssec_binary_t *hash, const dnssec_nsec3_params_t *params,
-                     const knot_dname_t *name)
+                     const knot_dname_t *name, struct kr_nsec3_cache *cache)
 {
-	assert(hash && params);
+	assert(hash && hash->data && params);
 	if (!name)
 		return kr_error(EINVAL);
 
@@ -85,14 +88,76 @@ static int hash_name(dnssec_binary_t *hash, const dnssec_nsec3_params_t *params,
 	dname.size = knot_dname_size(name);
 	dname.data = (uint8_t *) name;
 
-	int ret = dnssec_nsec3_hash(&dname, params, hash);
+	/* Look up memoized hash, key = { u8 algorithm, u16 iterations, u8 salt length, salt, name } */
+	uint8_t key[4 + UINT8_MAX + KNOT_DNAME_MAXLEN];
+	size_t key_len = 0;
+	if (cache) {
+		if (params->iterations > cache->max_iterations) {
+			return kr_error(ERANGE);
+		}
+		if (params->salt.size <= UINT8_MAX && dname.size <= KNOT_DNAME_MAXLEN) {
+			key[0] = params->algorithm;
+			wire_write_u16(key + 1, params->iterations);
+			key[3] = params->salt.size;
+			memcpy(key + 4, params->salt.data, params->salt.size);
+			memcpy(key + 4 + params->salt.size, name, dname.size);
+			key_len = 4 + params->salt.size + dname.size;
+			struct kr_nsec3_hash *memo = lru_get_try(cache->lru, (const char *)key, key_len);
+			if (memo) {
+				memcpy(hash->data, memo->data, memo->size);
+				hash->size = memo->size;
+				return kr_ok();
+			}
+		}
+	}
+
+	dnssec_binary_t computed = {0, };
+	int ret = dnssec_nsec3_hash(&dname, params, &computed);
 	if (ret != DNSSEC_EOK) {
 		return kr_error(EINVAL);
 	}
+	if (computed.size > MAX_HASH_BYTES) {
+		dnssec_binary_free(&computed);
+		return kr_error(EMSGSIZE);
+	}
+	memcpy(hash->data, computed.data, computed.size);
+	hash->size = computed.size;
+	dnssec_binary_free(&computed);
+
+	if (key_len > 0 && hash->size <= sizeof(((struct kr_nsec3_hash *)0)->data)) {
+		struct kr_nsec3_hash *memo = lru_get_new(cache->lru, (const char *)key, key_len);
+		if (memo) {
+			memcpy(memo->data, hash->data, hash->size);
+			memo->size = hash->size;
+		}
+	}
 
 	return kr_ok();
 }
 
+struct kr_nsec3_cache *kr_nsec3_cache_create(size_t max_slots, uint16_t max_iterations)
+{
+	struct kr_nsec3_cache *cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		return NULL;
+	}
+	lru_create(&cache->lru, max_slots, NULL, NULL);
+	if (!cache->lru) {
+		free(cache);
+		return NULL;
+	}
+	cache->max_iterations = max_iterations;
+	return cache;
+}
+
+void kr_nsec3_cache_free(struct kr_nsec3_cache *cache)
+{
+	if (cache) {
+		lru_free(cache->lru);
+		free(cache);
+	}
+}
+
 /**
  * Read hash from NSEC3 owner name and store its binary form.
  * @param hash          Buffer to be written.
@@ -114,7 +179,6 @@ static int read_owner_hash(dnssec_binary_t *hash, size_t max_hash_size, const kn
 	return kr_ok();
 }
 
-#define MAX_HASH_BYTES 64
 /**
  * Closest (provable) encloser match (RFC5155 7.2.1, bullet 1).
  * @param flags   Flags to be set according to check outcome.
@@ -124,7 +188,8 @@ static int read_owner_hash(dnssec_binary_t *hash, size_t max_hash_size, const kn
  * @return        0 or error code.
  */
 static int closest_encloser_match(int *flags, const knot_rrset_t *nsec3,
-                                  const knot_dname_t *name, unsigned *skipped)
+                                  const knot_dname_t *name, unsigned *skipped,
+                                  struct kr_nsec3_cache *cache)
 {
 	assert(flags && nsec3 && name && skipped);
 
@@ -132,7 +197,9 @@ static int closest_encloser_match(int *flags, const knot_rrset_t *nsec3,
 	uint8_t hash_data[MAX_HASH_BYTES] = {0, };
 	owner_hash.data = hash_data;
 	dnssec_nsec3_params_t params = {0, };
+	uint8_t name_hash_data[MAX_HASH_BYTES] = {0, };
 	dnssec_binary_t name_hash = {0, };
+	name_hash.data = name_hash_data;
 
 	int ret = read_owner_hash(&owner_hash, MAX_HASH_BYTES, nsec3);
 	if (ret != 0) {
@@ -154,20 +221,17 @@ static int closest_encloser_match(int *flags, const knot_rrset_t *nsec3,
 	*skipped = 1;
 
 	while(encloser) {
-		ret = hash_name(&name_hash, &params, encloser);
+		ret = hash_name(&name_hash, &params, encloser, cache);
 		if (ret != 0) {
 			goto fail;
 		}
 
 		if ((owner_hash.size == name_hash.size) &&
 		    (memcmp(owner_hash.data, name_hash.data, owner_hash.size) == 0)) {
-			dnssec_binary_free(&name_hash);
 			*flags |= FLG_CLOSEST_PROVABLE_ENCLOSER;
 			break;
 		}
 
-		dnssec_binary_free(&name_hash);
-
 		if (!encloser[0])
 			break;
 		encloser = knot_wire_next_label(encloser, NULL);
@@ -180,9 +244,6 @@ fail:
 	if (params.salt.data) {
 		dnssec_nsec3_params_free(&params);
 	}
-	if (name_hash.data) {
-		dnssec_binary_free(&name_hash);
-	}
 	return ret;
 }
 
@@ -193,7 +254,8 @@ fail:
  * @param name  Name to be checked.
  * @return      0 or error code.
  */
-static int covers_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_t *name)
+static int covers_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_t *name,
+                       struct kr_nsec3_cache *cache)
 {
 	assert(flags && nsec3 && name);
 
@@ -201,7 +263,9 @@ static int covers_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_t
 	uint8_t hash_data[MAX_HASH_BYTES] = {0, };
 	owner_hash.data = hash_data;
 	dnssec_nsec3_params_t params = {0, };
+	uint8_t name_hash_data[MAX_HASH_BYTES] = {0, };
 	dnssec_binary_t name_hash = {0, };
+	name_hash.data = name_hash_data;
 
 	int ret = read_owner_hash(&owner_hash, MAX_HASH_BYTES, nsec3);
 	if (ret != 0) {
@@ -213,7 +277,7 @@ static int covers_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_t
 		goto fail;
 	}
 
-	ret = hash_name(&name_hash, &params, name);
+	ret = hash_name(&name_hash, &params, name, cache);
 	if (ret != 0) {
 		goto fail;
 	}
@@ -266,9 +330,6 @@ fail:
 	if (params.salt.data) {
 		dnssec_nsec3_params_free(&params);
 	}
-	if (name_hash.data) {
-		dnssec_binary_free(&name_hash);
-	}
 	return ret;
 }
 
@@ -301,7 +362,8 @@ static bool has_optout(const knot_rrset_t *nsec3)
  * @param name  Name to be checked.
  * @return      0 or error code.
  */
-static int matches_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_t *name)
+static int matches_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_t *name,
+                        struct kr_nsec3_cache *cache)
 {
 	assert(flags && nsec3 && name);
 
@@ -309,7 +371,9 @@ static int matches_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_
 	uint8_t hash_data[MAX_HASH_BYTES] = {0, };
 	owner_hash.data = hash_data;
 	dnssec_nsec3_params_t params = {0, };
+	uint8_t name_hash_data[MAX_HASH_BYTES] = {0, };
 	dnssec_binary_t name_hash = {0, };
+	name_hash.data = name_hash_data;
 
 	int ret = read_owner_hash(&owner_hash, MAX_HASH_BYTES, nsec3);
 	if (ret != 0) {
@@ -321,7 +385,7 @@ static int matches_name(int *flags, const knot_rrset_t *nsec3, const knot_dname_
 		goto fail;
 	}
 
-	ret = hash_name(&name_hash, &params, name);
+	ret = hash_name(&name_hash, &params, name, cache);
 	if (ret != 0) {
 		goto fail;
 	}
@@ -336,12 +400,8 @@ fail:
 	if (params.salt.data) {
 		dnssec_nsec3_params_free(&params);
 	}
-	if (name_hash.data) {
-		dnssec_binary_free(&name_hash);
-	}
 	return ret;
 }
-#undef MAX_HASH_BYTES
 
 /**
  * Prepends an asterisk label to given name.
@@ -370,7 +430,8 @@ static int prepend_asterisk(uint8_t *tgt, size_t maxlen, const knot_dname_t *nam
  */
 static int closest_encloser_proof(const knot_pkt_t *pkt, knot_section_t section_id,
                                   const knot_dname_t *sname, const knot_dname_t **encloser_name,
-                                  const knot_rrset_t **matching_ecloser_nsec3, const knot_rrset_t **covering_next_nsec3)
+                                  const knot_rrset_t **matching_ecloser_nsec3, const knot_rrset_t **covering_next_nsec3,
+                                  struct kr_nsec3_cache *cache)
 {
 	const knot_pktsection_t *sec = knot_pkt_section(pkt, section_id);
 	if (!sec || !sname) {
@@ -389,7 +450,7 @@ static int closest_encloser_proof(const knot_pkt_t *pkt, knot_section_t section_
 		}
 		unsigned skipped = 0;
 		flags = 0;
-		int ret = closest_encloser_match(&flags, rrset, sname, &skipped);
+		int ret = closest_encloser_match(&flags, rrset, sname, &skipped, cache);
 		if (ret != 0) {
 			return ret;
 		}
@@ -408,7 +469,7 @@ static int closest_encloser_proof(const knot_pkt_t *pkt, knot_section_t section_
 			if (rrset->type != KNOT_RRTYPE_NSEC3) {
 				continue;
 			}
-			ret = covers_name(&flags, rrset, next_closer);
+			ret = covers_name(&flags, rrset, next_closer, cache);
 			if (ret != 0) {
 				return ret;
 			}
@@ -447,7 +508,7 @@ static int closest_encloser_proof(const knot_pkt_t *pkt, knot_section_t section_
  * @return           0 or error code.
  */
 static int covers_closest_encloser_wildcard(const knot_pkt_t *pkt, knot_section_t section_id,
-                                            const knot_dname_t *encloser)
+                                            const knot_dname_t *encloser, struct kr_nsec3_cache *cache)
 {
 	const knot_pktsection_t *sec = knot_pkt_section(pkt, section_id);
 	if (!sec || !encloser) {
@@ -469,7 +530,7 @@ static int covers_closest_encloser_wildcard(const knot_pkt_t *pkt, knot_section_
 		if (rrset->type != KNOT_RRTYPE_NSEC3) {
 			continue;
 		}
-		int ret = covers_name(&flags, rrset, wildcard);
+		int ret = covers_name(&flags, rrset, wildcard, cache);
 		if (ret != 0) {
 			return ret;
 		}
@@ -482,14 +543,14 @@ static int covers_closest_encloser_wildcard(const knot_pkt_t *pkt, knot_section_
 }
 
 int kr_nsec3_name_error_response_check(const knot_pkt_t *pkt, knot_section_t section_id,
-                                       const knot_dname_t *sname)
+                                       const knot_dname_t *sname, struct kr_nsec3_cache *cache)
 {
 	const knot_dname_t *encloser = NULL;
-	int ret = closest_encloser_proof(pkt, section_id, sname, &encloser, NULL, NULL);
+	int ret = closest_encloser_proof(pkt, section_id, sname, &encloser, NULL, NULL, cache);
 	if (ret != 0) {
 		return ret;
 	}
-	return covers_closest_encloser_wildcard(pkt, section_id, encloser);
+	return covers_closest_encloser_wildcard(pkt, section_id, encloser, cache);
 }
 
 /**
@@ -501,11 +562,12 @@ int kr_nsec3_name_error_response_check(const knot_pkt_t *pkt, knot_section_t sec
  * @return      0 or error code.
  */
 static int matches_name_and_type(int *flags, const knot_rrset_t *nsec3,
-                                const knot_dname_t *name, uint16_t type)
+                                const knot_dname_t *name, uint16_t type,
+                                struct kr_nsec3_cache *cache)
 {
 	assert(flags && nsec3 && name);
 
-	int ret = matches_name(flags, nsec3, name);
+	int ret = matches_name(flags, nsec3, name, cache);
 	if (ret != 0) {
 		return ret;
 	}
@@ -545,7 +607,8 @@ static int matches_name_and_type(int *flags, const knot_rrset_t *nsec3,
  * @return           0 or error code.
  */
 static int no_data_response_no_ds(const knot_pkt_t *pkt, knot_section_t section_id,
-                                  const knot_dname_t *sname, uint16_t stype)
+                                  const knot_dname_t *sname, uint16_t stype,
+                                  struct kr_nsec3_cache *cache)
 {
 	const knot_pktsection_t *sec = knot_pkt_section(pkt, section_id);
 	if (!sec || !sname) {
@@ -560,7 +623,7 @@ static int no_data_response_no_ds(const knot_pkt_t *pkt, knot_section_t section_
 		}
 		flags = 0;
 
-		int ret = matches_name_and_type(&flags, rrset, sname, stype);
+		int ret = matches_name_and_type(&flags, rrset, sname, stype, cache);
 		if (ret != 0) {
 			return ret;
 		}
@@ -584,7 +647,8 @@ static int no_data_response_no_ds(const knot_pkt_t *pkt, knot_section_t section_
  * @return           0 or error code.
  */
 static int matches_closest_encloser_wildcard(const knot_pkt_t *pkt, knot_section_t section_id,
-                                             const knot_dname_t *encloser, uint16_t stype)
+                                             const knot_dname_t *encloser, uint16_t stype,
+                                             struct kr_nsec3_cache *cache)
 {
 	const knot_pktsection_t *sec = knot_pkt_section(pkt, section_id);
 	if (!sec || !encloser) {
@@ -606,7 +670,7 @@ static int matches_closest_encloser_wildcard(const knot_pkt_t *pkt, knot_section
 		}
 		flags = 0;
 
-		int ret = matches_name_and_type(&flags, rrset, wildcard, stype);
+		int ret = matches_name_and_type(&flags, rrset, wildcard, stype, cache);
 		if (ret != 0) {
 			return ret;
 		}
@@ -626,7 +690,8 @@ static int matches_closest_encloser_wildcard(const knot_pkt_t *pkt, knot_section
 }
 
 int kr_nsec3_wildcard_answer_response_check(const knot_pkt_t *pkt, knot_section_t section_id,
-                                            const knot_dname_t *sname, int trim_to_next)
+                                            const knot_dname_t *sname, int trim_to_next,
+                                            struct kr_nsec3_cache *cache)
 {
 	const knot_pktsection_t *sec = knot_pkt_section(pkt, section_id);
 	if (!sec || !sname) {
@@ -645,7 +710,7 @@ int kr_nsec3_wildcard_answer_response_check(const knot_pkt_t *pkt, knot_section_
 		if (rrset->type != KNOT_RRTYPE_NSEC3) {
 			continue;
 		}
-		int ret = covers_name(&flags, rrset, sname);
+		int ret = covers_name(&flags, rrset, sname, cache);
 		if (ret != 0) {
 			return ret;
 		}
@@ -659,10 +724,10 @@ int kr_nsec3_wildcard_answer_response_check(const knot_pkt_t *pkt, knot_section_
 
 
 int kr_nsec3_no_data(const knot_pkt_t *pkt, knot_section_t section_id,
-                     const knot_dname_t *sname, uint16_t stype)
+                     const knot_dname_t *sname, uint16_t stype, struct kr_nsec3_cache *cache)
 {
 	/* DS record may be also matched by an existing NSEC3 RR. */
-	int ret = no_data_response_no_ds(pkt, section_id, sname, stype);
+	int ret = no_data_response_no_ds(pkt, section_id, sname, stype, cache);
 	if (ret == 0) {
 		/* Satisfies RFC5155 8.5 and 8.6, both first paragraph. */
 		return ret;
@@ -672,14 +737,14 @@ int kr_nsec3_no_data(const knot_pkt_t *pkt, knot_section_t section_id,
 	const knot_dname_t *encloser_name = NULL;
 	const knot_rrset_t *covering_next_nsec3 = NULL;
 	ret = closest_encloser_proof(pkt, section_id, sname, &encloser_name,
-                                     NULL, &covering_next_nsec3);
+                                     NULL, &covering_next_nsec3, cache);
 	if (ret != 0) {
 		return ret;
 	}
 
 	assert(encloser_name && covering_next_nsec3);
 	ret = matches_closest_encloser_wildcard(pkt, section_id,
-	                                         encloser_name, stype);
+	                                         encloser_name, stype, cache);
 	if (ret == 0) {
 		/* Satisfies RFC5155 8.7 */
 		return ret;
@@ -703,7 +768,7 @@ int kr_nsec3_no_data(const knot_pkt_t *pkt, knot_section_t section_id,
 	return ret;
 }
 
-int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt)
+int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt, struct kr_nsec3_cache *cache)
 {
 	int ret = kr_error(EINVAL);
 	int flags = 0;
@@ -733,9 +798,9 @@ int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt)
 			/* nsec3 found, check if owner name matches
 			 * the delegation name
 			 */
-			ret = matches_name(&flags, nsec3, ns->owner);
+			ret = matches_name(&flags, nsec3, ns->owner, cache);
 			if (ret != 0) {
-				return kr_error(EINVAL);
+				return ret == kr_error(ERANGE) ? ret : kr_error(EINVAL);
 			}
 			if (!(flags & FLG_NAME_MATCHED)) {
 				/* nsec3 owner name does not match
@@ -771,9 +836,9 @@ int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt)
 		const knot_dname_t *encloser_name = NULL;
 		const knot_rrset_t *covering_next_nsec3 = NULL;
 		ret = closest_encloser_proof(pkt, KNOT_AUTHORITY, ns->owner, &encloser_name,
-                                     NULL, &covering_next_nsec3);
+                                     NULL, &covering_next_nsec3, cache);
 		if (ret != 0) {
-			return kr_error(EINVAL);
+			return ret == kr_error(ERANGE) ? ret : kr_error(EINVAL);
 		}
 
 		if (has_optout(covering_next_nsec3)) {
@@ -17,6 +17,39 @@
 #pragma once
 
 #include <libknot/packet/pkt.h>
+#include "lib/defines.h"
+#include "lib/generic/lru.h"
+
+/** Memoized NSEC3 hash of a name (SHA-1 is the only defined algorithm). */
+struct kr_nsec3_hash {
+	uint8_t size;
+	uint8_t data[20];
+};
+
+typedef lru_t(struct kr_nsec3_hash) kr_nsec3_lru_t;
+
+/**
+ * NSEC3 hashing context, shared by the proofs of all queries.
+ * Hashes are keyed by the NSEC3 parameters (algorithm, iterations, salt) and the name,
+ * so the zones don't have to be tracked explicitly.
+ */
+struct kr_nsec3_cache {
+	kr_nsec3_lru_t *lru;      /**< Memoized hashes. */
+	uint16_t max_iterations;  /**< Proofs with more iterations are not checked. */
+};
+
+/**
+ * Create NSEC3 hashing context.
+ * @param max_slots      Maximum number of memoized hashes.
+ * @param max_iterations Iteration ceiling.
+ * @return               New context or NULL.
+ */
+KR_EXPORT
+struct kr_nsec3_cache *kr_nsec3_cache_create(size_t max_slots, uint16_t max_iterations);
+
+/** Free NSEC3 hashing context. */
+KR_EXPORT
+void kr_nsec3_cache_free(struct kr_nsec3_cache *cache);
 
 /**
  * Name error response check (RFC5155 7.2.2).
@@ -24,10 +57,11 @@
  * @param pkt        Packet structure to be processed.
  * @param section_id Packet section to be processed.
  * @param sname      Name to be checked.
- * @return           0 or error code.
+ * @param cache      Hashing context (optional).
+ * @return           0 or error code, ERANGE if the iteration ceiling is exceeded.
  */
 int kr_nsec3_name_error_response_check(const knot_pkt_t *pkt, knot_section_t section_id,
-                                       const knot_dname_t *sname);
+                                       const knot_dname_t *sname, struct kr_nsec3_cache *cache);
 
 /**
  * Wildcard answer response check (RFC5155 7.2.6).
@@ -35,10 +69,12 @@ int kr_nsec3_name_error_response_check(const knot_pkt_t *pkt, knot_section_t sec
  * @param section_id   Packet section to be processed.
  * @param sname        Name to be checked.
  * @param trim_to_next Number of labels to remove to obtain next closer name.
+ * @param cache        Hashing context (optional).
  * @return             0 or error code.
  */
 int kr_nsec3_wildcard_answer_response_check(const knot_pkt_t *pkt, knot_section_t section_id,
-                                            const knot_dname_t *sname, int trim_to_next);
+                                            const knot_dname_t *sname, int trim_to_next,
+                                            struct kr_nsec3_cache *cache);
 
 /**
  * Authenticated denial of existence according to RFC5155 8.5 and 8.7.
@@ -47,21 +83,25 @@ int kr_nsec3_wildcard_answer_response_check(const knot_pkt_t *pkt, knot_section_
  * @param section_id Packet section to be processed.
  * @param sname      Queried domain name.
  * @param stype      Queried type.
+ * @param cache      Hashing context (optional).
  * @return           0 or error code:
  * 		     DNSSEC_NOT_FOUND - denial of existence can't be proven
- *		     due to opt-out, otherwise - bogus.
+ *		     due to opt-out,
+ *		     ERANGE - iteration ceiling exceeded, otherwise - bogus.
  */
 int kr_nsec3_no_data(const knot_pkt_t *pkt, knot_section_t section_id,
-                     const knot_dname_t *sname, uint16_t stype);
+                     const knot_dname_t *sname, uint16_t stype, struct kr_nsec3_cache *cache);
 
 /**
  * Referral to unsigned subzone check (RFC5155 8.9).
  * @note 	     No RRSIGs are validated.
  * @param pkt        Packet structure to be processed.
+ * @param cache      Hashing context (optional).
  * @return           0 or error code:
  * 		     DNSSEC_NOT_FOUND - denial of existence can't be proven
  *		     due to opt-out.
+ *		     ERANGE - iteration ceiling exceeded.
  *		     EEXIST - ds record was found.
  *		     EINVAL - bogus.
  */
-int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt);
+int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt, struct kr_nsec3_cache *cache);
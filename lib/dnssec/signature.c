@@ -20,13 +20,16 @@
 
 #include <dnssec/error.h>
 #include <dnssec/key.h>
+#include <dnssec/random.h>
 #include <dnssec/sign.h>
+#include <dnssec/tsig.h>
 #include <libknot/descriptor.h>
 #include <libknot/packet/rrset-wire.h>
 #include <libknot/packet/wire.h>
 #include <libknot/rrset.h>
 #include <libknot/rrtype/rrsig.h>
 #include <libknot/rrtype/ds.h>
+#include <contrib/wire.h>
 
 #include "lib/defines.h"
 #include "lib/utils.h"
@@ -161,17 +164,17 @@ static int sign_ctx_add_self(dnssec_sign_ctx_t *ctx, const uint8_t *rdata)
 #undef RRSIG_RDATA_SIGNER_OFFSET
 
 /*!
- * \brief Add covered RRs to signing context.
+ * \brief Serialize covered RRs in the signed form.
  *
  * Requires all DNAMEs in canonical form and all RRs ordered canonically.
  *
- * \param ctx      Signing context.
  * \param covered  Covered RRs.
+ * \param wire     Output, points to a static buffer valid until next call.
  *
  * \return Error code, KNOT_EOK if successful.
  */
-static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *covered,
-                                uint32_t orig_ttl, int trim_labels)
+static int covered_to_wire(const knot_rrset_t *covered, uint32_t orig_ttl, int trim_labels,
+                           dnssec_binary_t *wire)
 {
 	// huge block of rrsets can be optionally created
 	static uint8_t wire_buffer[KNOT_WIRE_MAX_PKTSIZE];
@@ -199,11 +202,9 @@ static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *cove
 		*(--beginp) = 1;
 	}
 
-	dnssec_binary_t wire_binary = {
-		.size = written - (beginp - wire_buffer),
-		.data = beginp
-	};
-	return dnssec_sign_add(ctx, &wire_binary);
+	wire->size = written - (beginp - wire_buffer);
+	wire->data = beginp;
+	return kr_ok();
 }
 
 /*!
@@ -212,29 +213,85 @@ static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *cove
  * RFC 4034: The signature covers RRSIG RDATA field (excluding the signature)
  * and all matching RR records, which are ordered canonically.
  *
- * Requires all DNAMEs in canonical form and all RRs ordered canonically.
- *
  * \param ctx          Signing context.
  * \param rrsig_rdata  RRSIG RDATA with populated fields except signature.
- * \param covered      Covered RRs.
+ * \param covered      Covered RRs in signed form.
  *
  * \return Error code, KNOT_EOK if successful.
  */
 /* TODO -- Taken from knot/src/knot/dnssec/rrset-sign.c. Re-write for better fit needed. */
 static int sign_ctx_add_data(dnssec_sign_ctx_t *ctx, const uint8_t *rrsig_rdata,
-                             const knot_rrset_t *covered, uint32_t orig_ttl, int trim_labels)
+                             const dnssec_binary_t *covered)
 {
 	int result = sign_ctx_add_self(ctx, rrsig_rdata);
 	if (result != KNOT_EOK) {
 		return result;
 	}
 
-	return sign_ctx_add_records(ctx, covered, orig_ttl, trim_labels);
+	return dnssec_sign_add(ctx, covered);
+}
+
+/** @internal Add length-prefixed data to MAC, so the fields can't be shifted. */
+static void sigcache_mac_add(dnssec_tsig_ctx_t *mac, const dnssec_binary_t *data)
+{
+	uint8_t len[sizeof(uint32_t)];
+	wire_write_u32(len, data->size);
+	dnssec_binary_t len_bin = { .size = sizeof(len), .data = len };
+	dnssec_tsig_add(mac, &len_bin);
+	dnssec_tsig_add(mac, data);
+}
+
+/** @internal Compute cache key from all the verification inputs. */
+static int sigcache_key(struct kr_sigcache *cache, uint8_t *dst, const dnssec_key_t *key,
+                        const dnssec_binary_t *rrsig, const dnssec_binary_t *covered)
+{
+	dnssec_binary_t key_rdata = { 0, };
+	if (dnssec_key_get_rdata(key, &key_rdata) != DNSSEC_EOK) {
+		return kr_error(EINVAL);
+	}
+	dnssec_binary_t secret = { .size = sizeof(cache->secret), .data = cache->secret };
+	dnssec_tsig_ctx_t *mac = NULL;
+	if (dnssec_tsig_new(&mac, DNSSEC_TSIG_HMAC_SHA256, &secret) != DNSSEC_EOK) {
+		return kr_error(ENOMEM);
+	}
+	assert(dnssec_tsig_size(mac) == KR_SIGCACHE_KEYLEN);
+	sigcache_mac_add(mac, &key_rdata);
+	sigcache_mac_add(mac, rrsig);
+	sigcache_mac_add(mac, covered);
+	dnssec_tsig_write(mac, dst);
+	dnssec_tsig_free(mac);
+	return kr_ok();
+}
+
+void kr_sigcache_free(struct kr_sigcache *cache)
+{
+	if (cache) {
+		lru_free(cache->lru);
+		free(cache);
+	}
+}
+
+struct kr_sigcache *kr_sigcache_create(size_t max_slots)
+{
+	struct kr_sigcache *cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		return NULL;
+	}
+	lru_create(&cache->lru, max_slots, NULL, NULL);
+	if (!cache->lru) {
+		free(cache);
+		return NULL;
+	}
+	if (dnssec_random_buffer(cache->secret, sizeof(cache->secret)) != DNSSEC_EOK) {
+		kr_sigcache_free(cache);
+		return NULL;
+	}
+	return cache;
 }
 
 int kr_check_signature(const knot_rrset_t *rrsigs, size_t pos,
                        const dnssec_key_t *key, const knot_rrset_t *covered,
-                       int trim_labels)
+                       int trim_labels, struct kr_sigcache *cache)
 {
 	if (!rrsigs || !key || !dnssec_key_can_verify(key)) {
 		return kr_error(EINVAL);
@@ -243,6 +300,7 @@ int kr_check_signature(const knot_rrset_t *rrsigs, size_t pos,
 	int ret = 0;
 	dnssec_sign_ctx_t *sign_ctx = NULL;
 	dnssec_binary_t signature = {0, };
+	uint8_t *cached = NULL;
 
 	knot_rrsig_signature(&rrsigs->rrs, pos, &signature.data, &signature.size);
 	if (!signature.data || !signature.size) {
@@ -250,26 +308,52 @@ int kr_check_signature(const knot_rrset_t *rrsigs, size_t pos,
 		goto fail;
 	}
 
-	if (dnssec_sign_new(&sign_ctx, key) != 0) {
+	uint32_t orig_ttl = knot_rrsig_original_ttl(&rrsigs->rrs, pos);
+	const knot_rdata_t *rr_data = knot_rdataset_at(&rrsigs->rrs, pos);
+	uint8_t *rdata = knot_rdata_data(rr_data);
+
+	dnssec_binary_t covered_wire = {0, };
+	if (covered_to_wire(covered, orig_ttl, trim_labels, &covered_wire) != 0) {
 		ret = kr_error(ENOMEM);
 		goto fail;
 	}
 
-	uint32_t orig_ttl = knot_rrsig_original_ttl(&rrsigs->rrs, pos);
-	const knot_rdata_t *rr_data = knot_rdataset_at(&rrsigs->rrs, pos);
-	uint8_t *rdata = knot_rdata_data(rr_data);
+	/* Look up the result of previous verification. */
+	if (cache) {
+		uint8_t cache_key[KR_SIGCACHE_KEYLEN];
+		dnssec_binary_t rrsig_rdata = { .size = knot_rdata_rdlen(rr_data), .data = rdata };
+		if (sigcache_key(cache, cache_key, key, &rrsig_rdata, &covered_wire) == 0) {
+			cached = lru_get_new(cache->lru, (const char *)cache_key, sizeof(cache_key));
+		}
+		if (cached && *cached != KR_SIGCACHE_NONE) {
+			cache->stats.hit += 1;
+			return (*cached == KR_SIGCACHE_VALID) ? kr_ok() : kr_error(EBADMSG);
+		}
+		cache->stats.miss += 1;
+	}
+
+	if (dnssec_sign_new(&sign_ctx, key) != 0) {
+		ret = kr_error(ENOMEM);
+		goto fail;
+	}
 
-	if (sign_ctx_add_data(sign_ctx, rdata, covered, orig_ttl, trim_labels) != 0) {
+	if (sign_ctx_add_data(sign_ctx, rdata, &covered_wire) != 0) {
 		ret = kr_error(ENOMEM);
 		goto fail;
 	}
 
 	if (dnssec_sign_verify(sign_ctx, &signature) != 0) {
 		ret = kr_error(EBADMSG);
+		if (cached) {
+			*cached = KR_SIGCACHE_BOGUS;
+		}
 		goto fail;
 	}
 
 	ret = kr_ok();
+	if (cached) {
+		*cached = KR_SIGCACHE_VALID;
+	}
 
 fail:
 	dnssec_sign_free(sign_ctx);
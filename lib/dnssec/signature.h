@@ -18,6 +18,48 @@
 
 #include <dnssec/key.h>
 #include <libknot/rrset.h>
+#include "lib/defines.h"
+#include "lib/generic/lru.h"
+
+/** Length of the signature cache key (HMAC-SHA256). */
+#define KR_SIGCACHE_KEYLEN 32
+
+/** Cached result of the signature verification. */
+enum kr_sigcache_result {
+	KR_SIGCACHE_NONE  = 0, /**< Not verified yet (new entry). */
+	KR_SIGCACHE_VALID = 1,
+	KR_SIGCACHE_BOGUS = 2
+};
+
+typedef lru_t(uint8_t) kr_sigcache_lru_t;
+
+/**
+ * Cache of signature verification results.
+ *
+ * The entries are keyed by a keyed MAC of the DNSKEY, RRSIG RDATA (including the signature
+ * and its validity period) and the covered RRSet in signed form, so a result is only reused
+ * for exactly the same input. The MAC key is random and per-process.
+ */
+struct kr_sigcache {
+	kr_sigcache_lru_t *lru;
+	uint8_t secret[KR_SIGCACHE_KEYLEN];
+	struct {
+		uint32_t hit;  /**< Number of verifications answered from cache */
+		uint32_t miss; /**< Number of verifications done */
+	} stats;
+};
+
+/**
+ * Create signature verification cache.
+ * @param max_slots maximum number of cached results
+ * @return          new cache or NULL
+ */
+KR_EXPORT
+struct kr_sigcache *kr_sigcache_create(size_t max_slots);
+
+/** Free signature verification cache. */
+KR_EXPORT
+void kr_sigcache_free(struct kr_sigcache *cache);
 
 /**
  * Performs referral authentication according to RFC4035 5.2, bullet 2
@@ -34,8 +76,9 @@ int kr_authenticate_referral(const knot_rrset_t *ref, const dnssec_key_t *key);
  * @param key         Key to be used to validate the signature.
  * @param covered     The covered RRSet.
  * @param trim_labels Number of the leftmost labels to be removed and replaced with '*.'.
+ * @param cache       Cache of verification results (optional).
  * @return            0 if signature valid, error code else.
  */
 int kr_check_signature(const knot_rrset_t *rrsigs, size_t pos,
                        const dnssec_key_t *key, const knot_rrset_t *covered,
-                       int trim_labels);
+                       int trim_labels, struct kr_sigcache *cache);
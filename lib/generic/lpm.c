@@ -0,0 +1,189 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "contrib/ucw/lib.h"
+#include "lib/generic/lpm.h"
+#include "lib/utils.h"
+
+struct lpm_node {
+	struct lpm_node *child[2];
+	void *val;
+	bool has_val;                    /**< Branching nodes have no value. */
+	uint8_t bits;                    /**< Prefix length. */
+	uint8_t key[LPM_MAXBITS / 8];    /**< Prefix, bits past the length are zero. */
+};
+
+/** @internal Return n-th bit of the key. */
+static inline unsigned key_bit(const uint8_t *key, unsigned n)
+{
+	return (key[n / 8] >> (7 - n % 8)) & 1;
+}
+
+/** @internal Return length of common prefix of a and b, at most maxbits. */
+static unsigned common_bits(const uint8_t *a, const uint8_t *b, unsigned maxbits)
+{
+	unsigned bits = 0;
+	for (unsigned i = 0; bits < maxbits; ++i, bits += 8) {
+		uint8_t diff = a[i] ^ b[i];
+		if (diff) {
+			bits += __builtin_clz(diff) - (sizeof(unsigned) - 1) * 8;
+			break;
+		}
+	}
+	return bits < maxbits ? bits : maxbits;
+}
+
+static struct lpm_node *make_node(lpm_t *tree, const uint8_t *key, unsigned bits)
+{
+	struct lpm_node *node = mm_alloc(tree->pool, sizeof(*node));
+	if (!node) {
+		return NULL;
+	}
+	memset(node, 0, sizeof(*node));
+	node->bits = bits;
+	memcpy(node->key, key, (bits + 7) / 8);
+	if (bits % 8) {
+		node->key[bits / 8] &= 0xff << (8 - bits % 8);
+	}
+	return node;
+}
+
+void lpm_init(lpm_t *tree, knot_mm_t *pool)
+{
+	tree->root = NULL;
+	tree->pool = pool;
+}
+
+int lpm_insert(lpm_t *tree, const uint8_t *key, unsigned bits, void *val)
+{
+	if (!tree || !key || bits > LPM_MAXBITS) {
+		return kr_error(EINVAL);
+	}
+	struct lpm_node **slot = &tree->root;
+	while (*slot) {
+		struct lpm_node *node = *slot;
+		unsigned common = common_bits(node->key, key, MIN(node->bits, bits));
+		if (common == node->bits) {
+			if (bits == node->bits) { /* Existing prefix */
+				node->val = val;
+				node->has_val = true;
+				return kr_ok();
+			}
+			slot = &node->child[key_bit(key, node->bits)];
+			continue;
+		}
+		/* The new prefix diverges from (or encloses) the node. */
+		struct lpm_node *parent = make_node(tree, key, common);
+		if (!parent) {
+			return kr_error(ENOMEM);
+		}
+		parent->child[key_bit(node->key, common)] = node;
+		if (common == bits) {
+			parent->val = val;
+			parent->has_val = true;
+		} else {
+			struct lpm_node *leaf = make_node(tree, key, bits);
+			if (!leaf) {
+				mm_free(tree->pool, parent);
+				return kr_error(ENOMEM);
+			}
+			leaf->val = val;
+			leaf->has_val = true;
+			parent->child[key_bit(key, common)] = leaf;
+		}
+		*slot = parent;
+		return kr_ok();
+	}
+	struct lpm_node *leaf = make_node(tree, key, bits);
+	if (!leaf) {
+		return kr_error(ENOMEM);
+	}
+	leaf->val = val;
+	leaf->has_val = true;
+	*slot = leaf;
+	return kr_ok();
+}
+
+void *lpm_match(const lpm_t *tree, const uint8_t *key, unsigned bits, unsigned *match_bits)
+{
+	if (!tree || !key) {
+		return NULL;
+	}
+	const struct lpm_node *best = NULL;
+	const struct lpm_node *node = tree->root;
+	while (node && node->bits <= bits) {
+		if (common_bits(node->key, key, node->bits) != node->bits) {
+			break;
+		}
+		if (node->has_val) {
+			best = node;
+		}
+		if (node->bits == bits) {
+			break;
+		}
+		node = node->child[key_bit(key, node->bits)];
+	}
+	if (!best) {
+		return NULL;
+	}
+	if (match_bits) {
+		*match_bits = best->bits;
+	}
+	return best->val;
+}
+
+int lpm_match_all(const lpm_t *tree, const uint8_t *key, unsigned bits, void **vals, int max)
+{
+	if (!tree || !key || !vals) {
+		return 0;
+	}
+	int count = 0;
+	const struct lpm_node *node = tree->root;
+	while (node && node->bits <= bits && count < max) {
+		if (common_bits(node->key, key, node->bits) != node->bits) {
+			break;
+		}
+		if (node->has_val) {
+			vals[count++] = node->val;
+		}
+		if (node->bits == bits) {
+			break;
+		}
+		node = node->child[key_bit(key, node->bits)];
+	}
+	return count;
+}
+
+static void free_nodes(lpm_t *tree, struct lpm_node *node)
+{
+	if (node) {
+		free_nodes(tree, node->child[0]);
+		free_nodes(tree, node->child[1]);
+		mm_free(tree->pool, node);
+	}
+}
+
+void lpm_clear(lpm_t *tree)
+{
+	if (tree) {
+		free_nodes(tree, tree->root);
+		tree->root = NULL;
+	}
+}
@@ -0,0 +1,107 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file lpm.h
+ * @brief Longest prefix match on bit strings up to 128 bits (i.e. IPv4/IPv6 subnets),
+ *        implemented as a path-compressed binary trie.
+ *
+ * Lookup visits at most one node per distinct prefix length on the path,
+ * so it doesn't depend on the number of stored prefixes.
+ * Keep a separate tree for each address family.
+ *
+ * # Example usage:
+ *
+ * @code{.c}
+ * 	lpm_t tree;
+ * 	lpm_init(&tree, NULL);
+ *
+ * 	// Insert 10.0.0.0/8 and 10.1.0.0/16
+ * 	uint8_t net[4] = { 10, 0, 0, 0 };
+ * 	lpm_insert(&tree, net, 8, "ten");
+ * 	net[1] = 1;
+ * 	lpm_insert(&tree, net, 16, "ten-one");
+ *
+ * 	// Find the most specific prefix covering 10.1.2.3
+ * 	uint8_t addr[4] = { 10, 1, 2, 3 };
+ * 	const char *val = lpm_match(&tree, addr, 32, NULL);
+ * 	if (val)
+ * 		printf("%s\n", val); // ten-one
+ *
+ * 	lpm_clear(&tree);
+ * @endcode
+ *
+ * \addtogroup generics
+ * @{
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <libknot/mm_ctx.h>
+#include "lib/defines.h"
+
+/** Maximum key length in bits. */
+#define LPM_MAXBITS 128
+
+struct lpm_node;
+
+/** Longest prefix match tree, zero-initialized tree is empty and uses malloc(). */
+typedef struct {
+	struct lpm_node *root;
+	knot_mm_t *pool;
+} lpm_t;
+
+/** Initialize empty tree, pool may be NULL (use malloc). */
+KR_EXPORT
+void lpm_init(lpm_t *tree, knot_mm_t *pool);
+
+/**
+ * Insert prefix with associated value, the value of an existing prefix is replaced.
+ * @param key   prefix bits in network order
+ * @param bits  prefix length, at most LPM_MAXBITS
+ * @param val   associated value
+ * @return 0 or an error
+ */
+KR_EXPORT
+int lpm_insert(lpm_t *tree, const uint8_t *key, unsigned bits, void *val);
+
+/**
+ * Find the longest stored prefix of the key.
+ * @param key   searched bits in network order (e.g. address)
+ * @param bits  key length (e.g. 32 for IPv4)
+ * @param match_bits length of the matched prefix (optional)
+ * @return associated value or NULL if no prefix matches
+ */
+KR_EXPORT
+void *lpm_match(const lpm_t *tree, const uint8_t *key, unsigned bits, unsigned *match_bits);
+
+/**
+ * Find all stored prefixes of the key, from the shortest to the longest.
+ * @param key   searched bits in network order (e.g. address)
+ * @param bits  key length (e.g. 32 for IPv4)
+ * @param vals  output array of associated values
+ * @param max   capacity of the output array, at most LPM_MAXBITS + 1 prefixes can match
+ * @return number of matched prefixes written to vals
+ */
+KR_EXPORT
+int lpm_match_all(const lpm_t *tree, const uint8_t *key, unsigned bits, void **vals, int max);
+
+/** Remove all prefixes from the tree. */
+KR_EXPORT
+void lpm_clear(lpm_t *tree);
+
+/** @} */
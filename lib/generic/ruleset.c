@@ -0,0 +1,340 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libknot/packet/wire.h>
+
+#include "lib/generic/array.h"
+#include "lib/generic/lpm.h"
+#include "lib/generic/map.h"
+#include "lib/generic/ruleset.h"
+#include "lib/utils.h"
+
+/** @internal Additional clause predicate, see kr_ruleset_and(). */
+struct ruleset_pred {
+	enum { PRED_QNAME, PRED_SRC, PRED_DST } field;
+	int family, bits;
+	uint8_t addr[16];
+	knot_dname_t *qname;   /**< Lowercase QNAME suffix */
+};
+
+/** @internal Rule clause, zero family means the address isn't checked. */
+struct ruleset_clause {
+	int id;
+	int src_family, src_bits;
+	int dst_family, dst_bits;
+	uint8_t src[16];
+	uint8_t dst[16];
+	array_t(struct ruleset_pred) preds;
+};
+
+typedef array_t(struct ruleset_clause *) clause_list_t;
+
+struct kr_ruleset {
+	map_t by_qname;                 /**< Clauses with QNAME suffix, keyed by the suffix. */
+	lpm_t by_src[2];                /**< Clauses with source subnet only, IPv4 and IPv6. */
+	clause_list_t other;            /**< Clauses without indexed predicate. */
+	array_t(clause_list_t *) lists; /**< Indexed clause lists. */
+	struct ruleset_clause *last;    /**< Last added clause, see kr_ruleset_and(). */
+};
+
+static lpm_t *ruleset_tree(struct kr_ruleset *rs, int family)
+{
+	switch (family) {
+	case AF_INET:  return &rs->by_src[0];
+	case AF_INET6: return &rs->by_src[1];
+	default:       return NULL;
+	}
+}
+
+static void clause_list_free(clause_list_t *list)
+{
+	for (size_t i = 0; i < list->len; ++i) {
+		struct ruleset_clause *clause = list->at[i];
+		for (size_t j = 0; j < clause->preds.len; ++j) {
+			free(clause->preds.at[j].qname);
+		}
+		array_clear(clause->preds);
+		free(clause);
+	}
+	array_clear(*list);
+}
+
+struct kr_ruleset *kr_ruleset_new(void)
+{
+	struct kr_ruleset *rs = malloc(sizeof(*rs));
+	if (rs) {
+		memset(rs, 0, sizeof(*rs));
+		rs->by_qname = map_make();
+		lpm_init(&rs->by_src[0], NULL);
+		lpm_init(&rs->by_src[1], NULL);
+	}
+	return rs;
+}
+
+void kr_ruleset_free(struct kr_ruleset *rs)
+{
+	if (!rs) {
+		return;
+	}
+	for (size_t i = 0; i < rs->lists.len; ++i) {
+		clause_list_free(rs->lists.at[i]);
+		free(rs->lists.at[i]);
+	}
+	array_clear(rs->lists);
+	clause_list_free(&rs->other);
+	map_clear(&rs->by_qname);
+	lpm_clear(&rs->by_src[0]);
+	lpm_clear(&rs->by_src[1]);
+	free(rs);
+}
+
+static int parse_subnet(const char *str, uint8_t *addr, int *family, int *bits)
+{
+	*family = kr_straddr_family(str);
+	*bits = kr_straddr_subnet(addr, str);
+	if (*family < 0 || *bits < 0) {
+		return kr_error(EINVAL);
+	}
+	return kr_ok();
+}
+
+static clause_list_t *ruleset_list_new(struct kr_ruleset *rs)
+{
+	clause_list_t *list = malloc(sizeof(*list));
+	if (!list) {
+		return NULL;
+	}
+	array_init(*list);
+	if (array_push(rs->lists, list) < 0) {
+		free(list);
+		return NULL;
+	}
+	return list;
+}
+
+/** @internal Find or create list of clauses for given index key. */
+static clause_list_t *ruleset_list(struct kr_ruleset *rs, const knot_dname_t *qname,
+                                   const struct ruleset_clause *clause)
+{
+	clause_list_t *list = NULL;
+	if (qname) {
+		list = map_get(&rs->by_qname, (const char *)qname);
+		if (!list) {
+			list = ruleset_list_new(rs);
+			if (list && map_set(&rs->by_qname, (const char *)qname, list) != 0) {
+				return NULL;
+			}
+		}
+	} else if (clause->src_family) {
+		lpm_t *tree = ruleset_tree(rs, clause->src_family);
+		unsigned matched = 0;
+		list = lpm_match(tree, clause->src, clause->src_bits, &matched);
+		if (!list || matched != (unsigned)clause->src_bits) {
+			list = ruleset_list_new(rs);
+			if (list && lpm_insert(tree, clause->src, clause->src_bits, list) != 0) {
+				return NULL;
+			}
+		}
+	} else {
+		list = &rs->other;
+	}
+	return list;
+}
+
+int kr_ruleset_add(struct kr_ruleset *rs, int id, const knot_dname_t *qname,
+                   const char *src, const char *dst)
+{
+	if (!rs) {
+		return kr_error(EINVAL);
+	}
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	if (qname) {
+		if (knot_dname_to_wire(key, qname, sizeof(key)) < 0) {
+			return kr_error(EINVAL);
+		}
+		knot_dname_to_lower(key);
+	}
+	struct ruleset_clause *clause = malloc(sizeof(*clause));
+	if (!clause) {
+		return kr_error(ENOMEM);
+	}
+	memset(clause, 0, sizeof(*clause));
+	clause->id = id;
+	if ((src && parse_subnet(src, clause->src, &clause->src_family, &clause->src_bits) != 0) ||
+	    (dst && parse_subnet(dst, clause->dst, &clause->dst_family, &clause->dst_bits) != 0)) {
+		free(clause);
+		return kr_error(EINVAL);
+	}
+	clause_list_t *list = ruleset_list(rs, qname ? key : NULL, clause);
+	if (!list || array_push(*list, clause) < 0) {
+		free(clause);
+		return kr_error(ENOMEM);
+	}
+	rs->last = clause;
+	return kr_ok();
+}
+
+int kr_ruleset_and(struct kr_ruleset *rs, int id, const knot_dname_t *qname,
+                   const char *src, const char *dst)
+{
+	if (!rs || !rs->last || rs->last->id != id || (!qname + !src + !dst) != 2) {
+		return kr_error(EINVAL);
+	}
+	struct ruleset_pred pred;
+	memset(&pred, 0, sizeof(pred));
+	if (qname) {
+		pred.field = PRED_QNAME;
+		pred.qname = knot_dname_copy(qname, NULL);
+		if (!pred.qname) {
+			return kr_error(ENOMEM);
+		}
+		knot_dname_to_lower(pred.qname);
+	} else {
+		pred.field = src ? PRED_SRC : PRED_DST;
+		if (parse_subnet(src ? src : dst, pred.addr, &pred.family, &pred.bits) != 0) {
+			return kr_error(EINVAL);
+		}
+	}
+	if (array_push(rs->last->preds, pred) < 0) {
+		free(pred.qname);
+		return kr_error(ENOMEM);
+	}
+	return kr_ok();
+}
+
+static bool match_subnet(int family, const uint8_t *subnet, int bits, const struct sockaddr *addr)
+{
+	if (!family) {
+		return true;
+	}
+	if (kr_inaddr_family(addr) != family) {
+		return false;
+	}
+	return bits == 0 || kr_bitcmp((const char *)subnet, kr_inaddr(addr), bits) == 0;
+}
+
+/** @internal Check if the lowercase name is equal to or below the suffix. */
+static bool match_suffix(const knot_dname_t *suffix, const knot_dname_t *name)
+{
+	if (!name) {
+		return false;
+	}
+	while (true) {
+		if (knot_dname_is_equal(name, suffix)) {
+			return true;
+		}
+		if (!name[0]) {
+			return false;
+		}
+		name = knot_wire_next_label(name, NULL);
+	}
+}
+
+/** @internal Evaluate additional predicates of a clause. */
+static bool match_preds(const struct ruleset_clause *clause, const knot_dname_t *qname,
+                        const struct sockaddr *src, const struct sockaddr *dst)
+{
+	for (size_t i = 0; i < clause->preds.len; ++i) {
+		const struct ruleset_pred *pred = &clause->preds.at[i];
+		bool match = false;
+		switch (pred->field) {
+		case PRED_QNAME:
+			match = match_suffix(pred->qname, qname);
+			break;
+		case PRED_SRC:
+			match = match_subnet(pred->family, pred->addr, pred->bits, src);
+			break;
+		case PRED_DST:
+			match = match_subnet(pred->family, pred->addr, pred->bits, dst);
+			break;
+		}
+		if (!match) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/** @internal Evaluate residual predicates of candidate clauses. */
+static int match_clauses(const clause_list_t *list, const knot_dname_t *qname,
+                         const struct sockaddr *src, const struct sockaddr *dst,
+                         int *ids, int count, int max)
+{
+	for (size_t i = 0; i < list->len; ++i) {
+		const struct ruleset_clause *clause = list->at[i];
+		if (match_subnet(clause->src_family, clause->src, clause->src_bits, src) &&
+		    match_subnet(clause->dst_family, clause->dst, clause->dst_bits, dst) &&
+		    match_preds(clause, qname, src, dst)) {
+			/* Keep counting past the capacity, so the caller can grow it. */
+			if (count < max) {
+				ids[count] = clause->id;
+			}
+			count += 1;
+		}
+	}
+	return count;
+}
+
+static int id_cmp(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+int kr_ruleset_match(struct kr_ruleset *rs, const knot_dname_t *qname,
+                     const struct sockaddr *src, const struct sockaddr *dst, int *ids, int max)
+{
+	if (!rs || !ids) {
+		return 0;
+	}
+	int count = 0;
+	/* Clauses for every enclosing QNAME suffix */
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	const knot_dname_t *name = NULL;
+	if (qname && knot_dname_to_wire(key, qname, sizeof(key)) > 0) {
+		knot_dname_to_lower(key);
+		name = key;
+		const uint8_t *label = key;
+		while (true) {
+			const clause_list_t *list = map_get(&rs->by_qname, (const char *)label);
+			if (list) {
+				count = match_clauses(list, name, src, dst, ids, count, max);
+			}
+			if (!label[0]) {
+				break;
+			}
+			label = knot_wire_next_label(label, NULL);
+		}
+	}
+	/* Clauses for every enclosing source subnet */
+	lpm_t *tree = ruleset_tree(rs, kr_inaddr_family(src));
+	if (tree) {
+		void *lists[LPM_MAXBITS + 1];
+		const int nlists = lpm_match_all(tree, (const uint8_t *)kr_inaddr(src),
+		                                 kr_inaddr_len(src) * 8, lists, LPM_MAXBITS + 1);
+		for (int i = 0; i < nlists; ++i) {
+			count = match_clauses(lists[i], name, src, dst, ids, count, max);
+		}
+	}
+	count = match_clauses(&rs->other, name, src, dst, ids, count, max);
+	/* Each clause is indexed once, so the identifiers are unique. */
+	if (count <= max) {
+		qsort(ids, count, sizeof(*ids), id_cmp);
+	}
+	return count;
+}
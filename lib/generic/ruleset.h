@@ -0,0 +1,83 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file ruleset.h
+ * @brief Firewall rule table, clauses are indexed by QNAME suffix (map_t)
+ *        or source subnet (lpm_t), so only the candidate clauses are evaluated.
+ *
+ * \addtogroup generics
+ * @{
+ */
+
+#pragma once
+
+#include <sys/socket.h>
+#include <libknot/dname.h>
+#include "lib/defines.h"
+
+/**
+ * Firewall rule table, see kr_ruleset_match().
+ * Each clause is a conjunction of predicates on QNAME suffix, source and destination subnet,
+ * clauses are indexed by the QNAME suffix or the source subnet, if present.
+ */
+struct kr_ruleset;
+
+/** Create empty rule table. */
+KR_EXPORT
+struct kr_ruleset *kr_ruleset_new(void);
+
+/** Free rule table. */
+KR_EXPORT
+void kr_ruleset_free(struct kr_ruleset *rs);
+
+/**
+ * Add clause to the table, a rule may consist of several clauses (i.e. disjunction).
+ * @param id     clause identifier, clauses are matched in the order of identifiers
+ * @param qname  QNAME suffix or NULL
+ * @param src    source subnet in CIDR notation or NULL
+ * @param dst    destination subnet in CIDR notation or NULL
+ * @return 0 or an error
+ */
+KR_EXPORT
+int kr_ruleset_add(struct kr_ruleset *rs, int id, const knot_dname_t *qname,
+                   const char *src, const char *dst);
+
+/**
+ * Add predicate to the last added clause, exactly one of the predicates must be given.
+ * The predicates of a clause are a conjunction, i.e. all of them must match.
+ * @param id     identifier of the last added clause
+ * @param qname  QNAME suffix or NULL
+ * @param src    source subnet in CIDR notation or NULL
+ * @param dst    destination subnet in CIDR notation or NULL
+ * @return 0 or an error
+ */
+KR_EXPORT
+int kr_ruleset_and(struct kr_ruleset *rs, int id, const knot_dname_t *qname,
+                   const char *src, const char *dst);
+
+/**
+ * Find clauses matching the query, only the indexed candidates are evaluated.
+ * @param ids  output array of clause identifiers in ascending order
+ * @param max  capacity of the output array
+ * @return number of matching clauses, if it's larger than max, the output array
+ *         holds an arbitrary subset of them and the call should be repeated with larger array
+ */
+KR_EXPORT
+int kr_ruleset_match(struct kr_ruleset *rs, const knot_dname_t *qname,
+                     const struct sockaddr *src, const struct sockaddr *dst, int *ids, int max);
+
+/** @} */
@@ -0,0 +1,137 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <libknot/packet/wire.h>
+
+#include "lib/generic/suffix.h"
+#include "lib/utils.h"
+
+map_t *kr_suffix_new(void)
+{
+	map_t *set = malloc(sizeof(*set));
+	if (set) {
+		*set = map_make();
+	}
+	return set;
+}
+
+void kr_suffix_free(map_t *set)
+{
+	if (set) {
+		map_clear(set);
+		free(set);
+	}
+}
+
+int kr_suffix_add(map_t *set, const knot_dname_t *name)
+{
+	if (!set || !name) {
+		return kr_error(EINVAL);
+	}
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	if (knot_dname_to_wire(key, name, sizeof(key)) < 0) {
+		return kr_error(EINVAL);
+	}
+	knot_dname_to_lower(key);
+	return map_set(set, (const char *)key, NULL);
+}
+
+const knot_dname_t *kr_suffix_match(map_t *set, const knot_dname_t *name)
+{
+	if (!set || !name) {
+		return NULL;
+	}
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	if (knot_dname_to_wire(key, name, sizeof(key)) < 0) {
+		return NULL;
+	}
+	knot_dname_to_lower(key);
+	/* Strip labels from the left, the first match is the longest one. */
+	const uint8_t *label = key;
+	while (true) {
+		if (map_contains(set, (const char *)label)) {
+			return name + (label - key);
+		}
+		if (!label[0]) {
+			break;
+		}
+		label = knot_wire_next_label(label, NULL);
+	}
+	return NULL;
+}
+
+struct kr_rpz {
+	map_t exact;    /**< Rules for the names themselves. */
+	map_t wildcard; /**< Rules for names below, keyed by the wildcard parent. */
+};
+
+struct kr_rpz *kr_rpz_new(void)
+{
+	struct kr_rpz *rpz = malloc(sizeof(*rpz));
+	if (rpz) {
+		rpz->exact = map_make();
+		rpz->wildcard = map_make();
+	}
+	return rpz;
+}
+
+void kr_rpz_free(struct kr_rpz *rpz)
+{
+	if (rpz) {
+		map_clear(&rpz->exact);
+		map_clear(&rpz->wildcard);
+		free(rpz);
+	}
+}
+
+int kr_rpz_add(struct kr_rpz *rpz, const knot_dname_t *owner, int action)
+{
+	if (!rpz || !owner || action <= 0) {
+		return kr_error(EINVAL);
+	}
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	if (knot_dname_to_wire(key, owner, sizeof(key)) < 0) {
+		return kr_error(EINVAL);
+	}
+	knot_dname_to_lower(key);
+	void *val = (void *)(intptr_t)action;
+	if (knot_dname_is_wildcard(key)) {
+		return map_set(&rpz->wildcard, (const char *)knot_wire_next_label(key, NULL), val);
+	}
+	return map_set(&rpz->exact, (const char *)key, val);
+}
+
+int kr_rpz_match(struct kr_rpz *rpz, const knot_dname_t *name)
+{
+	if (!rpz || !name) {
+		return 0;
+	}
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	if (knot_dname_to_wire(key, name, sizeof(key)) < 0) {
+		return 0;
+	}
+	knot_dname_to_lower(key);
+	void *val = map_get(&rpz->exact, (const char *)key);
+	/* Closest wildcard, i.e. the longest enclosing parent */
+	const uint8_t *label = key;
+	while (!val && label[0]) {
+		label = knot_wire_next_label(label, NULL);
+		val = map_get(&rpz->wildcard, (const char *)label);
+	}
+	return (intptr_t)val;
+}
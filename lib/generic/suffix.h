@@ -0,0 +1,80 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file suffix.h
+ * @brief Sets of domain names matched by suffix on label boundary,
+ *        i.e. zone lists and response policy zones.
+ *
+ * Names are stored lowercased in wire format in a map_t, a lookup strips
+ * the labels from the left so it takes one map search per label.
+ *
+ * \addtogroup generics
+ * @{
+ */
+
+#pragma once
+
+#include <libknot/dname.h>
+#include "lib/generic/map.h"
+#include "lib/defines.h"
+
+/** Create set of domain names for suffix matching, names are compared case-insensitively. */
+KR_EXPORT
+map_t *kr_suffix_new(void);
+
+/** Free set of domain names. */
+KR_EXPORT
+void kr_suffix_free(map_t *set);
+
+/** Add domain name to the set. */
+KR_EXPORT
+int kr_suffix_add(map_t *set, const knot_dname_t *name);
+
+/**
+ * Find the longest name in the set that is equal to or encloses the given name,
+ * i.e. matches its suffix on label boundary. The lookup takes one map search per label.
+ * @return pointer to the matched suffix within name or NULL
+ */
+KR_EXPORT
+const knot_dname_t *kr_suffix_match(map_t *set, const knot_dname_t *name);
+
+/** Response policy zone rules, see kr_rpz_match(). */
+struct kr_rpz;
+
+/** Create empty set of response policy rules. */
+KR_EXPORT
+struct kr_rpz *kr_rpz_new(void);
+
+/** Free response policy rules. */
+KR_EXPORT
+void kr_rpz_free(struct kr_rpz *rpz);
+
+/**
+ * Add rule for the owner name, wildcard owner applies to all names below its parent.
+ * @param action action identifier, must be positive
+ */
+KR_EXPORT
+int kr_rpz_add(struct kr_rpz *rpz, const knot_dname_t *owner, int action);
+
+/**
+ * Find rule for the name, exact match takes precedence over the closest wildcard.
+ * @return action identifier or 0 if no rule matches
+ */
+KR_EXPORT
+int kr_rpz_match(struct kr_rpz *rpz, const knot_dname_t *name);
+
+/** @} */
@@ -72,6 +72,9 @@ struct kr_layer_api {
 	/** Produce either an answer to the request or a query for upstream (or fail). */
 	int (*produce)(kr_layer_t *ctx, knot_pkt_t *pkt);
 
+	/** The query sent to the upstream address wasn't answered in time, see kr_resolve_timeout(). */
+	int (*timeout)(kr_layer_t *ctx, const struct sockaddr *addr);
+
 	/** The module can store anything in here. */
 	void *data;
 };
@@ -84,5 +87,6 @@ struct kr_layer_pickle {
     const struct kr_layer_api *api;
     knot_pkt_t *pkt;
     unsigned state;
+    unsigned id; /**< Position in the consume hook table. */
 };
 
@@ -27,6 +27,7 @@
 #define DEBUG_MSG(qry, fmt...) QRDEBUG((qry), " pc ",  fmt)
 #define DEFAULT_MAXTTL (15 * 60)
 #define DEFAULT_NOTTL (5) /* Short-time "no data" retention to avoid bursts */
+#define NXDOMAIN_TYPE (0) /* Reserved RR type, marks names with NXDOMAIN answer (RFC 8020) */
 
 static uint32_t limit_ttl(uint32_t ttl)
 {
@@ -50,10 +51,14 @@ static int loot_cache_pkt(struct kr_cache *cache, knot_pkt_t *pkt, const knot_dn
                           uint16_t rrtype, bool want_secure, uint32_t timestamp, uint8_t *flags)
 {
 	struct kr_cache_entry *entry = NULL;
-	int ret = kr_cache_peek(cache, KR_CACHE_PKT, qname, rrtype, &entry, &timestamp);
+	size_t size = 0;
+	int ret = kr_cache_peek(cache, KR_CACHE_PKT, qname, rrtype, &entry, &size, &timestamp);
 	if (ret != 0) { /* Not in the cache */
 		return ret;
 	}
+	if (entry->count > size) { /* Corrupt entry */
+		return kr_error(EILSEQ);
+	}
 
 	/* Check that we have secure rank. */
 	if (want_secure && entry->rank == KR_RANK_BAD) {
@@ -100,6 +105,76 @@ static int loot_pktcache(struct kr_cache *cache, knot_pkt_t *pkt, struct kr_quer
 	return loot_cache_pkt(cache, pkt, qname, rrtype, want_secure, timestamp, flags);
 }
 
+/** @internal Synthesise NXDOMAIN if the name or its ancestor is known not to exist (RFC 8020). */
+static int loot_nxdomain(struct kr_cache *cache, knot_pkt_t *pkt, struct kr_query *qry, knot_mm_t *pool,
+                         uint8_t *flags)
+{
+	struct kr_cache_entry *entry = NULL;
+	const knot_dname_t *closest = NULL;
+	size_t size = 0;
+	uint32_t timestamp = qry->timestamp.tv_sec;
+	int ret = kr_cache_peek_closest(cache, KR_CACHE_PKT, qry->sname, NXDOMAIN_TYPE, &entry, &size,
+	                                &timestamp, &closest);
+	if (ret != 0) {
+		return ret;
+	}
+	if (entry->count > size) { /* Corrupt entry */
+		return kr_error(EILSEQ);
+	}
+	/* Only validated denials are trusted for the names below. */
+	if (entry->rank != KR_RANK_SECURE) {
+		return kr_error(ENOENT);
+	}
+
+	/* Parse the answer for the nonexistent ancestor */
+	knot_pkt_t *cached = knot_pkt_new(NULL, entry->count, pool);
+	if (!cached) {
+		return kr_error(ENOMEM);
+	}
+	memcpy(cached->wire, entry->data, entry->count);
+	cached->size = entry->count;
+	if (knot_pkt_parse(cached, 0) != 0) {
+		return kr_error(EILSEQ);
+	}
+
+	/* Answer for the original name, authority section is copied (SOA and denial proofs) */
+	uint16_t msgid = knot_wire_get_id(pkt->wire);
+	kr_pkt_recycle(pkt);
+	ret = knot_pkt_put_question(pkt, qry->sname, qry->sclass, qry->stype);
+	if (ret != 0) {
+		return ret;
+	}
+	knot_wire_set_id(pkt->wire, msgid);
+	knot_wire_set_rcode(pkt->wire, KNOT_RCODE_NXDOMAIN);
+	knot_pkt_begin(pkt, KNOT_AUTHORITY);
+	const knot_pktsection_t *ns = knot_pkt_section(cached, KNOT_AUTHORITY);
+	for (unsigned i = 0; i < ns->count; ++i) {
+		knot_rrset_t rr_copy;
+		ret = kr_cache_materialize(&rr_copy, knot_pkt_rr(ns, i), timestamp, 0, &pkt->mm);
+		if (ret == 0) {
+			ret = knot_pkt_put(pkt, 0, &rr_copy, KNOT_PF_FREE);
+			if (ret != 0) {
+				knot_rrset_clear(&rr_copy, &pkt->mm);
+			}
+		}
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	/* Copy cache entry flags */
+	if (flags) {
+		*flags = entry->flags;
+	}
+
+	WITH_DEBUG {
+		char name_str[KNOT_DNAME_MAXLEN];
+		knot_dname_to_str(name_str, closest, sizeof(name_str));
+		DEBUG_MSG(qry, "=> nothing below '%s'\n", name_str);
+	}
+	return kr_ok();
+}
+
 static int pktcache_peek(kr_layer_t *ctx, knot_pkt_t *pkt)
 {
 	struct kr_query *qry = ctx->req->current_query;
@@ -117,6 +192,9 @@ static int pktcache_peek(kr_layer_t *ctx, knot_pkt_t *pkt)
 	uint8_t flags = 0;
 	struct kr_cache *cache = &ctx->req->ctx->cache;
 	int ret = loot_pktcache(cache, pkt, qry, &flags);
+	if (ret != 0) {
+		ret = loot_nxdomain(cache, pkt, qry, &ctx->req->pool, &flags);
+	}
 	if (ret == 0) {
 		DEBUG_MSG(qry, "=> satisfied from cache\n");
 		qry->flags |= QUERY_CACHED|QUERY_NO_MINIMIZE;
@@ -184,7 +262,8 @@ static int pktcache_stash(kr_layer_t *ctx, knot_pkt_t *pkt)
 	/* Cache only NODATA/NXDOMAIN or metatype/RRSIG or wildcard expanded answers. */
 	const uint16_t qtype = knot_pkt_qtype(pkt);
 	const bool is_eligible = (knot_rrtype_is_metatype(qtype) || qtype == KNOT_RRTYPE_RRSIG);
-	const bool is_negative = kr_response_classify(pkt) & (PKT_NODATA|PKT_NXDOMAIN);
+	const int pkt_class = kr_response_classify(pkt);
+	const bool is_negative = pkt_class & (PKT_NODATA|PKT_NXDOMAIN);
 	if (!(is_eligible || is_negative || (qry->flags & QUERY_DNSSEC_WEXPAND))) {
 		return ctx->state;
 	}
@@ -231,6 +310,14 @@ static int pktcache_stash(kr_layer_t *ctx, knot_pkt_t *pkt)
 	if (ret == 0) {
 		DEBUG_MSG(qry, "=> answer cached for TTL=%u\n", ttl);
 	}
+	/* Remember that nothing exists below the name (RFC 8020).
+	 * Only validated answers to non-minimised queries are used, as broken servers answer
+	 * NXDOMAIN for empty non-terminals, see check_empty_nonterms().
+	 * Answers with CNAME chain are NXDOMAIN for the chain target, not the query name. */
+	if ((pkt_class & PKT_NXDOMAIN) && knot_wire_get_ancount(pkt->wire) == 0 &&
+	    header.rank == KR_RANK_SECURE && qtype == qry->stype && knot_dname_is_equal(qname, qry->sname)) {
+		kr_cache_insert(cache, KR_CACHE_PKT, qname, NXDOMAIN_TYPE, &header, data);
+	}
 	kr_cache_sync(cache);
 	return ctx->state;
 }
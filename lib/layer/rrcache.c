@@ -57,8 +57,14 @@ static int loot_rr(struct kr_cache *cache, knot_pkt_t *pkt, const knot_dname_t *
 		return ret;
 	}
 
-	/* Mark as expiring if it has less than 1% TTL (or less than 5s) */
+	/* Mark as expiring if it has less than 1% TTL (or less than 5s),
+	 * keep the shortest remaining TTL for refreshing. */
 	if (is_expiring(&cache_rr, drift)) {
+		uint32_t ttl = knot_rrset_ttl(&cache_rr);
+		ttl = ttl > drift ? ttl - drift : 0;
+		if (!(qry->flags & QUERY_EXPIRING) || ttl < qry->expiring_ttl) {
+			qry->expiring_ttl = ttl;
+		}
 		qry->flags |= QUERY_EXPIRING;
 	}
 
@@ -209,7 +215,12 @@ static int commit_rr(const char *key, void *val, void *data)
 	if ((rank & KR_RANK_AUTH) && (baton->qry->flags & QUERY_DNSSEC_WEXPAND)) {
 		flags |= KR_CACHE_FLAG_WCARD_PROOF;
 	}
-	return kr_cache_insert_rr(baton->cache, rr, rank, flags, baton->timestamp);
+	int ret = kr_cache_insert_rr(baton->cache, rr, rank, flags, baton->timestamp);
+	/* Cached zone cut at the name is stale now. */
+	if (ret == 0 && (rr->type == KNOT_RRTYPE_NS || rr->type == KNOT_RRTYPE_DS || rr->type == KNOT_RRTYPE_DNSKEY)) {
+		kr_zonecut_cache_del(baton->req->ctx->cache_cut, rr->owner);
+	}
+	return ret;
 }
 
 static int stash_commit(map_t *stash, struct kr_query *qry, struct kr_cache *cache, struct kr_request *req)
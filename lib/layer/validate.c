@@ -138,7 +138,8 @@ fail:
 	return ret;
 }
 
-static int validate_records(struct kr_query *qry, knot_pkt_t *answer, knot_mm_t *pool, bool has_nsec3)
+static int validate_records(struct kr_query *qry, knot_pkt_t *answer, knot_mm_t *pool, bool has_nsec3,
+                            struct kr_context *ctx)
 {
 	if (!qry->zone_cut.key) {
 		DEBUG_MSG(qry, "<= no DNSKEY, can't validate\n");
@@ -152,6 +153,9 @@ static int validate_records(struct kr_query *qry, knot_pkt_t *answer, knot_mm_t
 		.zone_name	= qry->zone_cut.name,
 		.timestamp	= qry->timestamp.tv_sec,
 		.has_nsec3	= has_nsec3,
+		.sigcache	= ctx->cache_sig,
+		.keycache	= ctx->cache_dnskey,
+		.nsec3cache	= ctx->cache_nsec3,
 		.flags		= 0,
 		.result		= 0
 	};
@@ -183,7 +187,8 @@ static int validate_records(struct kr_query *qry, knot_pkt_t *answer, knot_mm_t
 	return ret;
 }
 
-static int validate_keyset(struct kr_query *qry, knot_pkt_t *answer, bool has_nsec3)
+static int validate_keyset(struct kr_query *qry, knot_pkt_t *answer, bool has_nsec3,
+                           struct kr_context *ctx)
 {
 	/* Merge DNSKEY records from answer that are below/at current cut. */
 	bool updated_key = false;
@@ -221,6 +226,9 @@ static int validate_keyset(struct kr_query *qry, knot_pkt_t *answer, bool has_ns
 			.zone_name	= qry->zone_cut.name,
 			.timestamp	= qry->timestamp.tv_sec,
 			.has_nsec3	= has_nsec3,
+			.sigcache	= ctx->cache_sig,
+			.keycache	= ctx->cache_dnskey,
+			.nsec3cache	= ctx->cache_nsec3,
 			.flags		= 0,
 			.result		= 0
 		};
@@ -328,13 +336,14 @@ static int update_delegation(struct kr_request *req, struct kr_query *qry, knot_
 		} else {
 			if (!knot_wire_get_aa(answer->wire)) {
 				/* Referral, check if it is referral to unsigned, rfc5155 8.9 */
-				ret = kr_nsec3_ref_to_unsigned(answer);
+				ret = kr_nsec3_ref_to_unsigned(answer, req->ctx->cache_nsec3);
 			} else {
 				/* No-data answer, QTYPE is DS, rfc5155 8.6 */
-				ret = kr_nsec3_no_data(answer, KNOT_AUTHORITY, proved_name, KNOT_RRTYPE_DS);
+				ret = kr_nsec3_no_data(answer, KNOT_AUTHORITY, proved_name, KNOT_RRTYPE_DS,
+				                       req->ctx->cache_nsec3);
 			}
-			if (ret == kr_error(DNSSEC_NOT_FOUND)) {
-				/* Not bogus, going insecure due to optout */
+			if (ret == kr_error(DNSSEC_NOT_FOUND) || ret == kr_error(ERANGE)) {
+				/* Not bogus, going insecure due to optout or too many iterations */
 				ret = 0;
 			}
 		}
@@ -427,7 +436,7 @@ static int validate(kr_layer_t *ctx, knot_pkt_t *pkt)
 	uint16_t qtype = knot_pkt_qtype(pkt);
 	bool has_nsec3 = pkt_has_type(pkt, KNOT_RRTYPE_NSEC3);
 	if (knot_wire_get_aa(pkt->wire) && qtype == KNOT_RRTYPE_DNSKEY) {
-		ret = validate_keyset(qry, pkt, has_nsec3);
+		ret = validate_keyset(qry, pkt, has_nsec3, req->ctx);
 		if (ret != 0) {
 			DEBUG_MSG(qry, "<= bad keys, broken trust chain\n");
 			qry->flags |= QUERY_DNSSEC_BOGUS;
@@ -441,9 +450,14 @@ static int validate(kr_layer_t *ctx, knot_pkt_t *pkt)
 		if (!has_nsec3) {
 			ret = kr_nsec_name_error_response_check(pkt, KNOT_AUTHORITY, qry->sname);
 		} else {
-			ret = kr_nsec3_name_error_response_check(pkt, KNOT_AUTHORITY, qry->sname);
+			ret = kr_nsec3_name_error_response_check(pkt, KNOT_AUTHORITY, qry->sname,
+			                                         req->ctx->cache_nsec3);
 		}
-		if (ret != 0) {
+		if (has_nsec3 && (ret == kr_error(ERANGE))) {
+			DEBUG_MSG(qry, "<= NSEC3 iterations over limit, going insecure\n");
+			qry->flags &= ~QUERY_DNSSEC_WANT;
+			qry->flags |= QUERY_DNSSEC_INSECURE;
+		} else if (ret != 0) {
 			DEBUG_MSG(qry, "<= bad NXDOMAIN proof\n");
 			qry->flags |= QUERY_DNSSEC_BOGUS;
 			return KR_STATE_FAIL;
@@ -463,13 +477,18 @@ static int validate(kr_layer_t *ctx, knot_pkt_t *pkt)
 			if (!has_nsec3) {
 				ret = kr_nsec_existence_denial(pkt, KNOT_AUTHORITY, knot_pkt_qname(pkt), knot_pkt_qtype(pkt));
 			} else {
-				ret = kr_nsec3_no_data(pkt, KNOT_AUTHORITY, knot_pkt_qname(pkt), knot_pkt_qtype(pkt));
+				ret = kr_nsec3_no_data(pkt, KNOT_AUTHORITY, knot_pkt_qname(pkt), knot_pkt_qtype(pkt),
+				                       req->ctx->cache_nsec3);
 			}
 			if (ret != 0) {
 				if (has_nsec3 && (ret == kr_error(DNSSEC_NOT_FOUND))) {
 					DEBUG_MSG(qry, "<= can't prove NODATA due to optout, going insecure\n");
 					qry->flags &= ~QUERY_DNSSEC_WANT;
 					qry->flags |= QUERY_DNSSEC_INSECURE;
+				} else if (has_nsec3 && (ret == kr_error(ERANGE))) {
+					DEBUG_MSG(qry, "<= NSEC3 iterations over limit, going insecure\n");
+					qry->flags &= ~QUERY_DNSSEC_WANT;
+					qry->flags |= QUERY_DNSSEC_INSECURE;
 				} else {
 					DEBUG_MSG(qry, "<= bad NODATA proof\n");
 					qry->flags |= QUERY_DNSSEC_BOGUS;
@@ -482,7 +501,7 @@ static int validate(kr_layer_t *ctx, knot_pkt_t *pkt)
 	/* Validate all records, fail as bogus if it doesn't match.
 	 * Do not revalidate data from cache, as it's already trusted. */
 	if (!(qry->flags & QUERY_CACHED)) {
-		ret = validate_records(qry, pkt, req->rplan.pool, has_nsec3);
+		ret = validate_records(qry, pkt, req->rplan.pool, has_nsec3, req->ctx);
 		if (ret != 0) {
 			DEBUG_MSG(qry, "<= couldn't validate RRSIGs\n");
 			qry->flags |= QUERY_DNSSEC_BOGUS;
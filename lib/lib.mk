@@ -1,6 +1,9 @@
 libkres_SOURCES := \
 	lib/generic/lru.c      \
 	lib/generic/map.c      \
+	lib/generic/lpm.c      \
+	lib/generic/suffix.c   \
+	lib/generic/ruleset.c  \
 	lib/layer/iterate.c    \
 	lib/layer/validate.c   \
 	lib/layer/rrcache.c    \
@@ -23,6 +26,9 @@ libkres_HEADERS := \
 	lib/generic/array.h    \
 	lib/generic/lru.h      \
 	lib/generic/map.h      \
+	lib/generic/lpm.h      \
+	lib/generic/suffix.h   \
+	lib/generic/ruleset.h  \
 	lib/generic/set.h      \
 	lib/layer.h            \
 	lib/dnssec/nsec.h      \
@@ -80,7 +80,7 @@ static void update_nsrep_set(struct kr_nsrep *ns, const knot_dname_t *name, uint
 
 #undef ADDR_SET
 
-static unsigned eval_addr_set(pack_t *addr_set, kr_nsrep_lru_t *rttcache, unsigned score, uint8_t *addr[], uint32_t opts)
+static unsigned eval_addr_set(pack_t *addr_set, kr_nsrep_rtt_lru_t *rttcache, unsigned score, uint8_t *addr[], uint32_t opts)
 {
 	/* Name server is better candidate if it has address record. */
 	uint8_t *it = pack_head(*addr_set);
@@ -98,8 +98,8 @@ static unsigned eval_addr_set(pack_t *addr_set, kr_nsrep_lru_t *rttcache, unsign
 		}
 		/* Get RTT for this address (if known) */
 		if (is_valid) {
-			unsigned *cached = rttcache ? lru_get_try(rttcache, val, len) : NULL;
-			unsigned addr_score = (cached) ? *cached : KR_NS_GLUED;
+			struct kr_nsrep_rtt *cached = rttcache ? lru_get_try(rttcache, val, len) : NULL;
+			unsigned addr_score = (cached) ? cached->score : KR_NS_GLUED;
 			if (addr_score < score + favour) {
 				/* Shake down previous contenders */
 				for (size_t i = KR_NSREP_MAXADDR - 1; i > 0; --i)
@@ -189,11 +189,11 @@ int kr_nsrep_set(struct kr_query *qry, size_t index, uint8_t *addr, size_t addr_
 	/* Retrieve RTT from cache */
 	if (addr && addr_len > 0) {
 		struct kr_context *ctx = qry->ns.ctx;
-		unsigned *score = ctx
+		struct kr_nsrep_rtt *rtt = ctx
 			? lru_get_try(ctx->cache_rtt, (const char *)addr, addr_len)
 			: NULL;
-		if (score) {
-			qry->ns.score = MIN(qry->ns.score, *score);
+		if (rtt) {
+			qry->ns.score = MIN(qry->ns.score, rtt->score);
 		}
 	}
 	update_nsrep(&qry->ns, index, addr, addr_len, port);
@@ -240,8 +240,21 @@ int kr_nsrep_elect_addr(struct kr_query *qry, struct kr_context *ctx)
 
 #undef ELECT_INIT
 
+/** Update SRTT and RTTVAR estimate with a measured RTT (RFC 6298, 2.2 and 2.3). */
+static void update_rtt_estimate(struct kr_nsrep_rtt *rtt, unsigned sample)
+{
+	if (rtt->srtt == 0) {
+		rtt->srtt = sample;
+		rtt->rttvar = sample / 2;
+	} else {
+		unsigned delta = (rtt->srtt > sample) ? rtt->srtt - sample : sample - rtt->srtt;
+		rtt->rttvar = (3 * rtt->rttvar + delta) / 4;
+		rtt->srtt = (7 * rtt->srtt + sample) / 8;
+	}
+}
+
 int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
-			unsigned score, kr_nsrep_lru_t *cache, int umode)
+			unsigned score, kr_nsrep_rtt_lru_t *cache, int umode)
 {
 	if (!ns || !cache || ns->addr[0].ip.sa_family == AF_UNSPEC) {
 		return kr_error(EINVAL);
@@ -258,7 +271,7 @@ int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
 			addr_len = sizeof(struct in6_addr);
 		}
 	}
-	unsigned *cur = lru_get_new(cache, addr_in, addr_len);
+	struct kr_nsrep_rtt *cur = lru_get_new(cache, addr_in, addr_len);
 	if (!cur) {
 		return kr_ok();
 	}
@@ -269,21 +282,46 @@ int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
 	if (score <= KR_NS_GLUED) {
 		score = KR_NS_GLUED + 1;
 	}
+	/* Measured RTT updates the estimate, timeout backs off the RTO twice (RFC 6298, 5.5). */
+	if (umode == KR_NS_UPDATE) {
+		if (score < KR_NS_TIMEOUT) {
+			update_rtt_estimate(cur, score);
+		} else if (cur->srtt > 0) {
+			cur->rttvar = MIN(KR_CONN_RTT_MAX, 2 * cur->rttvar + cur->srtt / 4);
+		}
+	}
 	/* First update is always set. */
-	if (*cur == 0) {
+	if (cur->score == 0) {
 		umode = KR_NS_RESET;
 	}
 	/* Update score, by default smooth over last two measurements. */
 	switch (umode) {
-	case KR_NS_UPDATE: *cur = (*cur + score) / 2; break;
-	case KR_NS_RESET:  *cur = score; break;
-	case KR_NS_ADD:    *cur = MIN(KR_NS_MAX_SCORE - 1, *cur + score); break;
-	case KR_NS_MAX:    *cur = MAX(*cur, score); break;
+	case KR_NS_UPDATE: cur->score = (cur->score + score) / 2; break;
+	case KR_NS_RESET:  cur->score = score; break;
+	case KR_NS_ADD:    cur->score = MIN(KR_NS_MAX_SCORE - 1, cur->score + score); break;
+	case KR_NS_MAX:    cur->score = MAX(cur->score, score); break;
 	default: break;
 	}
 	return kr_ok();
 }
 
+unsigned kr_nsrep_rto(kr_nsrep_rtt_lru_t *cache, const struct sockaddr *addr)
+{
+	if (!cache || !addr) {
+		return KR_CONN_RETRY;
+	}
+	int addr_len = kr_inaddr_len(addr);
+	if (addr_len <= 0) {
+		return KR_CONN_RETRY;
+	}
+	struct kr_nsrep_rtt *rtt = lru_get_try(cache, kr_inaddr(addr), addr_len);
+	if (!rtt || rtt->srtt == 0) {
+		return KR_CONN_RETRY;
+	}
+	unsigned rto = rtt->srtt + 4 * rtt->rttvar;
+	return MIN(MAX(rto, KR_CONN_RTO_MIN), KR_CONN_RTT_MAX);
+}
+
 int kr_nsrep_update_rep(struct kr_nsrep *ns, unsigned reputation, kr_nsrep_lru_t *cache)
 {
 	if (!ns || !cache ) {
@@ -299,3 +337,168 @@ int kr_nsrep_update_rep(struct kr_nsrep *ns, unsigned reputation, kr_nsrep_lru_t
 	}
 	return kr_ok();
 }
+
+/*
+ * Saved tables are serialized as { u32 length, { u8 key_len, key, value }* },
+ * each table is a single cache entry under the root name.
+ */
+
+enum {
+	NSREP_SAVE_RTT = 1,
+	NSREP_SAVE_REP = 2
+};
+
+struct nsrep_save_baton {
+	char *buf;
+	size_t len;
+	size_t cap;
+	size_t count;
+	size_t val_len;
+	int ret;
+};
+
+static enum lru_apply_do save_entry(const char *key, uint len, void *val, void *baton)
+{
+	struct nsrep_save_baton *save = baton;
+	if (save->ret != 0 || len > UINT8_MAX) {
+		return LRU_APPLY_DO_NOTHING;
+	}
+	size_t want = save->len + 1 + len + save->val_len;
+	if (kr_memreserve(NULL, &save->buf, 1, want, &save->cap) != 0) {
+		save->ret = kr_error(ENOMEM);
+		return LRU_APPLY_DO_NOTHING;
+	}
+	char *dst = save->buf + save->len;
+	dst[0] = len;
+	memcpy(dst + 1, key, len);
+	memcpy(dst + 1 + len, val, save->val_len);
+	save->len = want;
+	save->count += 1;
+	return LRU_APPLY_DO_NOTHING;
+}
+
+static enum lru_apply_do save_rtt(const char *key, uint len, struct kr_nsrep_rtt *val, void *baton)
+{
+	/* Timeouted servers would be cleaned up anyway. */
+	if (val->score > KR_NS_LONG) {
+		return LRU_APPLY_DO_NOTHING;
+	}
+	return save_entry(key, len, val, baton);
+}
+
+static enum lru_apply_do save_rep(const char *key, uint len, unsigned *val, void *baton)
+{
+	return save_entry(key, len, val, baton);
+}
+
+static int save_commit(struct kr_cache *cache, uint16_t type, struct nsrep_save_baton *save, uint32_t timestamp)
+{
+	if (save->ret != 0 || save->count == 0) {
+		return save->ret;
+	}
+	struct kr_cache_entry header = {
+		.timestamp = timestamp,
+		.ttl = KR_NSREP_SAVE_TTL,
+		.count = MIN(save->count, UINT16_MAX),
+	};
+	uint32_t len = save->len - sizeof(len);
+	memcpy(save->buf, &len, sizeof(len));
+	knot_db_val_t data = { save->buf, save->len };
+	return kr_cache_insert(cache, KR_CACHE_INFRA, (const knot_dname_t *)"", type, &header, data);
+}
+
+int kr_nsrep_save(struct kr_context *ctx, uint32_t timestamp)
+{
+	if (!ctx || !kr_cache_is_open(&ctx->cache)) {
+		return kr_error(EINVAL);
+	}
+	int ret = 0;
+	if (ctx->cache_rtt) {
+		struct nsrep_save_baton save = { .len = sizeof(uint32_t), .val_len = sizeof(struct kr_nsrep_rtt) };
+		lru_apply(ctx->cache_rtt, save_rtt, &save);
+		ret = save_commit(&ctx->cache, NSREP_SAVE_RTT, &save, timestamp);
+		free(save.buf);
+	}
+	if (ret == 0 && ctx->cache_rep) {
+		struct nsrep_save_baton save = { .len = sizeof(uint32_t), .val_len = sizeof(unsigned) };
+		lru_apply(ctx->cache_rep, save_rep, &save);
+		ret = save_commit(&ctx->cache, NSREP_SAVE_REP, &save, timestamp);
+		free(save.buf);
+	}
+	return ret;
+}
+
+/** Fetch saved table, the data is copied as it's going to be inserted into LRU. */
+static int load_fetch(struct kr_cache *cache, uint16_t type, uint32_t *timestamp, knot_db_val_t *data)
+{
+	struct kr_cache_entry *entry = NULL;
+	size_t size = 0;
+	int ret = kr_cache_peek(cache, KR_CACHE_INFRA, (const knot_dname_t *)"", type, &entry, &size, timestamp);
+	if (ret != 0) {
+		return ret;
+	}
+	uint32_t len = 0;
+	if (size < sizeof(len)) {
+		return kr_error(EILSEQ);
+	}
+	memcpy(&len, entry->data, sizeof(len));
+	if (len > size - sizeof(len)) {
+		return kr_error(EILSEQ);
+	}
+	data->data = malloc(len);
+	if (!data->data) {
+		return kr_error(ENOMEM);
+	}
+	memcpy(data->data, entry->data + sizeof(len), len);
+	data->len = len;
+	return kr_ok();
+}
+
+/** @internal Check that the saved record (key length, key and value) fits in the data. */
+static bool load_record_valid(const uint8_t *it, const uint8_t *end, size_t val_len)
+{
+	return it < end && (size_t)(end - it) >= 1 + (size_t)it[0] + val_len;
+}
+
+int kr_nsrep_load(struct kr_context *ctx, uint32_t timestamp)
+{
+	if (!ctx || !kr_cache_is_open(&ctx->cache)) {
+		return kr_error(EINVAL);
+	}
+	int count = 0;
+	knot_db_val_t data = { NULL, 0 };
+	/* RTT table, widen the variation of an aged estimate as the RTT may have changed since. */
+	uint32_t drift = timestamp;
+	if (ctx->cache_rtt && load_fetch(&ctx->cache, NSREP_SAVE_RTT, &drift, &data) == 0) {
+		const uint8_t *it = data.data, *end = it + data.len;
+		while (load_record_valid(it, end, sizeof(struct kr_nsrep_rtt))) {
+			struct kr_nsrep_rtt rtt;
+			memcpy(&rtt, it + 1 + it[0], sizeof(rtt));
+			if (drift >= KR_NSREP_SAVE_AGED) {
+				rtt.rttvar = MAX(rtt.rttvar, rtt.srtt / 2);
+			}
+			struct kr_nsrep_rtt *cur = lru_get_new(ctx->cache_rtt, (const char *)it + 1, it[0]);
+			if (cur && cur->score == 0) {
+				*cur = rtt;
+				count += 1;
+			}
+			it += 1 + it[0] + sizeof(rtt);
+		}
+		free(data.data);
+	}
+	/* Reputation table */
+	drift = timestamp;
+	if (ctx->cache_rep && load_fetch(&ctx->cache, NSREP_SAVE_REP, &drift, &data) == 0) {
+		const uint8_t *it = data.data, *end = it + data.len;
+		while (load_record_valid(it, end, sizeof(unsigned))) {
+			unsigned *cur = lru_get_new(ctx->cache_rep, (const char *)it + 1, it[0]);
+			if (cur && *cur == 0) {
+				memcpy(cur, it + 1 + it[0], sizeof(*cur));
+				count += 1;
+			}
+			it += 1 + it[0] + sizeof(unsigned);
+		}
+		free(data.data);
+	}
+	return count;
+}
@@ -26,6 +26,7 @@
 #include "lib/generic/lru.h"
 
 struct kr_query;
+struct kr_context;
 
 /** 
   * NS RTT score (special values).
@@ -64,6 +65,27 @@ enum kr_ns_update_mode {
  */
 typedef lru_t(unsigned) kr_nsrep_lru_t;
 
+/**
+ * NS address RTT information.
+ * @note The score is used for NS election and includes penalties,
+ *       SRTT and RTTVAR are smoothed over measured RTTs only (:rfc:`6298`).
+ */
+struct kr_nsrep_rtt {
+	unsigned score;  /**< NS score, see enum kr_ns_score */
+	unsigned srtt;   /**< Smoothed RTT (0 if unknown) */
+	unsigned rttvar; /**< RTT variation */
+};
+
+/**
+ * NS address RTT tracking.
+ */
+typedef lru_t(struct kr_nsrep_rtt) kr_nsrep_rtt_lru_t;
+
+/* Lifetime of the saved NS RTT and reputation tables (seconds) */
+#define KR_NSREP_SAVE_TTL 3600
+/* Age of the saved RTT estimate when its variation is reset (seconds) */
+#define KR_NSREP_SAVE_AGED 300
+
 /* Maximum count of addresses probed in one go (last is left empty) */
 #define KR_NSREP_MAXADDR 4
 
@@ -125,7 +147,8 @@ int kr_nsrep_elect_addr(struct kr_query *qry, struct kr_context *ctx);
 /**
  * Update NS address RTT information.
  *
- * @brief In KR_NS_UPDATE mode reputation is smoothed over last N measurements.
+ * @brief In KR_NS_UPDATE mode reputation is smoothed over last N measurements,
+ *        the score is also a RTT sample for the SRTT/RTTVAR estimate (or a timeout).
  * 
  * @param  ns           updated NS representation
  * @param  addr         chosen address (NULL for first)
@@ -136,7 +159,17 @@ int kr_nsrep_elect_addr(struct kr_query *qry, struct kr_context *ctx);
  */
 KR_EXPORT
 int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
-			unsigned score, kr_nsrep_lru_t *cache, int umode);
+			unsigned score, kr_nsrep_rtt_lru_t *cache, int umode);
+
+/**
+ * Retransmission timeout for the address (:rfc:`6298`), i.e. SRTT + 4 * RTTVAR.
+ *
+ * @param  cache        LRU cache
+ * @param  addr         server address
+ * @return              timeout in milliseconds, KR_CONN_RETRY if the RTT is unknown
+ */
+KR_EXPORT
+unsigned kr_nsrep_rto(kr_nsrep_rtt_lru_t *cache, const struct sockaddr *addr);
 
 /**
  * Update NSSET reputation information.
@@ -148,3 +181,25 @@ int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
  */
 KR_EXPORT
 int kr_nsrep_update_rep(struct kr_nsrep *ns, unsigned reputation, kr_nsrep_lru_t *cache);
+
+/**
+ * Save NS RTT and reputation tables into the cache (KR_CACHE_INFRA namespace).
+ *
+ * @param  ctx          resolution context
+ * @param  timestamp    current time
+ * @return              0 on success, error code on failure
+ */
+KR_EXPORT
+int kr_nsrep_save(struct kr_context *ctx, uint32_t timestamp);
+
+/**
+ * Load NS RTT and reputation tables saved by kr_nsrep_save().
+ *
+ * @note Entries with bad score are skipped and RTT variation of an older snapshot is widened,
+ *       snapshots older than KR_NSREP_SAVE_TTL are ignored.
+ * @param  ctx          resolution context
+ * @param  timestamp    current time
+ * @return              number of loaded entries or an error code
+ */
+KR_EXPORT
+int kr_nsrep_load(struct kr_context *ctx, uint32_t timestamp);
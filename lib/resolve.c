@@ -41,7 +41,7 @@
  * @internal Defer execution of current query.
  * The current layer state and input will be pushed to a stack and resumed on next iteration.
  */
-static int consume_yield(kr_layer_t *ctx, knot_pkt_t *pkt)
+static int consume_yield(kr_layer_t *ctx, size_t id, knot_pkt_t *pkt)
 {
 	struct kr_request *req = ctx->req;
 	knot_pkt_t *pkt_copy = knot_pkt_new(NULL, pkt->size, &req->pool);
@@ -51,31 +51,28 @@ static int consume_yield(kr_layer_t *ctx, knot_pkt_t *pkt)
 		pickle->api = ctx->api;
 		pickle->state = ctx->state;
 		pickle->pkt = pkt_copy;
+		pickle->id = id;
 		pickle->next = qry->deferred;
 		qry->deferred = pickle;
 		return kr_ok();
 	}
 	return kr_error(ENOMEM);
 }
-static int begin_yield(kr_layer_t *ctx) { return kr_ok(); }
-static int reset_yield(kr_layer_t *ctx) { return kr_ok(); }
-static int finish_yield(kr_layer_t *ctx) { return kr_ok(); }
-static int produce_yield(kr_layer_t *ctx, knot_pkt_t *pkt) { return kr_ok(); }
+static int begin_yield(kr_layer_t *ctx, size_t id) { return kr_ok(); }
+static int reset_yield(kr_layer_t *ctx, size_t id) { return kr_ok(); }
+static int finish_yield(kr_layer_t *ctx, size_t id) { return kr_ok(); }
+static int produce_yield(kr_layer_t *ctx, size_t id, knot_pkt_t *pkt) { return kr_ok(); }
+static int timeout_yield(kr_layer_t *ctx, size_t id, const struct sockaddr *addr) { return kr_ok(); }
 
 /** @internal Macro for iterating module layers. */
 #define RESUME_LAYERS(from, r, qry, func, ...) \
     (r)->current_query = (qry); \
-	for (size_t i = (from); i < (r)->ctx->modules->len; ++i) { \
-		struct kr_module *mod = (r)->ctx->modules->at[i]; \
-		if (mod->layer) { \
-			struct kr_layer layer = {.state = (r)->state, .api = mod->layer(mod), .req = (r)}; \
-			if (layer.api && layer.api->func) { \
-				(r)->state = layer.api->func(&layer, ##__VA_ARGS__); \
-				if ((r)->state == KR_STATE_YIELD) { \
-					func ## _yield(&layer, ##__VA_ARGS__); \
-					break; \
-				} \
-			} \
+	for (size_t i = (from); i < (r)->ctx->layers.func.len; ++i) { \
+		struct kr_layer layer = {.state = (r)->state, .api = (r)->ctx->layers.func.at[i], .req = (r)}; \
+		(r)->state = layer.api->func(&layer, ##__VA_ARGS__); \
+		if ((r)->state == KR_STATE_YIELD) { \
+			func ## _yield(&layer, i, ##__VA_ARGS__); \
+			break; \
 		} \
 	} /* Invalidate current query. */ \
 	(r)->current_query = NULL
@@ -83,18 +80,57 @@ static int produce_yield(kr_layer_t *ctx, knot_pkt_t *pkt) { return kr_ok(); }
 /** @internal Macro for starting module iteration. */
 #define ITERATE_LAYERS(req, qry, func, ...) RESUME_LAYERS(0, req, qry, func, ##__VA_ARGS__)
 
-/** @internal Find layer id matching API. */
-static inline size_t layer_id(struct kr_request *req, const struct kr_layer_api *api) {
-	module_array_t *modules = req->ctx->modules;
-	for (size_t i = 0; i < modules->len; ++i) {
-		struct kr_module *mod = modules->at[i];
-		if (mod->layer && mod->layer(mod) == api) {
+/** @internal Find layer id of the pickled layer.
+ * The stored position is used unless the layers changed since it was yielded. */
+static inline size_t layer_id(struct kr_request *req, const struct kr_layer_pickle *pickle) {
+	layer_array_t *layers = &req->ctx->layers.consume;
+	if (pickle->id < layers->len && layers->at[pickle->id] == pickle->api) {
+		return pickle->id;
+	}
+	for (size_t i = 0; i < layers->len; ++i) {
+		if (layers->at[i] == pickle->api) {
 			return i;
 		}
 	}
 	return 0; /* Not found, try all. */
 }
 
+/** @internal Append layer to the hook table if it implements the hook. */
+#define LAYER_HOOK_PUSH(hooks, api, func) \
+	if ((api)->func && array_push((hooks)->func, (api)) < 0) { \
+		return kr_error(ENOMEM); \
+	}
+
+int kr_resolve_layers(struct kr_context *ctx)
+{
+	if (!ctx) {
+		return kr_error(EINVAL);
+	}
+	struct kr_layer_hooks *hooks = &ctx->layers;
+	array_clear(hooks->begin);
+	array_clear(hooks->reset);
+	array_clear(hooks->finish);
+	array_clear(hooks->consume);
+	array_clear(hooks->produce);
+	array_clear(hooks->timeout);
+	for (size_t i = 0; ctx->modules && i < ctx->modules->len; ++i) {
+		struct kr_module *mod = ctx->modules->at[i];
+		const struct kr_layer_api *api = mod->layer ? mod->layer(mod) : NULL;
+		if (!api) {
+			continue;
+		}
+		LAYER_HOOK_PUSH(hooks, api, begin);
+		LAYER_HOOK_PUSH(hooks, api, reset);
+		LAYER_HOOK_PUSH(hooks, api, finish);
+		LAYER_HOOK_PUSH(hooks, api, consume);
+		LAYER_HOOK_PUSH(hooks, api, produce);
+		LAYER_HOOK_PUSH(hooks, api, timeout);
+	}
+	return kr_ok();
+}
+
+#undef LAYER_HOOK_PUSH
+
 /* @internal We don't need to deal with locale here */
 KR_CONST static inline bool isletter(unsigned chr)
 { return (chr | 0x20 /* tolower */) - 'a' <= 'z' - 'a'; }
@@ -152,7 +188,7 @@ static void check_empty_nonterms(struct kr_query *qry, knot_pkt_t *pkt, struct k
 		--labels;
 	}
 	for (int i = 0; i < labels; ++i) {
-		int ret = kr_cache_peek(cache, KR_CACHE_PKT, target, KNOT_RRTYPE_NS, &entry, &timestamp);
+		int ret = kr_cache_peek(cache, KR_CACHE_PKT, target, KNOT_RRTYPE_NS, &entry, NULL, &timestamp);
 		if (ret == 0) { /* Either NXDOMAIN or NODATA, start here. */
 			/* @todo We could stop resolution here for NXDOMAIN, but we can't because of broken CDNs */
 			qry->flags |= QUERY_NO_MINIMIZE;
@@ -430,6 +466,7 @@ int kr_resolve_begin(struct kr_request *request, struct kr_context *ctx, knot_pk
 	request->options = ctx->options;
 	request->state = KR_STATE_CONSUME;
 	request->current_query = NULL;
+	request->begin_time = kr_now_usec();
 	array_init(request->authority);
 	array_init(request->additional);
 
@@ -495,6 +532,34 @@ KR_PURE static bool kr_inaddr_equal(const struct sockaddr *a, const struct socka
 	return a_len == b_len && memcmp(kr_inaddr(a), kr_inaddr(b), a_len) == 0;
 }
 
+/** @internal Find the address in the NS address list, return its index or -1. */
+static int ns_addr_index(const struct kr_query *qry, const struct sockaddr *addr)
+{
+	for (size_t i = 0; i < KR_NSREP_MAXADDR; ++i) {
+		const struct sockaddr *ns_addr = &qry->ns.addr[i].ip;
+		if (ns_addr->sa_family == AF_UNSPEC) {
+			break;
+		}
+		if (kr_inaddr_equal(addr, ns_addr)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/** @internal Time since the address was first sent to (msec),
+ *  or since the query was generated if it wasn't sent to. */
+static unsigned ns_addr_elapsed(struct kr_query *qry, const struct sockaddr *addr)
+{
+	int i = addr ? ns_addr_index(qry, addr) : -1;
+	if (i < 0 || qry->sent_count[i] == 0) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		return time_diff(&qry->timestamp, &now);
+	}
+	return (kr_now_usec() - qry->sent_time[i]) / 1000;
+}
+
 static void update_nslist_rtt(struct kr_context *ctx, struct kr_query *qry, const struct sockaddr *src)
 {
 	/* Do not track in safe mode. */
@@ -502,24 +567,26 @@ static void update_nslist_rtt(struct kr_context *ctx, struct kr_query *qry, cons
 		return;
 	}
 
-	/* Calculate total resolution time from the time the query was generated. */
-	struct timeval now;
-	gettimeofday(&now, NULL);
-	unsigned elapsed = time_diff(&qry->timestamp, &now);
-
-	/* NSs in the preference list prior to the one who responded will be penalised
-	 * with the RETRY timer interval. This is because we know they didn't respond
-	 * for N retries, so their RTT must be at least N * RETRY.
-	 * The NS in the preference list that responded will have RTT relative to the
-	 * time when the query was sent out, not when it was originated.
+	/* The worker moves on to the next address after the RTO of the previous one,
+	 * so the RTT of each tried address is relative to the time it was sent to.
 	 */
+	const uint64_t now = kr_now_usec();
 	for (size_t i = 0; i < KR_NSREP_MAXADDR; ++i) {
 		const struct sockaddr *addr = &qry->ns.addr[i].ip;
 		if (addr->sa_family == AF_UNSPEC) {
 			break;
 		}
-		/* If this address is the source of the answer, update its RTT */
+		if (qry->sent_count[i] == 0) {
+			continue; /* Not tried */
+		}
+		unsigned elapsed = (now - qry->sent_time[i]) / 1000;
+		/* If this address is the source of the answer, update its RTT.
+		 * The answer to a retransmitted query may belong to any of the transmissions,
+		 * so such sample is ambiguous and the estimate is left alone (Karn's algorithm). */
 		if (kr_inaddr_equal(src, addr)) {
+			if (qry->sent_count[i] > 1) {
+				continue;
+			}
 			kr_nsrep_update_rtt(&qry->ns, addr, elapsed, ctx->cache_rtt, KR_NS_UPDATE);
 			WITH_DEBUG {
 				char addr_str[INET6_ADDRSTRLEN];
@@ -528,22 +595,15 @@ static void update_nslist_rtt(struct kr_context *ctx, struct kr_query *qry, cons
 			}
 		} else {
 			/* Response didn't come from this IP, but we know the RTT must be at least
-			 * several RETRY timer tries, e.g. if we have addresses [a, b, c] and we have
-			 * tried [a, b] when the answer from 'a' came after 350ms, then we know
-			 * that 'b' didn't respond for at least 350 - (1 * 300) ms. We can't say that
-			 * its RTT is 50ms, but we can say that its score shouldn't be less than 50. */
-			 kr_nsrep_update_rtt(&qry->ns, addr, elapsed, ctx->cache_rtt, KR_NS_MAX);
-			 WITH_DEBUG {
-			 	char addr_str[INET6_ADDRSTRLEN];
-			 	inet_ntop(addr->sa_family, kr_inaddr(addr), addr_str, sizeof(addr_str));
-			 	DEBUG_MSG(qry, "<= server: '%s' rtt: >=%ld ms\n", addr_str, elapsed);
-			 }
-		}
-		/* Subtract query start time from elapsed time */
-		if (elapsed < KR_CONN_RETRY) {
-			break;
+			 * the time since it was sent to. We can't say what its RTT is, but we can say
+			 * that its score shouldn't be less than that. */
+			kr_nsrep_update_rtt(&qry->ns, addr, elapsed, ctx->cache_rtt, KR_NS_MAX);
+			WITH_DEBUG {
+				char addr_str[INET6_ADDRSTRLEN];
+				inet_ntop(addr->sa_family, kr_inaddr(addr), addr_str, sizeof(addr_str));
+				DEBUG_MSG(qry, "<= server: '%s' rtt: >=%ld ms\n", addr_str, elapsed);
+			}
 		}
-		elapsed = elapsed - KR_CONN_RETRY;
 	}
 }
 
@@ -603,10 +663,8 @@ int kr_resolve_consume(struct kr_request *request, const struct sockaddr *src, k
 		if (qry->flags & QUERY_CACHED) {
 			ITERATE_LAYERS(request, qry, consume, packet);
 		} else {
-			struct timeval now;
-			gettimeofday(&now, NULL);
 			/* Fill in source and latency information. */
-			request->upstream.rtt = time_diff(&qry->timestamp, &now);
+			request->upstream.rtt = ns_addr_elapsed(qry, src);
 			request->upstream.addr = src;
 			ITERATE_LAYERS(request, qry, consume, packet);
 			/* Clear temporary information */
@@ -646,6 +704,21 @@ int kr_resolve_consume(struct kr_request *request, const struct sockaddr *src, k
 	return kr_rplan_empty(&request->rplan) ? KR_STATE_DONE : KR_STATE_PRODUCE;
 }
 
+void kr_resolve_timeout(struct kr_request *request, const struct sockaddr *addr)
+{
+	struct kr_rplan *rplan = &request->rplan;
+	if (!addr || addr->sa_family == AF_UNSPEC || kr_rplan_empty(rplan)) {
+		return;
+	}
+	struct kr_query *qry = array_tail(rplan->pending);
+	if (qry->flags & QUERY_CACHED) {
+		return;
+	}
+	int state = request->state;
+	ITERATE_LAYERS(request, qry, timeout, addr);
+	request->state = state;
+}
+
 /** @internal Spawn subrequest in current zone cut (no minimization or lookup). */
 static struct kr_query *zone_cut_subreq(struct kr_rplan *rplan, struct kr_query *parent,
                            const knot_dname_t *qname, uint16_t qtype)
@@ -791,7 +864,7 @@ int kr_resolve_produce(struct kr_request *request, struct sockaddr **dst, int *t
 		DEBUG_MSG(qry, "=> resuming yielded answer\n");
 		struct kr_layer_pickle *pickle = qry->deferred;
 		request->state = KR_STATE_YIELD;
-		RESUME_LAYERS(layer_id(request, pickle->api), request, qry, consume, pickle->pkt);
+		RESUME_LAYERS(layer_id(request, pickle), request, qry, consume, pickle->pkt);
 		qry->deferred = pickle->next;
 	} else {
 		/* Caller is interested in always tracking a zone cut, even if the answer is cached
@@ -893,6 +966,8 @@ ns_election:
 	 */
 
 	gettimeofday(&qry->timestamp, NULL);
+	memset(qry->sent_time, 0, sizeof(qry->sent_time));
+	memset(qry->sent_count, 0, sizeof(qry->sent_count));
 	*dst = &qry->ns.addr[0].ip;
 	*type = (qry->flags & QUERY_TCP) ? SOCK_STREAM : SOCK_DGRAM;
 	return request->state;
@@ -966,6 +1041,17 @@ int kr_resolve_checkout(struct kr_request *request, struct sockaddr *src,
 		return kr_error(EINVAL);
 	}
 
+	/* Remember when the address was sent to first and whether it's a retransmission. */
+	int addr_index = dst ? ns_addr_index(qry, dst) : -1;
+	if (addr_index >= 0) {
+		if (qry->sent_count[addr_index] == 0) {
+			qry->sent_time[addr_index] = kr_now_usec();
+		}
+		if (qry->sent_count[addr_index] < UINT8_MAX) {
+			qry->sent_count[addr_index] += 1;
+		}
+	}
+
 	WITH_DEBUG {
 	char qname_str[KNOT_DNAME_MAXLEN], zonecut_str[KNOT_DNAME_MAXLEN], ns_str[INET6_ADDRSTRLEN], type_str[16];
 	knot_dname_to_str(qname_str, knot_pkt_qname(packet), sizeof(qname_str));
@@ -74,8 +74,23 @@
 
 /** @cond internal Array of modules. */
 typedef array_t(struct kr_module *) module_array_t;
+/** Array of layers. */
+typedef array_t(const struct kr_layer_api *) layer_array_t;
 /* @endcond */
 
+/**
+ * Layers of loaded modules per hook, in the module order.
+ * Only layers implementing the hook are present, see kr_resolve_layers().
+ */
+struct kr_layer_hooks {
+	layer_array_t begin;
+	layer_array_t reset;
+	layer_array_t finish;
+	layer_array_t consume;
+	layer_array_t produce;
+	layer_array_t timeout;
+};
+
 /**
  * Name resolution context.
  *
@@ -92,9 +107,14 @@ struct kr_context
 	map_t negative_anchors;
 	struct kr_zonecut root_hints;
 	struct kr_cache cache;
-	kr_nsrep_lru_t *cache_rtt;
+	kr_nsrep_rtt_lru_t *cache_rtt;
 	kr_nsrep_lru_t *cache_rep;
+	struct kr_zonecut_cache *cache_cut;
+	struct kr_sigcache *cache_sig;
+	struct kr_keycache *cache_dnskey;
+	struct kr_nsec3_cache *cache_nsec3;
 	module_array_t *modules;
+	struct kr_layer_hooks layers;
 	/* The cookie context structure should not be held within the cookies
 	 * module because of better access. */
 	struct kr_cookie_ctx cookie_ctx;
@@ -122,6 +142,7 @@ struct kr_request {
         const struct sockaddr *dst_addr;
         const knot_pkt_t *packet;
         const knot_rrset_t *opt;
+        bool tcp;                      /**< Query received over TCP (or TLS) */
     } qsource;
     struct {
         unsigned rtt;                  /**< Current upstream RTT */
@@ -133,8 +154,19 @@ struct kr_request {
     rr_array_t additional;
     struct kr_rplan rplan;
     knot_mm_t pool;
+    uint64_t begin_time;               /**< Monotonic time of the resolution start, see kr_now_usec() */
 };
 
+/**
+ * Rebuild per-hook layer tables from the list of modules.
+ *
+ * @note Call it whenever the list of modules or their order changes.
+ * @param ctx resolution context
+ * @return 0 or an error code
+ */
+KR_EXPORT
+int kr_resolve_layers(struct kr_context *ctx);
+
 /**
  * Begin name resolution.
  *
@@ -162,6 +194,19 @@ int kr_resolve_begin(struct kr_request *request, struct kr_context *ctx, knot_pk
 KR_EXPORT
 int kr_resolve_consume(struct kr_request *request, const struct sockaddr *src, knot_pkt_t *packet);
 
+/**
+ * Let layers observe that the query sent to the address wasn't answered in time.
+ *
+ * @note Call it for each address the current query was actually sent to, before
+ *       the timeout is passed to kr_resolve_consume() as an empty packet.
+ *       It doesn't change the request state.
+ *
+ * @param  request request state (awaiting answer)
+ * @param  addr    address the query was sent to
+ */
+KR_EXPORT
+void kr_resolve_timeout(struct kr_request *request, const struct sockaddr *addr);
+
 /**
  * Produce either next additional query or finish.
  *
@@ -49,7 +49,8 @@
 	X(STRICT,          1 << 21) /**< Strict resolver mode. */ \
 	X(BADCOOKIE_AGAIN, 1 << 22) /**< Query again because bad cookie returned. */ \
 	X(CNAME,	   1 << 23) /**< Query response contains CNAME in answer section. */ \
-	X(REORDER_RR,      1 << 24) /**< Reorder cached RRs. */
+	X(REORDER_RR,      1 << 24) /**< Reorder cached RRs. */ \
+	X(DNS64_MARK,      1 << 25) /**< Internal mark for DNS64 A sub-query. */
 
 /** Query flags */
 enum kr_query_flag {
@@ -79,6 +80,9 @@ struct kr_query {
 	struct kr_zonecut zone_cut;
 	struct kr_nsrep ns;
 	struct kr_layer_pickle *deferred;
+	uint64_t sent_time[KR_NSREP_MAXADDR]; /**< Monotonic time of the first send to ns.addr[i] (usec). */
+	uint8_t sent_count[KR_NSREP_MAXADDR]; /**< Number of sends to ns.addr[i], see kr_resolve_checkout() */
+	uint32_t expiring_ttl; /**< Remaining TTL of the expiring cached records, valid with QUERY_EXPIRING. */
 };
 
 /** @cond internal Array of queries. */
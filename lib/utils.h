@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <libknot/packet/pkt.h>
 #include "lib/generic/map.h"
@@ -80,6 +81,13 @@ static inline long time_diff(struct timeval *begin, struct timeval *end) {
     return res.tv_sec * 1000 + res.tv_usec / 1000;
 }
 
+/** Return monotonic time in microseconds, use it for measuring intervals. */
+static inline uint64_t kr_now_usec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
 /** @cond internal Array types */
 struct kr_context;
 typedef array_t(knot_rrset_t *) rr_array_t;
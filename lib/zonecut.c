@@ -26,6 +26,7 @@
 #include "lib/layer.h"
 #include "lib/resolve.h"
 #include "lib/generic/pack.h"
+#include "contrib/murmurhash3/murmurhash3.h"
 
 /* Root hint descriptor. */
 struct hint_info {
@@ -308,8 +309,21 @@ int kr_zonecut_set_sbelt(struct kr_context *ctx, struct kr_zonecut *cut)
 	return ret;
 }
 
+/** Lower the TTL bound to the smallest TTL in the (materialized) RRSet. */
+static void ttl_bound(uint32_t *ttl, const knot_rrset_t *rr)
+{
+	knot_rdata_t *rd = rr->rrs.data;
+	for (uint16_t i = 0; i < rr->rrs.rr_count; ++i) {
+		if (knot_rdata_ttl(rd) < *ttl) {
+			*ttl = knot_rdata_ttl(rd);
+		}
+		rd = kr_rdataset_next(rd);
+	}
+}
+
 /** Fetch address for zone cut. */
-static void fetch_addr(struct kr_zonecut *cut, struct kr_cache *cache, const knot_dname_t *ns, uint16_t rrtype, uint32_t timestamp)
+static void fetch_addr(struct kr_zonecut *cut, struct kr_cache *cache, const knot_dname_t *ns, uint16_t rrtype,
+                       uint32_t timestamp, uint32_t *ttl)
 {
 	uint8_t rank = 0;
 	knot_rrset_t cached_rr;
@@ -322,13 +336,17 @@ static void fetch_addr(struct kr_zonecut *cut, struct kr_cache *cache, const kno
 	for (uint16_t i = 0; i < cached_rr.rrs.rr_count; ++i) {
 		if (knot_rdata_ttl(rd) > timestamp) {
 			(void) kr_zonecut_add(cut, ns, rd);
+			if (knot_rdata_ttl(rd) - timestamp < *ttl) {
+				*ttl = knot_rdata_ttl(rd) - timestamp;
+			}
 		}
 		rd = kr_rdataset_next(rd);
 	}
 }
 
 /** Fetch best NS for zone cut. */
-static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut, const knot_dname_t *name, uint32_t timestamp, uint8_t * restrict rank)
+static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut, const knot_dname_t *name, uint32_t timestamp,
+                    uint8_t * restrict rank, uint32_t *ttl)
 {
 	uint32_t drift = timestamp;
 	knot_rrset_t cached_rr;
@@ -344,6 +362,7 @@ static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut, const knot_d
 	if (ret != 0) {
 		return ret;
 	}
+	ttl_bound(ttl, &rr_copy);
 
 	/* Insert name servers for this zone cut, addresses will be looked up
 	 * on-demand (either from cache or iteratively) */
@@ -355,10 +374,10 @@ static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut, const knot_d
 				(const char *)ns_name, knot_dname_size(ns_name));
 		unsigned reputation = (cached) ? *cached : 0;
 		if (!(reputation & KR_NS_NOIP4) && !(ctx->options & QUERY_NO_IPV4)) {
-			fetch_addr(cut, &ctx->cache, ns_name, KNOT_RRTYPE_A, timestamp);
+			fetch_addr(cut, &ctx->cache, ns_name, KNOT_RRTYPE_A, timestamp, ttl);
 		}
 		if (!(reputation & KR_NS_NOIP6) && !(ctx->options & QUERY_NO_IPV6)) {
-			fetch_addr(cut,  &ctx->cache, ns_name, KNOT_RRTYPE_AAAA, timestamp);
+			fetch_addr(cut,  &ctx->cache, ns_name, KNOT_RRTYPE_AAAA, timestamp, ttl);
 		}
 	}
 
@@ -370,7 +389,8 @@ static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut, const knot_d
  * Fetch RRSet of given type.
  */
 static int fetch_rrset(knot_rrset_t **rr, struct kr_cache *cache,
-                       const knot_dname_t *owner, uint16_t type, knot_mm_t *pool, uint32_t timestamp)
+                       const knot_dname_t *owner, uint16_t type, knot_mm_t *pool, uint32_t timestamp,
+                       uint32_t *ttl)
 {
 	if (!rr) {
 		return kr_error(ENOENT);
@@ -396,6 +416,7 @@ static int fetch_rrset(knot_rrset_t **rr, struct kr_cache *cache,
 		knot_rrset_free(rr, pool);
 		return ret;
 	}
+	ttl_bound(ttl, *rr);
 
 	return kr_ok();
 }
@@ -404,15 +425,191 @@ static int fetch_rrset(knot_rrset_t **rr, struct kr_cache *cache,
  * Fetch trust anchors for zone cut.
  * @note The trust anchor can theoretically be a DNSKEY but for now lets use only DS.
  */
-static int fetch_ta(struct kr_zonecut *cut, struct kr_cache *cache, const knot_dname_t *name, uint32_t timestamp)
+static int fetch_ta(struct kr_zonecut *cut, struct kr_cache *cache, const knot_dname_t *name, uint32_t timestamp, uint32_t *ttl)
 {
-	return fetch_rrset(&cut->trust_anchor, cache, name, KNOT_RRTYPE_DS, cut->pool, timestamp);
+	return fetch_rrset(&cut->trust_anchor, cache, name, KNOT_RRTYPE_DS, cut->pool, timestamp, ttl);
 }
 
 /** Fetch DNSKEY for zone cut. */
-static int fetch_dnskey(struct kr_zonecut *cut, struct kr_cache *cache, const knot_dname_t *name, uint32_t timestamp)
+static int fetch_dnskey(struct kr_zonecut *cut, struct kr_cache *cache, const knot_dname_t *name, uint32_t timestamp, uint32_t *ttl)
+{
+	return fetch_rrset(&cut->key, cache, name, KNOT_RRTYPE_DNSKEY, cut->pool, timestamp, ttl);
+}
+
+/*
+ * Zone cut cache.
+ *
+ * Each entry is a malloc-ed copy of the zone cut found in cache at the entry name,
+ * an entry without name servers remembers that there is no zone cut at the name.
+ * The table is 2-way set associative, the entry expiring first is replaced.
+ */
+
+#define CUT_CACHE_WAYS 2
+/** Lifetime of entries that may go stale without notice (no zone cut at the name
+ *  or name servers without addresses), the data may change in cache shared with other processes. */
+#define CUT_CACHE_SHORT_TTL 10
+/** Maximum lifetime of any entry, only NS, DS and DNSKEY updates invalidate it, but the NS addresses
+ *  are updated at other names and by other processes sharing the cache. */
+#define CUT_CACHE_MAX_TTL 30
+
+struct cut_entry {
+	struct kr_zonecut cut;
+	uint32_t expire;
+	uint8_t rank;
+};
+
+struct kr_zonecut_cache {
+	uint32_t mask;
+	struct cut_entry *slots[];
+};
+
+static void cut_entry_free(struct cut_entry *entry)
+{
+	if (entry) {
+		kr_zonecut_deinit(&entry->cut);
+		free(entry);
+	}
+}
+
+static struct cut_entry **cut_bucket(struct kr_zonecut_cache *zc, const knot_dname_t *name)
+{
+	uint32_t h = hash((const char *)name, knot_dname_size(name));
+	return &zc->slots[(h & zc->mask) * CUT_CACHE_WAYS];
+}
+
+struct kr_zonecut_cache *kr_zonecut_cache_create(size_t size)
+{
+	size_t buckets = 1;
+	while (buckets * CUT_CACHE_WAYS < size) {
+		buckets <<= 1;
+	}
+	struct kr_zonecut_cache *zc = calloc(1, sizeof(*zc) + buckets * CUT_CACHE_WAYS * sizeof(zc->slots[0]));
+	if (zc) {
+		zc->mask = buckets - 1;
+	}
+	return zc;
+}
+
+void kr_zonecut_cache_clear(struct kr_zonecut_cache *zc)
+{
+	if (!zc) {
+		return;
+	}
+	for (size_t i = 0; i < (zc->mask + 1) * CUT_CACHE_WAYS; ++i) {
+		cut_entry_free(zc->slots[i]);
+		zc->slots[i] = NULL;
+	}
+}
+
+void kr_zonecut_cache_free(struct kr_zonecut_cache *zc)
+{
+	kr_zonecut_cache_clear(zc);
+	free(zc);
+}
+
+void kr_zonecut_cache_del(struct kr_zonecut_cache *zc, const knot_dname_t *name)
+{
+	if (!zc || !name) {
+		return;
+	}
+	struct cut_entry **bucket = cut_bucket(zc, name);
+	for (unsigned i = 0; i < CUT_CACHE_WAYS; ++i) {
+		if (bucket[i] && knot_dname_is_equal(bucket[i]->cut.name, name)) {
+			cut_entry_free(bucket[i]);
+			bucket[i] = NULL;
+		}
+	}
+}
+
+static void cut_cache_put(struct kr_zonecut_cache *zc, struct cut_entry *entry)
+{
+	struct cut_entry **bucket = cut_bucket(zc, entry->cut.name);
+	/* Replace entry for the same name, free slot or the entry expiring first. */
+	unsigned victim = CUT_CACHE_WAYS;
+	for (unsigned i = 0; i < CUT_CACHE_WAYS; ++i) {
+		if (bucket[i] && knot_dname_is_equal(bucket[i]->cut.name, entry->cut.name)) {
+			victim = i;
+			break;
+		}
+	}
+	for (unsigned i = 0; i < CUT_CACHE_WAYS && victim == CUT_CACHE_WAYS; ++i) {
+		if (!bucket[i]) {
+			victim = i;
+		}
+	}
+	if (victim == CUT_CACHE_WAYS) {
+		victim = 0;
+		for (unsigned i = 1; i < CUT_CACHE_WAYS; ++i) {
+			if (bucket[i]->expire < bucket[victim]->expire) {
+				victim = i;
+			}
+		}
+	}
+	cut_entry_free(bucket[victim]);
+	bucket[victim] = entry;
+}
+
+static int ns_without_addr(const char *k, void *v, void *baton)
 {
-	return fetch_rrset(&cut->key, cache, name, KNOT_RRTYPE_DNSKEY, cut->pool, timestamp);
+	pack_t *addr_set = v;
+	return addr_set->len == 0;
+}
+
+/** Fetch zone cut cache entry for the name, create it from cache on a miss.
+ *  @return entry or NULL if the cache lookup failed */
+static const struct cut_entry *fetch_cut_entry(struct kr_context *ctx, const knot_dname_t *name, uint32_t timestamp)
+{
+	struct kr_zonecut_cache *zc = ctx->cache_cut;
+	struct cut_entry **bucket = cut_bucket(zc, name);
+	for (unsigned i = 0; i < CUT_CACHE_WAYS; ++i) {
+		if (bucket[i] && bucket[i]->expire > timestamp &&
+		    knot_dname_is_equal(bucket[i]->cut.name, name)) {
+			return bucket[i];
+		}
+	}
+
+	struct cut_entry *entry = malloc(sizeof(*entry));
+	if (!entry || kr_zonecut_init(&entry->cut, name, NULL) != 0 || !entry->cut.name) {
+		free(entry);
+		return NULL;
+	}
+	/* Fetch complete zone cut, the callers differ in wanting DS and DNSKEY. */
+	uint32_t ttl = UINT32_MAX;
+	entry->rank = 0;
+	int ret = fetch_ns(ctx, &entry->cut, name, timestamp, &entry->rank, &ttl);
+	if (ret == 0) {
+		fetch_ta(&entry->cut, &ctx->cache, name, timestamp, &ttl);
+		fetch_dnskey(&entry->cut, &ctx->cache, name, timestamp, &ttl);
+		if (ttl > CUT_CACHE_SHORT_TTL && map_walk(&entry->cut.nsset, ns_without_addr, NULL) != 0) {
+			ttl = CUT_CACHE_SHORT_TTL;
+		}
+	} else if (ret == kr_error(ENOENT) || ret == kr_error(ESTALE)) {
+		ttl = CUT_CACHE_SHORT_TTL;
+	} else {
+		cut_entry_free(entry);
+		return NULL;
+	}
+	if (ttl > CUT_CACHE_MAX_TTL) {
+		ttl = CUT_CACHE_MAX_TTL;
+	}
+	entry->expire = timestamp + ttl;
+	cut_cache_put(zc, entry);
+	return entry;
+}
+
+/** Replace RRSet with a copy if the source exists. */
+static int copy_rrset(knot_rrset_t **dst, const knot_rrset_t *src, knot_mm_t *pool)
+{
+	if (!src) {
+		return kr_ok();
+	}
+	knot_rrset_t *copy = knot_rrset_copy(src, pool);
+	if (!copy) {
+		return kr_error(ENOMEM);
+	}
+	knot_rrset_free(dst, pool);
+	*dst = copy;
+	return kr_ok();
 }
 
 int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut, const knot_dname_t *name,
@@ -429,17 +626,35 @@ int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut, const
 	/* Start at QNAME parent. */
 	const knot_dname_t *label = qname;
 	while (true) {
-		/* Fetch NS first and see if it's insecure. */
 		uint8_t rank = 0;
+		uint32_t ttl = UINT32_MAX;
 		const bool is_root = (label[0] == '\0');
-		if (fetch_ns(ctx, cut, label, timestamp, &rank) == 0) {
+		/* Look into zone cut cache if there's any, it remembers names without zone cut as well.
+		 * Otherwise fetch NS first and see if it's insecure. */
+		if (ctx->cache_cut) {
+			const struct cut_entry *entry = fetch_cut_entry(ctx, label, timestamp);
+			if (entry && entry->cut.nsset.root) {
+				if (entry->rank & KR_RANK_INSECURE)
+					*secured = false;
+				int ret = kr_zonecut_copy(cut, &entry->cut);
+				if (ret == 0 && (*secured || is_root)) {
+					ret = copy_rrset(&cut->trust_anchor, entry->cut.trust_anchor, cut->pool);
+				}
+				if (ret == 0 && (*secured || is_root)) {
+					ret = copy_rrset(&cut->key, entry->cut.key, cut->pool);
+				}
+				update_cut_name(cut, label);
+				mm_free(cut->pool, qname);
+				return ret;
+			}
+		} else if (fetch_ns(ctx, cut, label, timestamp, &rank, &ttl) == 0) {
 			/* Flag as insecure if cached as this */
 			if (rank & KR_RANK_INSECURE)
 				*secured = false;
 			/* Fetch DS if caller wants secure zone cut */
 			if (*secured || is_root) {
-				fetch_ta(cut, &ctx->cache, label, timestamp);
-				fetch_dnskey(cut, &ctx->cache, label, timestamp);
+				fetch_ta(cut, &ctx->cache, label, timestamp, &ttl);
+				fetch_dnskey(cut, &ctx->cache, label, timestamp, &ttl);
 			}
 			update_cut_name(cut, label);
 			mm_free(cut->pool, qname);
@@ -23,6 +23,7 @@
 
 struct kr_rplan;
 struct kr_context;
+struct kr_zonecut_cache;
 
 /**
  * Current zone cut representation.
@@ -140,3 +141,37 @@ int kr_zonecut_set_sbelt(struct kr_context *ctx, struct kr_zonecut *cut);
 KR_EXPORT
 int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut, const knot_dname_t *name,
                            uint32_t timestamp, bool * restrict secured);
+
+/**
+ * Create in-memory cache of zone cuts found by kr_zonecut_find_cached().
+ *
+ * The cache keeps zone cuts (including addresses, DS and DNSKEY) and names without
+ * a zone cut, so the closest zone cut is found without going through the cache for each label.
+ *
+ * @param size number of entries
+ * @return zone cut cache or NULL
+ */
+KR_EXPORT
+struct kr_zonecut_cache *kr_zonecut_cache_create(size_t size);
+
+/**
+ * Free zone cut cache and all entries.
+ * @param zc zone cut cache
+ */
+KR_EXPORT
+void kr_zonecut_cache_free(struct kr_zonecut_cache *zc);
+
+/**
+ * Remove all entries, e.g. when the cache is cleared.
+ * @param zc zone cut cache
+ */
+KR_EXPORT
+void kr_zonecut_cache_clear(struct kr_zonecut_cache *zc);
+
+/**
+ * Remove entry for given name, call it when NS, DS or DNSKEY at the name is updated in cache.
+ * @param zc   zone cut cache
+ * @param name zone cut name
+ */
+KR_EXPORT
+void kr_zonecut_cache_del(struct kr_zonecut_cache *zc, const knot_dname_t *name);
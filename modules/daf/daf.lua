@@ -1,6 +1,8 @@
 -- Load dependent modules
 if not view then modules.load('view') end
 if not policy then modules.load('policy') end
+local ffi = require('ffi')
+local C = ffi.C
 
 -- Actions
 local actions = {
@@ -40,29 +42,51 @@ local actions = {
 	end,
 }
 
--- Filter rules per column
+-- Filter rules per column, a filter is a list of clauses (disjunctive normal form)
+-- and each clause is a list of predicates {field, operator, operand}
 local filters = {
 	-- Filter on QNAME (either pattern or suffix match)
 	qname = function (g)
 		local op, val = g(), todname(g())
-		if     op == '~' then return policy.pattern(true, val:sub(2)) -- Skip leading label length
-		elseif op == '=' then return policy.suffix(true, {val})
+		if     op == '~' then return {{{'qname', op, val:sub(2)}}} -- Skip leading label length
+		elseif op == '=' then return {{{'qname', op, val}}}
 		else error(string.format('invalid operator "%s" on qname', op)) end
 	end,
 	-- Filter on source address
 	src = function (g)
 		local op = g()
 		if op ~= '=' then error('address supports only "=" operator') end
-		return view.rule_src(true, g())
+		return {{{'src', op, g()}}}
 	end,
 	-- Filter on destination address
 	dst = function (g)
 		local op = g()
 		if op ~= '=' then error('address supports only "=" operator') end
-		return view.rule_dst(true, g())
+		return {{{'dst', op, g()}}}
 	end,
 }
 
+-- Combine filters, conjunction distributes over clauses
+local function conjunction(fa, fb)
+	local f = {}
+	for _, a in ipairs(fa) do
+		for _, b in ipairs(fb) do
+			local clause = {}
+			for _, p in ipairs(a) do table.insert(clause, p) end
+			for _, p in ipairs(b) do table.insert(clause, p) end
+			table.insert(f, clause)
+		end
+	end
+	return f
+end
+
+local function disjunction(fa, fb)
+	local f = {}
+	for _, a in ipairs(fa) do table.insert(f, a) end
+	for _, b in ipairs(fb) do table.insert(f, b) end
+	return f
+end
+
 local function parse_filter(tok, g, prev)
 	if not tok then error(string.format('expected filter after "%s"', prev)) end
 	local filter = filters[tok:lower()]
@@ -77,16 +101,14 @@ local function parse_rule(g)
 		return tok, nil
 	end
 	local f = parse_filter(tok, g)
-	-- Compose filter functions on conjunctions
+	-- Compose filters on conjunctions
 	-- or terminate filter chain and return
 	tok = g()
 	while tok do
 		if tok:lower() == 'and' then
-			local fa, fb = f, parse_filter(g(), g, tok)
-			f = function (req, qry) return fa(req, qry) and fb(req, qry) end
+			f = conjunction(f, parse_filter(g(), g, tok))
 		elseif tok:lower() == 'or' then
-			local fa, fb = f, parse_filter(g(), g, tok)
-			f = function (req, qry) return fa(req, qry) or fb(req, qry) end
+			f = disjunction(f, parse_filter(g(), g, tok))
 		else
 			break
 		end
@@ -121,6 +143,103 @@ local function compile(query)
 	return parse_query(g)
 end
 
+-- @function Evaluate QNAME pattern predicates of a clause
+local function match_patterns(patterns, req, qry)
+	for i = 1, #patterns do
+		if patterns[i](req, qry) == nil then
+			return false
+		end
+	end
+	return true
+end
+
+-- Rule tables, the clauses are indexed by QNAME suffix and source subnet
+-- and the exact match predicates are evaluated natively, only the QNAME patterns are left in Lua.
+-- Special actions are evaluated as postrules.
+local function ruletable()
+	local tbl = {
+		set = ffi.gc(C.kr_ruleset_new(), C.kr_ruleset_free),
+		clauses = {},
+		ids = ffi.new('int[?]', 1),
+		capacity = 1,
+		matched = 0,
+	}
+	-- Matching clauses are enforced by an action shared for all queries,
+	-- it is called right after evaluate() so the state of last match is valid
+	tbl.action = function (state, req)
+		local qry = tbl.qry
+		local matched = nil
+		for i = 0, tbl.matched - 1 do
+			local clause = tbl.clauses[tbl.ids[i]]
+			local r = clause.rule
+			-- Rule with several matching clauses is enforced once
+			if r ~= matched and not r.rule.suspended and match_patterns(clause.patterns, req, qry) then
+				matched = r
+				r.rule.count = r.rule.count + 1
+				local next_state = policy.enforce(state, req, r.action)
+				if next_state then    -- Not a chain rule,
+					return next_state -- stop on first match
+				end
+			end
+		end
+	end
+	return tbl
+end
+local tables = { rules = ruletable(), postrules = ruletable() }
+
+-- @function Add rule clauses to the rule table
+local function index_rule(tbl, r)
+	for _, clause in ipairs(r.filter) do
+		local native, extra, patterns = {}, {}, {}
+		for _, p in ipairs(clause) do
+			if p[2] == '~' then
+				table.insert(patterns, policy.pattern(true, p[3]))
+			elseif native[p[1]] == nil then
+				native[p[1]] = p[3]
+			else
+				table.insert(extra, p)
+			end
+		end
+		local id = #tbl.clauses + 1
+		if C.kr_ruleset_add(tbl.set, id, native.qname, native.src, native.dst) ~= 0 then
+			return false
+		end
+		for _, p in ipairs(extra) do
+			local qname, src, dst
+			if p[1] == 'qname' then qname = p[3]
+			elseif p[1] == 'src' then src = p[3]
+			else dst = p[3] end
+			if C.kr_ruleset_and(tbl.set, id, qname, src, dst) ~= 0 then
+				return false
+			end
+		end
+		tbl.clauses[id] = {rule=r, patterns=patterns}
+	end
+	if #tbl.clauses > tbl.capacity then
+		tbl.capacity = 2 * #tbl.clauses
+		tbl.ids = ffi.new('int[?]', tbl.capacity)
+	end
+	return true
+end
+
+-- @function Evaluate rule table, matching rules are enforced in the order they were added
+local function evaluate(tbl, req, qry)
+	local n = C.kr_ruleset_match(tbl.set, qry.sname, req.qsource.addr, req.qsource.dst_addr,
+	                             tbl.ids, tbl.capacity)
+	-- Output array is too small, grow it and match again
+	if n > tbl.capacity then
+		tbl.capacity = n
+		tbl.ids = ffi.new('int[?]', tbl.capacity)
+		n = C.kr_ruleset_match(tbl.set, qry.sname, req.qsource.addr, req.qsource.dst_addr,
+		                       tbl.ids, tbl.capacity)
+	end
+	if n == 0 then
+		return nil
+	end
+	tbl.matched, tbl.qry = n, qry
+	return tbl.action
+end
+
 -- @function Describe given rule for presentation
 local function rule_info(r)
 	return {info=r.info, id=r.rule.id, active=(r.rule.suspended ~= true), count=r.rule.count}
@@ -131,10 +250,28 @@ local M = {
 	rules = {}
 }
 
--- @function Remove a rule
+-- Rule tables are enforced in policy module
+local dispatch = {
+	rules = policy.add(function (req, qry) return evaluate(tables.rules, req, qry) end),
+	postrules = policy.add(function (req, qry) return evaluate(tables.postrules, req, qry) end, true),
+}
+local nextid = 0
+
+-- @function Rebuild rule table from the list of rules
+local function rebuild(name)
+	local tbl = ruletable()
+	for _, r in ipairs(M.rules) do
+		if r.table == name then
+			index_rule(tbl, r)
+		end
+	end
+	tables[name] = tbl
+end
 
 -- @function Cleanup module
 function M.deinit()
+	policy.del(dispatch.rules.id)
+	policy.del(dispatch.postrules.id)
 	if http and http.endpoints then
 		http.endpoints['/daf'] = nil
 		http.endpoints['/daf.js'] = nil
@@ -150,23 +287,18 @@ function M.add(rule)
 	end
 	local id, action, filter = compile(rule)
 	if not id then error(action) end
-	-- Combine filter and action into policy
-	local p
-	if filter then
-		p = function (req, qry)
-			return filter(req, qry) and action
-		end
-	else
-		p = function (req, qry)
-			return action
-		end
-	end
-	local desc = {info=rule, policy=p}
-	-- Enforce in policy module, special actions are postrules
+	-- Rule without filter matches all queries
+	nextid = nextid + 1
+	local desc = {info=rule, action=action, filter=filter or {{}}, rule={id=nextid, count=0}}
+	-- Special actions are postrules
 	if id == 'reroute' or id == 'rewrite' then
-		desc.rule = policy.add(p, true)
+		desc.table = 'postrules'
 	else
-		desc.rule = policy.add(p)
+		desc.table = 'rules'
+	end
+	if not index_rule(tables[desc.table], desc) then
+		rebuild(desc.table) -- Drop clauses already added
+		error(string.format('invalid rule "%s"', rule))
 	end
 	table.insert(M.rules, desc)
 	return desc
@@ -176,8 +308,8 @@ end
 function M.del(id)
 	for i, r in ipairs(M.rules) do
 		if r.rule.id == id then
-			policy.del(id)
-			table.remove(M.rules, id)
+			table.remove(M.rules, i)
+			rebuild(r.table)
 			return true
 		end
 	end
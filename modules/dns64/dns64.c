@@ -0,0 +1,328 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file dns64.c
+ * @brief RFC 6147 DNS64 AAAA-from-A record synthesis.
+ *
+ * The final AAAA query without usable AAAA records (i.e. NODATA or only excluded addresses)
+ * spawns an A sub-query, and its answer is translated into the final answer
+ * using every configured NAT64 prefix (RFC 6052 address format).
+ */
+
+#include <arpa/inet.h>
+#include <libknot/packet/pkt.h>
+#include <libknot/descriptor.h>
+#include <libknot/rrtype/aaaa.h>
+#include <ccan/json/json.h>
+#include <contrib/cleanup.h>
+
+#include "lib/module.h"
+#include "lib/layer.h"
+#include "lib/resolve.h"
+#include "lib/rplan.h"
+#include "lib/utils.h"
+
+#define DEBUG_MSG(qry, fmt...) QRDEBUG(qry, "dns64",  fmt)
+
+/* Excluded by default (RFC 6147 5.1.4) */
+#define DEFAULT_EXCLUDE "::ffff:0:0/96"
+
+struct dns64_prefix {
+	uint8_t addr[16];
+	int bits;
+};
+
+typedef array_t(struct dns64_prefix) prefix_list_t;
+
+struct dns64_data {
+	prefix_list_t prefixes; /**< NAT64 prefixes used for synthesis. */
+	prefix_list_t exclude;  /**< AAAA addresses in these subnets are treated as missing. */
+};
+
+/** Embed IPv4 address into IPv6 prefix (RFC 6052 2.2), the bits 64-71 are skipped. */
+static void synth_addr(uint8_t *dst, const struct dns64_prefix *prefix, const uint8_t *addr4)
+{
+	memcpy(dst, prefix->addr, sizeof(prefix->addr));
+	int pos = prefix->bits / 8;
+	for (int i = 0; i < 4; ++i, ++pos) {
+		if (pos == 8) {
+			++pos;
+		}
+		dst[pos] = addr4[i];
+	}
+}
+
+static bool is_excluded(const struct dns64_data *data, const uint8_t *addr6)
+{
+	for (size_t i = 0; i < data->exclude.len; ++i) {
+		const struct dns64_prefix *net = &data->exclude.at[i];
+		if (net->bits == 0 || kr_bitcmp((const char *)net->addr, (const char *)addr6, net->bits) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Return true if the AAAA answer has no usable addresses, i.e. is NODATA or contains only excluded ones. */
+static bool needs_synthesis(const struct dns64_data *data, const knot_pkt_t *pkt)
+{
+	const knot_pktsection_t *an = knot_pkt_section(pkt, KNOT_ANSWER);
+	for (unsigned i = 0; i < an->count; ++i) {
+		const knot_rrset_t *rr = knot_pkt_rr(an, i);
+		if (rr->type == KNOT_RRTYPE_RRSIG) {
+			continue;
+		}
+		if (rr->type != KNOT_RRTYPE_AAAA) {
+			return false; /* e.g. CNAME, the chain isn't followed */
+		}
+		for (uint16_t j = 0; j < rr->rrs.rr_count; ++j) {
+			const knot_rdata_t *rd = knot_rdataset_at(&rr->rrs, j);
+			if (knot_rdata_rdlen(rd) != 16 || !is_excluded(data, knot_rdata_data(rd))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/** Translate A records from the sub-query answer into AAAA records in the final answer. */
+static int synthesize(struct kr_request *req, const struct dns64_data *data, const knot_pkt_t *pkt)
+{
+	knot_pkt_t *answer = req->answer;
+	/* Only excluded AAAA records may be in the answer at this point, replace them. */
+	if (knot_pkt_section(answer, KNOT_ANSWER)->count > 0) {
+		kr_pkt_clear_payload(answer);
+	}
+	const knot_pktsection_t *an = knot_pkt_section(pkt, KNOT_ANSWER);
+	for (unsigned i = 0; i < an->count; ++i) {
+		const knot_rrset_t *rr = knot_pkt_rr(an, i);
+		if (rr->type != KNOT_RRTYPE_A) {
+			continue;
+		}
+		knot_dname_t *owner = knot_dname_copy(rr->owner, &answer->mm);
+		knot_rrset_t synth;
+		knot_rrset_init(&synth, owner, KNOT_RRTYPE_AAAA, rr->rclass);
+		for (uint16_t j = 0; j < rr->rrs.rr_count; ++j) {
+			const knot_rdata_t *rd = knot_rdataset_at(&rr->rrs, j);
+			if (knot_rdata_rdlen(rd) != 4) {
+				continue;
+			}
+			for (size_t k = 0; k < data->prefixes.len; ++k) {
+				uint8_t addr6[16];
+				synth_addr(addr6, &data->prefixes.at[k], knot_rdata_data(rd));
+				knot_rrset_add_rdata(&synth, addr6, sizeof(addr6), knot_rdata_ttl(rd), &answer->mm);
+			}
+		}
+		if (knot_rrset_empty(&synth)) {
+			knot_rrset_clear(&synth, &answer->mm);
+			continue;
+		}
+		unsigned hint = 0;
+		if (knot_dname_is_equal(owner, knot_pkt_qname(answer))) {
+			hint = KNOT_COMPR_HINT_QNAME;
+		}
+		int ret = knot_pkt_put(answer, hint, &synth, KNOT_PF_FREE);
+		if (ret != 0) {
+			knot_rrset_clear(&synth, &answer->mm);
+			return ret;
+		}
+	}
+	return kr_ok();
+}
+
+static int consume(kr_layer_t *ctx, knot_pkt_t *pkt)
+{
+	struct kr_request *req = ctx->req;
+	struct kr_query *qry = req->current_query;
+	struct kr_module *module = ctx->api->data;
+	struct dns64_data *data = module->data;
+	/* Observe only authoritative answers */
+	if (!qry || ctx->state & KR_STATE_FAIL || !data || data->prefixes.len == 0 ||
+	    !(qry->flags & QUERY_RESOLVED)) {
+		return ctx->state;
+	}
+	/* Synthetic AAAA from marked A responses */
+	if (qry->flags & QUERY_DNS64_MARK) {
+		if (synthesize(req, data, pkt) != 0) {
+			DEBUG_MSG(qry, "<= failed to synthesize AAAA\n");
+		}
+		return ctx->state;
+	}
+	/* Observe final AAAA responses without usable addresses */
+	if (qry->stype != KNOT_RRTYPE_AAAA || qry->parent ||
+	    knot_pkt_qtype(pkt) != KNOT_RRTYPE_AAAA ||
+	    knot_wire_get_rcode(pkt->wire) != KNOT_RCODE_NOERROR ||
+	    !knot_dname_is_equal(knot_pkt_qname(pkt), qry->sname) ||
+	    !needs_synthesis(data, pkt)) {
+		return ctx->state;
+	}
+	struct kr_query *next = kr_rplan_push(&req->rplan, qry, qry->sname, qry->sclass, KNOT_RRTYPE_A);
+	if (!next) {
+		return ctx->state;
+	}
+	next->flags = (qry->flags & QUERY_DNSSEC_WANT) | QUERY_AWAIT_CUT | QUERY_DNS64_MARK;
+	DEBUG_MSG(qry, "=> no usable AAAA, synthesizing from A\n");
+	return ctx->state;
+}
+
+/** Parse subnet in CIDR notation, address without length is a /96 prefix for NAT64. */
+static int parse_prefix(struct dns64_prefix *prefix, const char *str, bool nat64)
+{
+	if (!str || kr_straddr_family(str) != AF_INET6) {
+		return kr_error(EINVAL);
+	}
+	memset(prefix, 0, sizeof(*prefix));
+	int bits = kr_straddr_subnet(prefix->addr, str);
+	if (bits < 0) {
+		return kr_error(EINVAL);
+	}
+	if (!strchr(str, '/') && nat64) {
+		bits = 96;
+	}
+	/* RFC 6052 2.2, only these prefix lengths are valid */
+	if (nat64 && bits != 32 && bits != 40 && bits != 48 && bits != 56 && bits != 64 && bits != 96) {
+		return kr_error(EINVAL);
+	}
+	/* Clear host bits */
+	for (int i = bits; i < 128; ++i) {
+		prefix->addr[i / 8] &= ~(0x80 >> (i % 8));
+	}
+	prefix->bits = bits;
+	return kr_ok();
+}
+
+static int add_prefixes(prefix_list_t *list, JsonNode *node, bool nat64)
+{
+	if (!node) {
+		return kr_ok();
+	}
+	if (node->tag == JSON_STRING) {
+		struct dns64_prefix prefix;
+		if (parse_prefix(&prefix, node->string_, nat64) != 0) {
+			kr_log_error("[dns64] '%s' is not a valid prefix\n", node->string_);
+			return kr_error(EINVAL);
+		}
+		return array_push(*list, prefix) < 0 ? kr_error(ENOMEM) : kr_ok();
+	}
+	if (node->tag != JSON_ARRAY) {
+		return kr_error(EINVAL);
+	}
+	JsonNode *elm = NULL;
+	json_foreach(elm, node) {
+		int ret = add_prefixes(list, elm, nat64);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	return kr_ok();
+}
+
+static void free_data(struct dns64_data *data)
+{
+	if (data) {
+		array_clear(data->prefixes);
+		array_clear(data->exclude);
+		free(data);
+	}
+}
+
+/**
+ * Parse configuration, either a single NAT64 prefix or an object:
+ * { prefix = 'addr' | { 'addr', ... }, exclude = 'subnet' | { 'subnet', ... } }
+ */
+static struct dns64_data *parse_config(const char *conf)
+{
+	struct dns64_data *data = malloc(sizeof(*data));
+	if (!data) {
+		return NULL;
+	}
+	array_init(data->prefixes);
+	array_init(data->exclude);
+	JsonNode *root = json_decode(conf);
+	JsonNode *prefixes = NULL, *exclude = NULL;
+	if (root && root->tag == JSON_OBJECT) {
+		prefixes = json_find_member(root, "prefix");
+		exclude = json_find_member(root, "exclude");
+	} else if (!root) {
+		/* Plain address */
+		root = json_mkstring(conf);
+		prefixes = root;
+	} else {
+		prefixes = root;
+	}
+	JsonNode *default_exclude = exclude ? NULL : json_mkstring(DEFAULT_EXCLUDE);
+	int ret = add_prefixes(&data->prefixes, prefixes, true);
+	if (ret == 0) {
+		ret = add_prefixes(&data->exclude, exclude ? exclude : default_exclude, false);
+	}
+	json_delete(default_exclude);
+	json_delete(root);
+	if (ret != 0) {
+		free_data(data);
+		return NULL;
+	}
+	return data;
+}
+
+/*
+ * Module implementation.
+ */
+
+KR_EXPORT
+const kr_layer_api_t *dns64_layer(struct kr_module *module)
+{
+	static kr_layer_api_t _layer = {
+		.consume = &consume,
+	};
+	/* Store module reference */
+	_layer.data = module;
+	return &_layer;
+}
+
+KR_EXPORT
+int dns64_init(struct kr_module *module)
+{
+	module->data = NULL;
+	return kr_ok();
+}
+
+KR_EXPORT
+int dns64_config(struct kr_module *module, const char *conf)
+{
+	if (!conf || strlen(conf) < 1) {
+		return kr_ok();
+	}
+	/* Keep the current configuration if the new one is invalid */
+	struct dns64_data *data = parse_config(conf);
+	if (!data) {
+		kr_log_error("[dns64] invalid configuration '%s'\n", conf);
+		return kr_error(EINVAL);
+	}
+	free_data(module->data);
+	module->data = data;
+	return kr_ok();
+}
+
+KR_EXPORT
+int dns64_deinit(struct kr_module *module)
+{
+	free_data(module->data);
+	module->data = NULL;
+	return kr_ok();
+}
+
+KR_MODULE_EXPORT(dns64);
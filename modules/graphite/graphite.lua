@@ -5,6 +5,7 @@ if not stats then modules.load('stats') end
 if worker.id > 0 then return {} end
 local M = {}
 local socket = require('socket')
+local histogram = require('histogram')
 
 -- Create connected UDP socket
 local function make_udp(host, port)
@@ -42,11 +43,61 @@ local function make_tcp(host, port)
 	return s
 end
 
-local function merge(results)
+-- Merge metrics from all workers, the metrics in shared set are the same in all workers
+local function merge(results, shared)
 	local t = {}
 	for _, result in ipairs(results) do
 		for k, v in pairs(result) do
-			t[k] = (t[k] or 0) + v
+			if shared and shared[k] then
+				t[k] = math.max(t[k] or 0, v)
+			else
+				t[k] = (t[k] or 0) + v
+			end
+		end
+	end
+	return t
+end
+
+-- Summarize latency histogram as count, mean and percentiles (in milliseconds)
+local function summarize_hist(hist)
+	local bounds = histogram.bounds(hist)
+	local t = { count = hist.count, mean = hist.count > 0 and hist.sum / hist.count / 1000 or 0 }
+	local quantiles = { p50 = 0.5, p90 = 0.9, p99 = 0.99, p999 = 0.999 }
+	for key, q in pairs(quantiles) do
+		local count, rank = 0, q * hist.count
+		for _, max in ipairs(bounds) do
+			count = count + hist.buckets[max]
+			if count >= rank then
+				t[key] = max / 1000
+				break
+			end
+		end
+	end
+	return t
+end
+
+-- Aggregate latency histograms into flat metrics, e.g. latency.qtype.A.p99
+local function latency_metrics(results)
+	local hists = {}
+	for _, result in ipairs(results) do
+		if type(result) == 'table' and result.total then
+			hists.total = hists.total or {}
+			histogram.merge(hists.total, result.total)
+			for group, group_hists in pairs(result) do
+				if group ~= 'total' then
+					for k, hist in pairs(group_hists) do
+						local key = group .. '.' .. k
+						hists[key] = hists[key] or {}
+						histogram.merge(hists[key], hist)
+					end
+				end
+			end
+		end
+	end
+	local t = {}
+	for key, hist in pairs(hists) do
+		for k, v in pairs(summarize_hist(hist)) do
+			t[key .. '.' .. k] = v
 		end
 	end
 	return t
@@ -99,6 +150,10 @@ function M.publish()
 	publish_table(merge(map 'worker.stats()'), M.prefix..'.worker', now)
 	-- Publish extended statistics if available
 	publish_table(merge(map 'stats.list()'), M.prefix, now)
+	publish_table(latency_metrics(map 'stats.latency()'), M.prefix..'.latency', now)
+	if predict then
+		publish_table(merge(map 'predict.stats()', {epoch = true}), M.prefix..'.predict', now)
+	end
 	return 0
 end
 
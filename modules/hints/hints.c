@@ -25,6 +25,9 @@
 #include <libknot/descriptor.h>
 #include <libknot/rrtype/aaaa.h>
 #include <ccan/json/json.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <ucw/mempool.h>
 #include <contrib/cleanup.h>
 
@@ -37,15 +40,10 @@
 #define DEFAULT_FILE "/etc/hosts"
 #define DEBUG_MSG(qry, fmt...) QRDEBUG(qry, "hint",  fmt)
 
-/* Structure for reverse search (address to domain) */
-struct rev_search_baton {
-	knot_pkt_t *pkt;
-	const knot_dname_t *name;
-	union {
-		struct in_addr ip4;
-		struct in6_addr ip6;
-	} addr;
-	size_t addr_len;
+/* Forward (name to address) and reverse (address to name) hints */
+struct hints_data {
+	struct kr_zonecut hints;
+	struct kr_zonecut reverse_hints;
 };
 
 static int put_answer(knot_pkt_t *pkt, knot_rrset_t *rr)
@@ -69,79 +67,25 @@ static int put_answer(knot_pkt_t *pkt, knot_rrset_t *rr)
 	return ret;
 }
 
-static int find_reverse(const char *k, void *v, void *baton)
+static int satisfy_reverse(struct kr_zonecut *hints, knot_pkt_t *pkt, struct kr_query *qry)
 {
-	const knot_dname_t *domain = (const knot_dname_t *)k;
-	pack_t *addr_set = (pack_t *)v;
-	struct rev_search_baton *search = baton;
-	/* Check if it matches any of the addresses. */
-	bool matches = false;
-	uint8_t *addr = pack_head(*addr_set);
-	while (!matches && addr != pack_tail(*addr_set)) {
-		size_t len = pack_obj_len(addr);
-		void *addr_val = pack_obj_val(addr);
-		matches = (len == search->addr_len && memcmp(addr_val, (void *)&search->addr, len) == 0);
-		addr = pack_obj_next(addr);
-	}
-	/* Synthesise PTR record */
-	if (!matches) {
-		return 0;
+	/* Find a matching reverse name */
+	pack_t *name_set = kr_zonecut_find(hints, qry->sname);
+	if (!name_set || name_set->len == 0) {
+		return kr_error(ENOENT);
 	}
-	knot_pkt_t *pkt = search->pkt;
-	knot_dname_t *qname = knot_dname_copy(search->name, &pkt->mm);
+	knot_dname_t *qname = knot_dname_copy(qry->sname, &pkt->mm);
 	knot_rrset_t rr;
 	knot_rrset_init(&rr, qname, KNOT_RRTYPE_PTR, KNOT_CLASS_IN);
-	knot_rrset_add_rdata(&rr, domain, knot_dname_size(domain), 0, &pkt->mm);
-	/* Insert into packet */
-	int ret = put_answer(pkt, &rr);
-	if (ret == 0) {
-		return 1;
-	}
-	return ret;
-}
-
-static inline uint8_t label2num(const uint8_t **src, int base)
-{
-	uint8_t ret = strtoul((const char *)(*src + 1), NULL, base) & 0xff; /* ord(0-64) => labels are separators */
-	*src = knot_wire_next_label(*src, NULL);
-	return ret;
-}
 
-static int satisfy_reverse(struct kr_zonecut *hints, knot_pkt_t *pkt, struct kr_query *qry)
-{
-	struct rev_search_baton baton = {
-		.pkt = pkt,
-		.name = qry->sname,
-		.addr_len = sizeof(struct in_addr)
-	};
-	/* Check if it is IPv6/IPv4 query. */
-	size_t need_labels = baton.addr_len;
-	if (knot_dname_in((const uint8_t *)"\3ip6\4arpa", qry->sname)) {
-		baton.addr_len = sizeof(struct in6_addr);
-		need_labels = baton.addr_len * 2; /* Each label is a nibble */
-	}
-	/* Make address from QNAME (reverse order). */
-	int labels = knot_dname_labels(qry->sname, NULL);
-	if (labels != need_labels + 2) {
-		return kr_error(EINVAL);
-	}
-	const uint8_t *src = qry->sname;
-	uint8_t *dst = (uint8_t *)&baton.addr.ip4 + baton.addr_len - 1;
-	for (size_t i = 0; i < baton.addr_len; ++i) {
-		if (baton.addr_len == sizeof(struct in_addr)) { /* IPv4, 1 label = 1 octet */
-			*dst = label2num(&src, 10);
-		} else { /* IPv4, 1 label = 1 nibble */
-			*dst = label2num(&src, 16);
-			*dst |= label2num(&src, 16) << 4;
-		}
-		dst -= 1;
+	/* Append PTR records from hints */
+	uint8_t *name = pack_head(*name_set);
+	while (name != pack_tail(*name_set)) {
+		knot_rrset_add_rdata(&rr, pack_obj_val(name), pack_obj_len(name), 0, &pkt->mm);
+		name = pack_obj_next(name);
 	}
-	/* Try to find matching domains. */
-	int ret = map_walk(&hints->nsset, find_reverse, &baton);
-	if (ret > 0) {
-		return kr_ok(); /* Found */
-	}
-	return kr_error(ENOENT);
+
+	return put_answer(pkt, &rr);
 }
 
 static int satisfy_forward(struct kr_zonecut *hints, knot_pkt_t *pkt, struct kr_query *qry)
@@ -181,15 +125,15 @@ static int query(kr_layer_t *ctx, knot_pkt_t *pkt)
 	}
 
 	struct kr_module *module = ctx->api->data;
-	struct kr_zonecut *hint_map = module->data;
+	struct hints_data *data = module->data;
 	switch(qry->stype) {
 	case KNOT_RRTYPE_A:
 	case KNOT_RRTYPE_AAAA: /* Find forward record hints */
-		if (satisfy_forward(hint_map, pkt, qry) != 0)
+		if (satisfy_forward(&data->hints, pkt, qry) != 0)
 			return ctx->state;
 		break;
 	case KNOT_RRTYPE_PTR: /* Find PTR record */
-		if (satisfy_reverse(hint_map, pkt, qry) != 0)
+		if (satisfy_reverse(&data->reverse_hints, pkt, qry) != 0)
 			return ctx->state;
 		break;
 	default:
@@ -216,6 +160,18 @@ static int parse_addr_str(struct sockaddr_storage *sa, const char *addr)
 	return 0;
 }
 
+static int add_forward(struct kr_zonecut *hints, const knot_dname_t *name,
+                       const struct sockaddr_storage *ss)
+{
+	/* Build RDATA */
+	size_t addr_len = kr_inaddr_len((struct sockaddr *)ss);
+	const uint8_t *raw_addr = (const uint8_t *)kr_inaddr((struct sockaddr *)ss);
+	/* @warning _NOT_ thread-safe */
+	static knot_rdata_t rdata_arr[RDATA_ARR_MAX];
+	knot_rdata_init(rdata_arr, addr_len, raw_addr, 0);
+	return kr_zonecut_add(hints, name, rdata_arr);
+}
+
 static int add_pair(struct kr_zonecut *hints, const char *name, const char *addr)
 {
 	/* Build key */
@@ -230,76 +186,187 @@ static int add_pair(struct kr_zonecut *hints, const char *name, const char *addr
 		return kr_error(EINVAL);
 	}
 
+	return add_forward(hints, key, &ss);
+}
+
+/** Build reverse name (in-addr.arpa or ip6.arpa) for the address. */
+static int raw_addr2reverse(knot_dname_t *dst, size_t maxlen, const uint8_t *raw_addr, size_t addr_len)
+{
+	char reverse_addr[4 * 16 + sizeof("ip6.arpa.")];
+	char *it = reverse_addr;
+	if (addr_len == sizeof(struct in_addr)) {
+		sprintf(it, "%u.%u.%u.%u.in-addr.arpa.",
+		        raw_addr[3], raw_addr[2], raw_addr[1], raw_addr[0]);
+	} else {
+		for (int i = addr_len - 1; i >= 0; --i) {
+			it += sprintf(it, "%x.%x.", raw_addr[i] & 0x0f, raw_addr[i] >> 4);
+		}
+		strcpy(it, "ip6.arpa.");
+	}
+	if (!knot_dname_from_str(dst, reverse_addr, maxlen)) {
+		return kr_error(EINVAL);
+	}
+	return kr_ok();
+}
+
+static int add_reverse(struct kr_zonecut *reverse_hints, const knot_dname_t *name,
+                       const struct sockaddr_storage *ss)
+{
+	/* Build key */
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	size_t addr_len = kr_inaddr_len((struct sockaddr *)ss);
+	const uint8_t *raw_addr = (const uint8_t *)kr_inaddr((struct sockaddr *)ss);
+	if (raw_addr2reverse(key, sizeof(key), raw_addr, addr_len) != 0) {
+		return kr_error(EINVAL);
+	}
+
 	/* Build RDATA */
-	size_t addr_len = kr_inaddr_len((struct sockaddr *)&ss);
-	const uint8_t *raw_addr = (const uint8_t *)kr_inaddr((struct sockaddr *)&ss);
 	/* @warning _NOT_ thread-safe */
 	static knot_rdata_t rdata_arr[RDATA_ARR_MAX];
-	knot_rdata_init(rdata_arr, addr_len, raw_addr, 0);
-	return kr_zonecut_add(hints, key, rdata_arr);
+	knot_rdata_init(rdata_arr, knot_dname_size(name), name, 0);
+	return kr_zonecut_add(reverse_hints, key, rdata_arr);
 }
 
-static int load_map(struct kr_zonecut *hints, FILE *fp)
+/** Add both forward and reverse hint for the pair. */
+static int add_hint(struct hints_data *data, const char *name, const char *addr)
 {
-	size_t line_len = 0;
-	size_t count = 0;
-	auto_free char *line = NULL;
+	knot_dname_t key[KNOT_DNAME_MAXLEN];
+	if (!knot_dname_from_str(key, name, sizeof(key))) {
+		return kr_error(EINVAL);
+	}
+	struct sockaddr_storage ss;
+	if (parse_addr_str(&ss, addr) != 0) {
+		return kr_error(EINVAL);
+	}
+	int ret = add_forward(&data->hints, key, &ss);
+	if (ret == 0) {
+		ret = add_reverse(&data->reverse_hints, key, &ss);
+	}
+	return ret;
+}
 
-	while(getline(&line, &line_len, fp) > 0) {
-		char *saveptr = NULL;
-		char *tok = strtok_r(line, " \t\r", &saveptr);
-		if (tok == NULL || strchr(tok, '#') || strlen(tok) == 0) {
-			continue;
+/**
+ * Copy next whitespace-delimited token from [*it, end) to dst.
+ * @return token length, 0 at the end of input, -1 if the token doesn't fit (it's skipped)
+ */
+static int next_token(const char **it, const char *end, char *dst, size_t maxlen)
+{
+	const char *pos = *it;
+	while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) {
+		++pos;
+	}
+	const char *start = pos;
+	while (pos < end && *pos != ' ' && *pos != '\t' && *pos != '\r') {
+		++pos;
+	}
+	*it = pos;
+	size_t len = pos - start;
+	if (len >= maxlen) {
+		return -1;
+	}
+	memcpy(dst, start, len);
+	dst[len] = '\0';
+	return len;
+}
+
+static int load_map(struct hints_data *data, const char *buf, size_t buflen)
+{
+	size_t count = 0;
+	const char *end = buf + buflen;
+	const char *line = buf;
+	while (line < end) {
+		const char *eol = memchr(line, '\n', end - line);
+		if (eol == NULL) {
+			eol = end;
 		}
-		char *name_tok = strtok_r(NULL, " \t\n", &saveptr);
-		while (name_tok != NULL) {
-			if (add_pair(hints, name_tok, tok) == 0) {
-				count += 1;
+		/* Everything after '#' is a comment */
+		const char *comment = memchr(line, '#', eol - line);
+		const char *it = line;
+		const char *stop = comment ? comment : eol;
+		char addr[INET6_ADDRSTRLEN];
+		if (next_token(&it, stop, addr, sizeof(addr)) > 0) {
+			char name[KNOT_DNAME_MAXLEN * 4];
+			int len = 0;
+			while ((len = next_token(&it, stop, name, sizeof(name))) != 0) {
+				if (len > 0 && add_hint(data, name, addr) == 0) {
+					count += 1;
+				}
 			}
-			name_tok = strtok_r(NULL, " \t\n", &saveptr);
 		}
+		line = eol + 1;
 	}
 
 	DEBUG_MSG(NULL, "loaded %zu hints\n", count);
 	return kr_ok();
 }
 
+static void free_data(struct hints_data *data)
+{
+	if (data) {
+		kr_zonecut_deinit(&data->hints);
+		kr_zonecut_deinit(&data->reverse_hints);
+		mp_delete(data->hints.pool->ctx);
+	}
+}
+
+/** Build a new table off to the side and swap it in, the current one stays on failure. */
 static int load(struct kr_module *module, const char *path)
 {
-	auto_fclose FILE *fp = fopen(path, "r");
-	if (fp == NULL) {
+	auto_close int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
 		DEBUG_MSG(NULL, "reading '%s' failed: %s\n", path, strerror(errno));
 		return kr_error(errno);
 	} else {
 		DEBUG_MSG(NULL, "reading '%s'\n", path);
 	}
+	const char *buf = NULL;
+	if (st.st_size > 0) {
+		buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			DEBUG_MSG(NULL, "reading '%s' failed: %s\n", path, strerror(errno));
+			return kr_error(errno);
+		}
+		madvise((void *)buf, st.st_size, MADV_SEQUENTIAL);
+	}
 
-	/* Create pool and copy itself */
+	/* Create pool and copy itself, size chunks for the file so large ones don't need many */
+	size_t chunk_size = MIN(MAX(st.st_size, 4096), 1024 * 1024);
 	knot_mm_t _pool = {
-		.ctx = mp_new(4096),
+		.ctx = mp_new(chunk_size),
 		.alloc = (knot_mm_alloc_t) mp_alloc
 	};
 	knot_mm_t *pool = mm_alloc(&_pool, sizeof(*pool));
-	if (!pool) {
+	struct hints_data *data = pool ? mm_alloc(&_pool, sizeof(*data)) : NULL;
+	if (!data) {
+		mp_delete(_pool.ctx);
+		if (buf) {
+			munmap((void *)buf, st.st_size);
+		}
 		return kr_error(ENOMEM);
 	}
 	memcpy(pool, &_pool, sizeof(*pool));
 
 	/* Load file to map */
-	struct kr_zonecut *hints = mm_alloc(pool, sizeof(*hints));
-	kr_zonecut_init(hints, (const uint8_t *)(""), pool);
-	module->data = hints;
-	return load_map(hints, fp);
+	kr_zonecut_init(&data->hints, (const uint8_t *)(""), pool);
+	kr_zonecut_init(&data->reverse_hints, (const uint8_t *)(""), pool);
+	int ret = load_map(data, buf, buf ? st.st_size : 0);
+	if (buf) {
+		munmap((void *)buf, st.st_size);
+	}
+	if (ret != 0) {
+		free_data(data);
+		return ret;
+	}
+	free_data(module->data);
+	module->data = data;
+	return kr_ok();
 }
 
 static void unload(struct kr_module *module)
 {
-	struct kr_zonecut *hints = module->data;
-	if (hints) {
-		kr_zonecut_deinit(hints);
-		mp_delete(hints->pool->ctx);
-		module->data = NULL;
-	}
+	free_data(module->data);
+	module->data = NULL;
 }
 
 /**
@@ -311,14 +378,14 @@ static void unload(struct kr_module *module)
  */
 static char* hint_set(void *env, struct kr_module *module, const char *args)
 {
-	struct kr_zonecut *hints = module->data;
+	struct hints_data *data = module->data;
 	auto_free char *args_copy = strdup(args);
 
 	int ret = -1;
 	char *addr = strchr(args_copy, ' ');
 	if (addr) {
 		*addr = '\0';
-		ret = add_pair(hints, args_copy, addr + 1);
+		ret = add_hint(data, args_copy, addr + 1);
 	}
 
 	char *result = NULL;
@@ -353,11 +420,11 @@ static JsonNode *pack_addrs(pack_t *pack)
  */
 static char* hint_get(void *env, struct kr_module *module, const char *args)
 {
-	struct kr_zonecut *hints = module->data;
+	struct hints_data *data = module->data;
 	knot_dname_t key[KNOT_DNAME_MAXLEN];
 	pack_t *pack = NULL;
 	if (knot_dname_from_str(key, args, sizeof(key))) {
-		pack = kr_zonecut_find(hints, key);
+		pack = kr_zonecut_find(&data->hints, key);
 	}
 	if (!pack || pack->len == 0) {
 		return NULL;
@@ -452,7 +519,6 @@ int hints_init(struct kr_module *module)
 KR_EXPORT
 int hints_config(struct kr_module *module, const char *conf)
 {
-	unload(module);
 	if (!conf || strlen(conf) < 1) {
 		conf = DEFAULT_FILE;
 	}
@@ -1,18 +1,32 @@
 local cqueues = require('cqueues')
+local histogram = require('histogram')
 local snapshots, snapshots_count = {}, 120
 
 -- Gauge metrics
 local gauges = {
 	['worker.concurrent'] = true,
 	['worker.rss']        = true,
+	['predict.epoch']     = true,
+	['predict.queue']     = true,
+	['predict.inflight']  = true,
+	['predict.learned']   = true,
+}
+
+-- Metrics that are the same in all workers, merged as maximum instead of sum
+local shared = {
+	['predict.epoch'] = true,
 }
 
 local function merge(t, results, prefix)
 	for _, result in pairs(results) do
 		if type(result) == 'table' then
 			for k, v in pairs(result) do
-				local val = t[prefix..k]
-				t[prefix..k] = (val or 0) + v
+				local key, val = prefix..k, t[prefix..k]
+				if shared[key] then
+					t[key] = math.max(val or 0, v)
+				else
+					t[key] = (val or 0) + v
+				end
 			end
 		end
 	end
@@ -23,6 +37,7 @@ local function getstats()
 	merge(t, map 'stats.list()', '')
 	merge(t, map 'cache.stats()', 'cache.')
 	merge(t, map 'worker.stats()', 'worker.')
+	merge(t, map 'predict and predict.stats()', 'predict.')
 	return t
 end
 
@@ -33,6 +48,7 @@ end
 -- Function to sort frequency list
 local function snapshot_start(h, ws)
 	local ok, prev = true, getstats()
+	local prev_upstreams = {}
 	while snapshots_count do
 		local is_empty = true
 		-- Get current snapshot
@@ -46,21 +62,28 @@ local function snapshot_start(h, ws)
 			is_empty = is_empty and stats_dt[k] == 0
 		end
 		prev = cur
-		-- Calculate upstreams and geotag them if possible
+		-- Calculate upstreams answering since the last snapshot and geotag them if possible
 		local upstreams
 		if http.geoip then
-			upstreams = stats.upstreams()
-			for k,v in pairs(upstreams) do
+			local counters = stats.upstreams()
+			upstreams = {}
+			for k,v in pairs(counters) do
+				local last = prev_upstreams[k]
+				local queries = v.count - (last and last.count or 0)
 				local gi
-				if string.find(k, '.', 1, true) then
-					gi = http.geoip:search_ipv4(k)
-				else
-					gi = http.geoip:search_ipv6(k)
+				if queries > 0 then
+					if string.find(k, '.', 1, true) then
+						gi = http.geoip:search_ipv4(k)
+					else
+						gi = http.geoip:search_ipv6(k)
+					end
 				end
 				if gi then
-					upstreams[k] = {data=v, location=gi.location, country=gi.country and gi.country.iso_code}
+					local rtt = (v.rtt.sum - (last and last.rtt.sum or 0)) / queries / 1000
+					upstreams[k] = {queries=queries, rtt=rtt, location=gi.location, country=gi.country and gi.country.iso_code}
 				end
 			end
+			prev_upstreams = counters
 		end
 		-- Aggregate per-worker metrics
 		local wdata = {}
@@ -106,37 +129,120 @@ local function stream_stats(h, ws)
 	end
 end
 
+-- Aggregate latency histograms from all workers
+local function getlatency()
+	local t = { total = {}, qtype = {}, rcode = {}, cache = {}, transport = {} }
+	for _, result in pairs(map 'stats.latency()') do
+		if type(result) == 'table' and result.total then
+			histogram.merge(t.total, result.total)
+			for group, hists in pairs(result) do
+				if group ~= 'total' and t[group] then
+					for k, hist in pairs(hists) do
+						t[group][k] = t[group][k] or {}
+						histogram.merge(t[group][k], hist)
+					end
+				end
+			end
+		end
+	end
+	return t
+end
+
+-- Static bucket bounds of stats histograms, they're the same in all workers
+local bounds = nil
+local function getbounds()
+	if not bounds and stats then
+		bounds = stats.bounds()
+		-- Labels are exact bounds in milliseconds, so they're the same on each scrape
+		for _, list in pairs(bounds) do
+			list.labels = {}
+			for i, max in ipairs(list) do
+				list.labels[i] = string.format('%.3f', max / 1000):gsub('%.?0+$', '')
+			end
+		end
+	end
+	return bounds or { latency = {}, rtt = {} }
+end
+
+-- Render latency histogram in milliseconds, every bucket is exported including the empty ones
+local function render_hist(render, name, label, hist, list)
+	local prefix = label and (label .. ',') or ''
+	local count = 0
+	for i, max in ipairs(list) do
+		count = count + (hist.buckets and hist.buckets[max] or 0)
+		table.insert(render, string.format('%s_bucket{%sle="%s"} %f', name, prefix, list.labels[i], count))
+	end
+	local labels = label and ('{' .. label .. '}') or ''
+	table.insert(render, string.format('%s_bucket{%sle="+Inf"} %f', name, prefix, hist.count or 0))
+	table.insert(render, string.format('%s_count%s %f', name, labels, hist.count or 0))
+	table.insert(render, string.format('%s_sum%s %f', name, labels, (hist.sum or 0) / 1000))
+end
+
+-- Aggregate upstream counters from all workers
+local function getupstreams()
+	local t = {}
+	for _, result in pairs(map 'stats.upstreams()') do
+		if type(result) == 'table' then
+			for addr, v in pairs(result) do
+				local u = t[addr]
+				if not u then
+					u = { count = 0, timeouts = 0, tcp = 0, rcode = {}, rtt = {} }
+					t[addr] = u
+				end
+				u.count = u.count + v.count
+				u.timeouts = u.timeouts + v.timeouts
+				u.tcp = u.tcp + v.tcp
+				for rcode, count in pairs(v.rcode) do
+					u.rcode[rcode] = (u.rcode[rcode] or 0) + count
+				end
+				histogram.merge(u.rtt, v.rtt)
+			end
+		end
+	end
+	return t
+end
+
 -- Render stats in Prometheus text format
 local function serve_prometheus()
 	-- First aggregate metrics list and print counters
 	local slist, render = getstats(), {}
-	local latency = {}
 	local counter = '# TYPE %s counter\n%s %f'
 	for k,v in pairs(slist) do
 		k = select(1, k:gsub('%.', '_'))
-		-- Aggregate histograms
-		local band = k:match('answer_([%d]+)ms')
-		if band then
-			table.insert(latency, {band, v})
-		elseif k == 'answer_slow' then
-			table.insert(latency, {'+Inf', v})
-		-- Counter as a fallback
-		else table.insert(render, string.format(counter, k, k, v)) end
+		-- Fixed latency bands are superseded by latency histograms
+		if not k:match('answer_[%d]+ms') and k ~= 'answer_slow' then
+			table.insert(render, string.format(counter, k, k, v))
+		end
 	end
-	-- Fill in latency histogram
-	local function kweight(x) return tonumber(x) or math.huge end
-	table.sort(latency, function (a,b) return kweight(a[1]) < kweight(b[1]) end)
+	-- Fill in latency histograms, total and broken down by each dimension
+	local latency, bounds = getlatency(), getbounds()
 	table.insert(render, '# TYPE latency histogram')
-	local count, sum = 0.0, 0.0
-	for _,e in ipairs(latency) do
-		-- The information about the %Inf bin is lost, so we treat it
-		-- as a timeout (3000ms) for metrics purposes
-		count = count + e[2]
-		sum = sum + e[2] * (math.min(tonumber(e[1]), 3000.0))
-		table.insert(render, string.format('latency_bucket{le=%s} %f', e[1], count))
+	render_hist(render, 'latency', nil, latency.total, bounds.latency)
+	for _, group in ipairs({'qtype', 'rcode', 'cache', 'transport'}) do
+		local name = 'latency_' .. group
+		table.insert(render, string.format('# TYPE %s histogram', name))
+		for k, hist in pairs(latency[group]) do
+			render_hist(render, name, string.format('%s="%s"', group, k), hist, bounds.latency)
+		end
+	end
+	-- Fill in per-upstream counters and RTT histograms
+	local upstreams = getupstreams()
+	for _, name in ipairs({'count', 'timeouts', 'tcp'}) do
+		table.insert(render, string.format('# TYPE upstream_%s counter', name))
+		for addr, u in pairs(upstreams) do
+			table.insert(render, string.format('upstream_%s{addr="%s"} %f', name, addr, u[name]))
+		end
+	end
+	table.insert(render, '# TYPE upstream_rcode counter')
+	for addr, u in pairs(upstreams) do
+		for rcode, count in pairs(u.rcode) do
+			table.insert(render, string.format('upstream_rcode{addr="%s",rcode="%s"} %f', addr, rcode, count))
+		end
+	end
+	table.insert(render, '# TYPE upstream_rtt histogram')
+	for addr, u in pairs(upstreams) do
+		render_hist(render, 'upstream_rtt', string.format('addr="%s"', addr), u.rtt, bounds.rtt)
 	end
-	table.insert(render, string.format('latency_count %f', count))
-	table.insert(render, string.format('latency_sum %f', sum))
 	return table.concat(render, '\n')
 end
 
@@ -196,18 +196,17 @@ $(function() {
 		var maxQueries = 1;
 		for (var key in resp) {
 			var val = resp[key];
-			if ('data' in val) {
-				maxQueries = Math.max(maxQueries, resp[key].data.length)
+			if ('queries' in val) {
+				maxQueries = Math.max(maxQueries, val.queries)
 			}
 		}
 		/* Update bubbles and prune the oldest */
 		for (var key in resp) {
 			var val = resp[key];
-			if (!val.data || !val.location || val.location.longitude == null) {
+			if (!val.queries || !val.location || val.location.longitude == null) {
 				continue;
 			}
-			var sum = val.data.reduce(function(a, b) { return a + b; });
-			var avg = sum / val.data.length;
+			var avg = val.rtt;
 			var geokey = toGeokey(val.location.longitude, val.location.latitude)
 			var found = bubblemap[geokey];
 			if (!found) {
@@ -227,8 +226,8 @@ $(function() {
 			}
 			found.rtt = (found.rtt + avg) / 2.0;
 			found.fillKey = colorBracket(found.rtt);
-			found.queries = found.queries + val.data.length;
-			found.radius = Math.max(5, 15*(val.data.length/maxQueries));
+			found.queries = found.queries + val.queries;
+			found.radius = Math.max(5, 15*(val.queries/maxQueries));
 			found.age = age;
 		}
 		/* Prune bubbles not updated in a while. */
@@ -1,6 +1,8 @@
 # List of built-in modules
 modules_TARGETS := hints \
-                   stats
+                   stats \
+                   dns64 \
+                   predict
 
 # DNS cookies
 ifeq ($(ENABLE_COOKIES),yes)
@@ -22,8 +24,6 @@ modules_TARGETS += ketcd \
                    graphite \
                    policy \
                    view \
-                   predict \
-                   dns64 \
                    renumber \
                    http \
                    daf \
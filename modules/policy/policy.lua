@@ -106,13 +106,20 @@ function policy.all(action)
 	return function(req, query) return action end
 end
 
+-- Compile list of domain names into a suffix set
+local function suffix_set(zone_list)
+	local set = ffi.gc(ffi.C.kr_suffix_new(), ffi.C.kr_suffix_free)
+	for i = 1, #zone_list do
+		ffi.C.kr_suffix_add(set, zone_list[i])
+	end
+	return set
+end
+
 -- Requests which QNAME matches given zone list (i.e. suffix match)
 function policy.suffix(action, zone_list)
-	local AC = require('aho-corasick')
-	local tree = AC.build(zone_list)
+	local set = suffix_set(zone_list)
 	return function(req, query)
-		local match = AC.match(tree, query:name(), false)
-		if match[1] ~= nil then
+		if ffi.C.kr_suffix_match(set, query.sname) ~= nil then
 			return action
 		end
 		return nil
@@ -120,24 +127,9 @@ function policy.suffix(action, zone_list)
 end
 
 -- Check for common suffix first, then suffix match (specialized version of suffix match)
+-- The suffix set lookup is already proportional to QNAME labels, so the common suffix is not needed.
 function policy.suffix_common(action, suffix_list, common_suffix)
-	local common_len = string.len(common_suffix)
-	local suffix_count = #suffix_list
-	return function(req, query)
-		-- Preliminary check
-		local qname = query:name()
-		if not string.find(qname, common_suffix, -common_len, true) then
-			return nil
-		end
-		-- String match
-		for i = 1, suffix_count do
-			local zone = suffix_list[i]
-			if string.find(qname, zone, -string.len(zone), true) then
-				return action
-			end
-		end
-		return nil
-	end
+	return policy.suffix(action, suffix_list)
 end
 
 -- Filter QNAME pattern
@@ -150,49 +142,48 @@ function policy.pattern(action, pattern)
 	end
 end
 
-local function rpz_parse(action, path)
-	local rules = {}
-	local action_map = {
-		-- RPZ Policy Actions
-		['\0'] = action,
-		['\1*\0'] = action, -- deviates from RPZ spec
-		['\012rpz-passthru\0'] = policy.PASS, -- the grammar...
-		['\008rpz-drop\0'] = policy.DROP,
-		['\012rpz-tcp-only\0'] = policy.TC,
-		-- Policy triggers @NYI@
-	}
-	local parser = require('zonefile').new()
-	if not parser:open(path) then error(string.format('failed to parse "%s"', path)) end
-	while parser:parse() do
-		local name = ffi.string(parser.r_owner, parser.r_owner_length)
-		local action = ffi.string(parser.r_data, parser.r_data_length)
-		rules[name] = action_map[action]
-		-- Warn when NYI
-		if #name > 1 and not action_map[action] then
-			print(string.format('[ rpz ] %s:%d: unsupported policy action', path, tonumber(parser.line_counter)))
-		end
-	end
-	return rules
-end
-
 -- Create RPZ from zone file
-local function rpz_zonefile(action, path)
-	local rules = rpz_parse(action, path)
-	collectgarbage()
+-- The rules are compiled into a native map of action indexes in the thread pool,
+-- and swapped in only once complete, so the old rules are kept if reloading fails.
+local function rpz_zonefile(action, path, interval)
+	local f = io.open(path, 'r')
+	if not f then error(string.format('failed to parse "%s"', path)) end
+	f:close()
+	-- Action indexes, see rpz_action() in the daemon
+	local actions = { action, policy.PASS, policy.DROP, policy.TC }
+	local rpz, mtime, loading = nil, 0, false
+	local function load()
+		if loading then return end
+		loading = true
+		worker.rpz_load(path, function (rules, err, modified)
+			loading = false
+			if rules ~= nil then
+				rpz = ffi.gc(ffi.cast('struct kr_rpz *', rules), ffi.C.kr_rpz_free)
+				mtime = modified
+			elseif err then
+				print(string.format('[ rpz ] failed to load "%s": %s', path, err))
+			end
+		end, mtime)
+	end
+	load()
+	if interval then
+		event.recurrent(interval, load)
+	end
 	return function(req, query)
-		local label = query:name()
-		local action = rules[label]
-		while action == nil and string.len(label) > 0 do
-			label = string.sub(label, string.byte(label) + 2)
-			action = rules['\1*'..label]
+		if rpz == nil then
+			return nil
 		end
-		return action
+		local id = ffi.C.kr_rpz_match(rpz, query.sname)
+		if id > 0 then
+			return actions[id]
+		end
+		return nil
 	end
 end
 
 -- RPZ policy set
-function policy.rpz(action, path)
-	return rpz_zonefile(action, path)
+function policy.rpz(action, path, interval)
+	return rpz_zonefile(action, path, interval)
 end
 
 -- Evaluate packet in given rules to determine policy action
@@ -0,0 +1,658 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file predict.c
+ * @brief Prefetching of expiring and periodically used records.
+ *
+ * Records answered from cache close to their expiration (QUERY_EXPIRING) are queued for refresh.
+ * The queue is a binary heap ordered by the expected expiry scaled down by popularity,
+ * so records expiring sooner and asked for more often are refreshed first. Refreshes are issued
+ * continuously while the number of refreshes in flight is below the concurrency budget.
+ *
+ * Uncached queries are also sampled into a log of the current time window (epoch), the names seen
+ * in the same window of the previous period or repeating in the past windows are prefetched
+ * at the beginning of each window.
+ */
+
+#include <time.h>
+#include <uv.h>
+#include <libknot/packet/pkt.h>
+#include <libknot/descriptor.h>
+#include <ccan/json/json.h>
+#include <contrib/cleanup.h>
+
+#include "daemon/engine.h"
+#include "daemon/worker.h"
+#include "lib/module.h"
+#include "lib/layer.h"
+#include "lib/resolve.h"
+#include "lib/rplan.h"
+#include "lib/utils.h"
+
+/* Defaults */
+#define DEFAULT_WINDOW       15   /* Length of the sampling window (minutes) */
+#define DEFAULT_PERIOD       24   /* Number of tracked windows */
+#define DEFAULT_CONCURRENCY  10   /* Maximum number of refreshes in flight */
+#define QUEUE_MAX          4096   /* Maximum number of queued refreshes */
+#define LOG_SIZE           5000   /* Size of the window log */
+#define SAVED_SIZE         5000   /* Size of the table of refreshed records */
+#define SAMPLE_RATE          10   /* Sample 1 in N uncached queries */
+#define EPOCH_CHECK   (60 * 1000) /* Interval of the window change check (ms) */
+
+/** Text key {[4] hex type, owner}, used for queue lookups. */
+#define TEXT_KEY_MAXLEN (4 + KNOT_DNAME_TXT_MAXLEN + 1)
+
+/** @internal LRU hash of sampled names. */
+typedef lru_t(unsigned) namehash_t;
+/** @internal LRU hash of refreshed names, with expiration of the replaced record. */
+typedef lru_t(uint64_t) savedhash_t;
+
+/** Scheduled refresh. */
+struct prefetch {
+	uint64_t prio;      /**< Expected time of need scaled down by popularity (ms), lower goes first. */
+	uint64_t deadline;  /**< Time when the record is needed, i.e. expires (ms). */
+	uint64_t expire;    /**< Expiration of the cached record (ms). */
+	uint32_t hits;      /**< Number of times the record was asked for. */
+	uint32_t pos;       /**< Position in the heap. */
+	uint16_t type;
+	knot_dname_t name[];
+};
+
+typedef array_t(struct prefetch *) prefetch_heap_t;
+
+struct predict_data {
+	struct engine *engine;
+	prefetch_heap_t heap;   /**< Queued refreshes, min-heap ordered by priority. */
+	map_t queued;           /**< Queued refreshes by text key. */
+	map_t inflight;         /**< Issued refreshes by text key. */
+	unsigned pending;       /**< Number of issued refreshes. */
+	savedhash_t *saved;
+	namehash_t **log;       /**< Sampled names, one table per window in period. */
+	uv_timer_t *drain;
+	uv_timer_t *epoch_timer;
+	unsigned window;
+	unsigned period;
+	unsigned concurrency;
+	int epoch;
+	struct {
+		size_t queued;
+		size_t predicted;
+		size_t issued;
+		size_t done;
+		size_t failed;
+		size_t dropped;
+		size_t saved;
+		size_t learned;
+	} stats;
+};
+
+static inline uint64_t now_msec(void)
+{
+	return kr_now_usec() / 1000;
+}
+
+/** @internal Copy the name in lowercase, return its length. */
+static int lower_name(knot_dname_t *dst, const knot_dname_t *name)
+{
+	int len = knot_dname_to_wire(dst, name, KNOT_DNAME_MAXLEN);
+	if (len > 0) {
+		knot_dname_to_lower(dst);
+	}
+	return len;
+}
+
+static void text_key(char *key, uint16_t type, const knot_dname_t *name)
+{
+	sprintf(key, "%04x", type);
+	knot_dname_to_str(key + 4, name, KNOT_DNAME_TXT_MAXLEN);
+}
+
+/** @internal Binary key {[2] type, [1-255] owner}, same as in the stats module. */
+static int bin_key(char *key, uint16_t type, const knot_dname_t *name)
+{
+	memcpy(key, &type, sizeof(type));
+	int key_len = knot_dname_to_wire((uint8_t *)key + sizeof(type), name, KNOT_DNAME_MAXLEN);
+	if (key_len > 0) {
+		return key_len + sizeof(type);
+	}
+	return key_len;
+}
+
+/*
+ * Priority queue of refreshes.
+ */
+
+static inline bool heap_less(const prefetch_heap_t *heap, size_t a, size_t b)
+{
+	return heap->at[a]->prio < heap->at[b]->prio;
+}
+
+static inline void heap_swap(prefetch_heap_t *heap, size_t a, size_t b)
+{
+	struct prefetch *tmp = heap->at[a];
+	heap->at[a] = heap->at[b];
+	heap->at[b] = tmp;
+	heap->at[a]->pos = a;
+	heap->at[b]->pos = b;
+}
+
+static void heap_up(prefetch_heap_t *heap, size_t i)
+{
+	while (i > 0 && heap_less(heap, i, (i - 1) / 2)) {
+		heap_swap(heap, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_down(prefetch_heap_t *heap, size_t i)
+{
+	for (;;) {
+		size_t min = i, left = 2 * i + 1, right = 2 * i + 2;
+		if (left < heap->len && heap_less(heap, left, min)) {
+			min = left;
+		}
+		if (right < heap->len && heap_less(heap, right, min)) {
+			min = right;
+		}
+		if (min == i) {
+			break;
+		}
+		heap_swap(heap, i, min);
+		i = min;
+	}
+}
+
+static struct prefetch *heap_pop(prefetch_heap_t *heap)
+{
+	struct prefetch *top = heap->at[0];
+	heap->at[0] = array_tail(*heap);
+	heap->at[0]->pos = 0;
+	array_pop(*heap);
+	if (heap->len > 0) {
+		heap_down(heap, 0);
+	}
+	return top;
+}
+
+/** @internal Records needed sooner and more popular have lower priority value. */
+static uint64_t prefetch_prio(const struct prefetch *entry, uint64_t now)
+{
+	uint64_t remaining = entry->deadline > now ? entry->deadline - now : 0;
+	return now + remaining / MAX(entry->hits, 1);
+}
+
+/** Queue refresh of the record or bump the queued one, the name must be lowercase. */
+static void prefetch_push(struct predict_data *data, const knot_dname_t *name, uint16_t type,
+                          uint64_t now, uint64_t deadline, uint64_t expire, unsigned hits)
+{
+	char key[TEXT_KEY_MAXLEN];
+	text_key(key, type, name);
+	if (map_contains(&data->inflight, key)) {
+		return;
+	}
+	struct prefetch *entry = map_get(&data->queued, key);
+	if (entry) {
+		entry->hits += hits;
+		entry->deadline = MIN(entry->deadline, deadline);
+		entry->expire = MIN(entry->expire, expire);
+		entry->prio = prefetch_prio(entry, now);
+		heap_up(&data->heap, entry->pos);
+		heap_down(&data->heap, entry->pos);
+		return;
+	}
+	if (data->heap.len >= QUEUE_MAX) {
+		data->stats.dropped += 1;
+		return;
+	}
+	size_t name_len = knot_dname_size(name);
+	entry = malloc(sizeof(*entry) + name_len);
+	if (!entry) {
+		return;
+	}
+	entry->deadline = deadline;
+	entry->expire = expire;
+	entry->hits = hits;
+	entry->type = type;
+	entry->prio = prefetch_prio(entry, now);
+	memcpy(entry->name, name, name_len);
+	if (array_push(data->heap, entry) < 0) {
+		free(entry);
+		return;
+	}
+	if (map_set(&data->queued, key, entry) != 0) {
+		array_pop(data->heap);
+		free(entry);
+		return;
+	}
+	entry->pos = data->heap.len - 1;
+	heap_up(&data->heap, entry->pos);
+	data->stats.queued += 1;
+}
+
+/** Issue the refresh, it's finished in the layer when the resolution ends. */
+static int prefetch_issue(struct predict_data *data, struct prefetch *entry)
+{
+	struct worker_ctx *worker = uv_default_loop()->data;
+	knot_pkt_t *pkt = knot_pkt_new(NULL, KNOT_EDNS_MAX_UDP_PAYLOAD, NULL);
+	if (!pkt) {
+		return kr_error(ENOMEM);
+	}
+	knot_pkt_put_question(pkt, entry->name, KNOT_CLASS_IN, entry->type);
+	knot_wire_set_rd(pkt->wire);
+	pkt->opt_rr = knot_rrset_copy(data->engine->resolver.opt_rr, NULL);
+	char key[TEXT_KEY_MAXLEN];
+	text_key(key, entry->type, entry->name);
+	int ret = map_set(&data->inflight, key, entry);
+	if (ret == 0) {
+		data->pending += 1;
+		data->stats.issued += 1;
+		ret = worker_resolve(worker, pkt, QUERY_NO_CACHE, NULL, NULL);
+		/* Failed resolution is finished by the layer too, only the refresh that didn't start is left. */
+		if (ret != 0 && map_contains(&data->inflight, key)) {
+			map_del(&data->inflight, key);
+			data->pending -= 1;
+		} else {
+			ret = kr_ok();
+		}
+	}
+	knot_rrset_free(&pkt->opt_rr, NULL);
+	knot_pkt_free(&pkt);
+	return ret;
+}
+
+/** Issue queued refreshes up to the concurrency budget. */
+static void drain(uv_timer_t *handle)
+{
+	struct predict_data *data = handle->data;
+	char key[TEXT_KEY_MAXLEN];
+	while (data->pending < data->concurrency && data->heap.len > 0) {
+		struct prefetch *entry = heap_pop(&data->heap);
+		text_key(key, entry->type, entry->name);
+		map_del(&data->queued, key);
+		if (prefetch_issue(data, entry) != 0) {
+			data->stats.failed += 1;
+			free(entry);
+		}
+	}
+}
+
+/** Schedule draining in the next loop iteration, refreshes may be finished in the middle of resolution. */
+static void drain_schedule(struct predict_data *data)
+{
+	if (data->heap.len > 0 && data->pending < data->concurrency &&
+	    !uv_is_active((uv_handle_t *)data->drain)) {
+		uv_timer_start(data->drain, drain, 0, 0);
+	}
+}
+
+/** Finish the refresh and remember the refreshed record. */
+static void prefetch_finish(struct predict_data *data, struct kr_request *req, int state)
+{
+	const knot_dname_t *qname = req->answer ? knot_pkt_qname(req->answer) : NULL;
+	knot_dname_t name[KNOT_DNAME_MAXLEN];
+	if (!qname || lower_name(name, qname) <= 0) {
+		return;
+	}
+	char key[TEXT_KEY_MAXLEN];
+	uint16_t type = knot_pkt_qtype(req->answer);
+	text_key(key, type, name);
+	struct prefetch *entry = map_get(&data->inflight, key);
+	if (!entry) {
+		return; /* Not a refresh */
+	}
+	map_del(&data->inflight, key);
+	data->pending -= 1;
+	if (state & KR_STATE_FAIL) {
+		data->stats.failed += 1;
+	} else {
+		data->stats.done += 1;
+		/* Cache hits after the expiration of the replaced record are saved by the refresh */
+		char bkey[sizeof(uint16_t) + KNOT_DNAME_MAXLEN];
+		int bkey_len = bin_key(bkey, type, name);
+		uint64_t *expire = bkey_len > 0 ? lru_get_new(data->saved, bkey, bkey_len) : NULL;
+		if (expire) {
+			*expire = MAX(entry->expire, 1);
+		}
+	}
+	free(entry);
+	drain_schedule(data);
+}
+
+/** Count the cache hit if it's saved by the refresh. */
+static void collect_saved(struct predict_data *data, const knot_dname_t *name, uint16_t type, uint64_t now)
+{
+	char key[sizeof(uint16_t) + KNOT_DNAME_MAXLEN];
+	int key_len = bin_key(key, type, name);
+	uint64_t *expire = key_len > 0 ? lru_get_try(data->saved, key, key_len) : NULL;
+	if (expire && *expire > 0 && *expire <= now) {
+		data->stats.saved += 1;
+		*expire = 0;
+	}
+}
+
+static void collect_sample(struct predict_data *data, const knot_dname_t *name, uint16_t type)
+{
+	char key[sizeof(uint16_t) + KNOT_DNAME_MAXLEN];
+	int key_len = bin_key(key, type, name);
+	unsigned *count = key_len > 0 ? lru_get_new(data->log[data->epoch], key, key_len) : NULL;
+	if (count) {
+		if (*count == 0) {
+			data->stats.learned += 1;
+		}
+		*count += 1;
+	}
+}
+
+static int collect(kr_layer_t *ctx)
+{
+	struct kr_request *req = ctx->req;
+	struct kr_module *module = ctx->api->data;
+	struct predict_data *data = module->data;
+	if (!data) {
+		return ctx->state;
+	}
+	/* Internal requests are either refreshes or not interesting */
+	if (!req->qsource.addr) {
+		prefetch_finish(data, req, ctx->state);
+		return ctx->state;
+	}
+	const uint64_t now = now_msec();
+	struct kr_rplan *rplan = &req->rplan;
+	knot_dname_t name[KNOT_DNAME_MAXLEN];
+	for (size_t i = 0; i < rplan->resolved.len; ++i) {
+		struct kr_query *qry = rplan->resolved.at[i];
+		if (lower_name(name, qry->sname) <= 0) {
+			continue;
+		}
+		if (qry->flags & QUERY_EXPIRING) {
+			uint64_t expire = now + 1000 * (uint64_t)qry->expiring_ttl;
+			prefetch_push(data, name, qry->stype, now, expire, expire, 1);
+		} else if (qry->flags & QUERY_CACHED) {
+			collect_saved(data, name, qry->stype, now);
+		} else if (data->epoch >= 0 && kr_rand_uint(SAMPLE_RATE) == 0) {
+			collect_sample(data, name, qry->stype);
+		}
+	}
+	drain_schedule(data);
+	return ctx->state;
+}
+
+/*
+ * Prediction of periodic queries.
+ */
+
+/** @internal Return the current window in period, or -1 if prediction is disabled. */
+static int current_epoch(const struct predict_data *data)
+{
+	if (data->period <= 1 || data->window == 0) {
+		return -1;
+	}
+	time_t now = time(NULL);
+	struct tm tm;
+	if (!localtime_r(&now, &tm)) {
+		return -1;
+	}
+	return ((tm.tm_hour * 60 + tm.tm_min) / data->window) % data->period;
+}
+
+struct predict_baton {
+	struct predict_data *data;
+	namehash_t *past;   /**< Only names also present in this log are queued (optional). */
+	uint64_t now;
+	uint64_t deadline;
+};
+
+static enum lru_apply_do queue_logged(const char *key, uint len, unsigned *val, void *baton)
+{
+	struct predict_baton *ctx = baton;
+	if (ctx->past && !lru_get_try(ctx->past, key, len)) {
+		return LRU_APPLY_DO_NOTHING;
+	}
+	uint16_t type = 0;
+	memcpy(&type, key, sizeof(type));
+	/* The names aren't expected in cache, any later hit is saved by the refresh */
+	prefetch_push(ctx->data, (const knot_dname_t *)key + sizeof(type), type,
+	              ctx->now, ctx->deadline, ctx->now, *val);
+	ctx->data->stats.predicted += 1;
+	return LRU_APPLY_DO_NOTHING;
+}
+
+/** Predict names for the new window, and start sampling it. */
+static void on_epoch(uv_timer_t *handle)
+{
+	struct predict_data *data = handle->data;
+	int epoch = current_epoch(data);
+	if (epoch < 0 || epoch == data->epoch) {
+		return;
+	}
+	data->epoch = epoch;
+	data->stats.learned = 0;
+	const unsigned period = data->period;
+	struct predict_baton baton = {
+		.data = data,
+		.past = NULL,
+		.now = now_msec(),
+		.deadline = now_msec() + data->window * 60 * 1000,
+	};
+	/* Names seen in this window of the previous period */
+	lru_apply(data->log[epoch], queue_logged, &baton);
+	lru_reset(data->log[epoch]);
+	/* Names repeating in past windows */
+	for (unsigned i = 1; i < period / 2; ++i) {
+		baton.past = data->log[(epoch + 2 * period - 2 * i) % period];
+		lru_apply(data->log[(epoch + period - i) % period], queue_logged, &baton);
+	}
+	drain_schedule(data);
+}
+
+static void log_free(struct predict_data *data)
+{
+	uv_timer_stop(data->epoch_timer);
+	if (data->log) {
+		for (unsigned i = 0; i < data->period; ++i) {
+			lru_free(data->log[i]);
+		}
+		free(data->log);
+		data->log = NULL;
+	}
+	data->epoch = -1;
+}
+
+static int log_create(struct predict_data *data)
+{
+	int epoch = current_epoch(data);
+	if (epoch < 0) {
+		return kr_ok();
+	}
+	data->log = calloc(data->period, sizeof(*data->log));
+	if (!data->log) {
+		return kr_error(ENOMEM);
+	}
+	for (unsigned i = 0; i < data->period; ++i) {
+		lru_create(&data->log[i], LOG_SIZE, NULL, NULL);
+		if (!data->log[i]) {
+			log_free(data);
+			return kr_error(ENOMEM);
+		}
+	}
+	data->epoch = epoch;
+	uv_timer_start(data->epoch_timer, on_epoch, EPOCH_CHECK, EPOCH_CHECK);
+	return kr_ok();
+}
+
+static int free_inflight(const char *key, void *val, void *baton)
+{
+	free(val);
+	return 0;
+}
+
+/**
+ * Show prefetching counters.
+ *
+ * Output: { epoch, queue, inflight, queued, predicted, issued, done, failed, dropped, saved, learned }
+ */
+static char* dump_stats(void *env, struct kr_module *module, const char *args)
+{
+	struct predict_data *data = module->data;
+	JsonNode *root = json_mkobject();
+	if (data->epoch >= 0) {
+		json_append_member(root, "epoch", json_mknumber(data->epoch));
+	}
+	json_append_member(root, "queue", json_mknumber(data->heap.len));
+	json_append_member(root, "inflight", json_mknumber(data->pending));
+	json_append_member(root, "queued", json_mknumber(data->stats.queued));
+	json_append_member(root, "predicted", json_mknumber(data->stats.predicted));
+	json_append_member(root, "issued", json_mknumber(data->stats.issued));
+	json_append_member(root, "done", json_mknumber(data->stats.done));
+	json_append_member(root, "failed", json_mknumber(data->stats.failed));
+	json_append_member(root, "dropped", json_mknumber(data->stats.dropped));
+	json_append_member(root, "saved", json_mknumber(data->stats.saved));
+	json_append_member(root, "learned", json_mknumber(data->stats.learned));
+	char *ret = json_encode(root);
+	json_delete(root);
+	return ret;
+}
+
+/*
+ * Module implementation.
+ */
+
+KR_EXPORT
+const kr_layer_api_t *predict_layer(struct kr_module *module)
+{
+	static kr_layer_api_t _layer = {
+		.finish = &collect,
+	};
+	/* Store module reference */
+	_layer.data = module;
+	return &_layer;
+}
+
+KR_EXPORT
+int predict_init(struct kr_module *module)
+{
+	struct predict_data *data = malloc(sizeof(*data));
+	if (!data) {
+		return kr_error(ENOMEM);
+	}
+	memset(data, 0, sizeof(*data));
+	data->engine = module->data;
+	data->window = DEFAULT_WINDOW;
+	data->period = DEFAULT_PERIOD;
+	data->concurrency = DEFAULT_CONCURRENCY;
+	data->epoch = -1;
+	array_init(data->heap);
+	data->queued = map_make();
+	data->inflight = map_make();
+	lru_create(&data->saved, SAVED_SIZE, NULL, NULL);
+	data->drain = malloc(sizeof(*data->drain));
+	data->epoch_timer = malloc(sizeof(*data->epoch_timer));
+	if (!data->saved || !data->drain || !data->epoch_timer) {
+		lru_free(data->saved);
+		free(data->drain);
+		free(data->epoch_timer);
+		free(data);
+		return kr_error(ENOMEM);
+	}
+	uv_timer_init(uv_default_loop(), data->drain);
+	uv_timer_init(uv_default_loop(), data->epoch_timer);
+	data->drain->data = data;
+	data->epoch_timer->data = data;
+	module->data = data;
+	return log_create(data);
+}
+
+/**
+ * Reconfigure the predictor, all parameters are optional.
+ *
+ * Input: { window: <minutes>, period: <windows>, concurrency: <refreshes in flight> }
+ */
+KR_EXPORT
+int predict_config(struct kr_module *module, const char *conf)
+{
+	struct predict_data *data = module->data;
+	if (!conf || strlen(conf) < 1) {
+		return kr_ok();
+	}
+	JsonNode *root = json_decode(conf);
+	if (!root || root->tag != JSON_OBJECT) {
+		kr_log_error("[predict] invalid configuration '%s'\n", conf);
+		json_delete(root);
+		return kr_error(EINVAL);
+	}
+	unsigned window = data->window, period = data->period;
+	JsonNode *node = json_find_member(root, "window");
+	if (node && node->tag == JSON_NUMBER && node->number_ >= 0) {
+		window = node->number_;
+	}
+	node = json_find_member(root, "period");
+	if (node && node->tag == JSON_NUMBER && node->number_ >= 0) {
+		period = node->number_;
+	}
+	node = json_find_member(root, "concurrency");
+	if (node && node->tag == JSON_NUMBER && node->number_ >= 1) {
+		data->concurrency = node->number_;
+	}
+	json_delete(root);
+	/* Restart prediction with new window logs */
+	int ret = kr_ok();
+	if (window != data->window || period != data->period) {
+		log_free(data);
+		data->window = window;
+		data->period = period;
+		data->stats.learned = 0;
+		ret = log_create(data);
+	}
+	drain_schedule(data);
+	return ret;
+}
+
+KR_EXPORT
+int predict_deinit(struct kr_module *module)
+{
+	struct predict_data *data = module->data;
+	if (data) {
+		log_free(data);
+		/* Handles are freed by the loop, libc free() outlives the module */
+		uv_close((uv_handle_t *)data->drain, (uv_close_cb)free);
+		uv_close((uv_handle_t *)data->epoch_timer, (uv_close_cb)free);
+		for (size_t i = 0; i < data->heap.len; ++i) {
+			free(data->heap.at[i]);
+		}
+		array_clear(data->heap);
+		map_clear(&data->queued);
+		/* Refreshes in flight are forgotten, the layer is gone with the module */
+		map_walk(&data->inflight, free_inflight, NULL);
+		map_clear(&data->inflight);
+		lru_free(data->saved);
+		free(data);
+		module->data = NULL;
+	}
+	return kr_ok();
+}
+
+KR_EXPORT
+struct kr_prop *predict_props(void)
+{
+	static struct kr_prop prop_list[] = {
+	    { &dump_stats, "stats", "Show prefetching counters.", },
+	    { NULL, NULL, NULL }
+	};
+	return prop_list;
+}
+
+KR_MODULE_EXPORT(predict);
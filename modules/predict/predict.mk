@@ -1,2 +1,9 @@
-predict_SOURCES := predict.lua
-$(call make_lua_module,predict)
+predict_CFLAGS := -fvisibility=hidden -fPIC
+predict_SOURCES := modules/predict/predict.c
+predict_DEPEND := $(libkres)
+predict_LIBS := $(contrib_TARGET) $(libkres_TARGET) $(libkres_LIBS) $(libuv_LIBS)
+# Refreshes are issued by the daemon worker
+ifeq ($(PLATFORM),Darwin)
+predict_LDFLAGS := -undefined dynamic_lookup
+endif
+$(call make_c_module,predict)
\ No newline at end of file
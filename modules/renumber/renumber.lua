@@ -33,41 +33,70 @@ local function add_prefix(subnet, addr)
 	table.insert(prefixes, matchprefix(subnet, addr))
 end
 
--- Match IP against given subnet or record owner
-local function match_subnet(subnet, bitlen, addrtype, rr)
+-- Index rules by address type, subnet rules go to prefix trees and name rules to tables.
+-- Rules are inserted in reverse, so the first rule wins for duplicate subnets and names.
+local function build_index(tbl)
+	local index = { count = #tbl }
+	for i = #tbl, 1, -1 do
+		local prefix = tbl[i]
+		local by_type = index[prefix[4]]
+		if by_type == nil then
+			by_type = { tree = ffi.gc(ffi.new('lpm_t'), ffi.C.lpm_clear), names = {} }
+			index[prefix[4]] = by_type
+		end
+		if prefix[2] then
+			ffi.C.lpm_insert(by_type.tree, ffi.cast('const uint8_t *', prefix[1]), prefix[2], ffi.cast('void *', i))
+		else
+			by_type.names[prefix[1]] = i
+		end
+	end
+	return index
+end
+
+-- Find the most specific subnet rule for record address, or a rule for record owner
+local function match_rule(index, rr)
+	local by_type = index[rr.type]
+	if by_type == nil then
+		return nil
+	end
 	local addr = rr.rdata
-	return addrtype == rr.type and
-	       ((bitlen and (#addr >= bitlen / 8) and (ffi.C.kr_bitcmp(subnet, addr, bitlen) == 0)) or subnet == rr.owner)
+	local i = ffi.C.lpm_match(by_type.tree, ffi.cast('const uint8_t *', addr), #addr * 8, nil)
+	if i ~= nil then
+		return tonumber(ffi.cast('intptr_t', i))
+	end
+	return by_type.names[rr.owner]
 end
 
 -- Renumber address record
 local addr_buf = ffi.new('char[16]')
-local function renumber_record(tbl, rr)
-	for i = 1, #tbl do
+local function renumber_record(tbl, index, rr)
+	local i = match_rule(index, rr)
+	if i ~= nil then
 		local prefix = tbl[i]
-		-- Match record type to address family and record address to given subnet
-		-- If provided, compare record owner to prefix name
-		if match_subnet(prefix[1], prefix[2], prefix[4], rr) then
-			-- Replace part or whole address
-			local to_copy = prefix[2] or (#prefix[3] * 8)
-			local chunks = to_copy / 8
-			local rdlen = #rr.rdata
-			if rdlen < chunks then return rr end -- Address length mismatch
-			ffi.copy(addr_buf, rr.rdata, rdlen)
-			ffi.copy(addr_buf, prefix[3], chunks)
-			-- @todo: CIDR not supported
-			to_copy = to_copy - chunks * 8
-			rr.rdata = ffi.string(addr_buf, rdlen)
-			return rr
-		end
-	end	
+		-- Replace part or whole address
+		local to_copy = prefix[2] or (#prefix[3] * 8)
+		local chunks = to_copy / 8
+		local rdlen = #rr.rdata
+		if rdlen < chunks then return rr end -- Address length mismatch
+		ffi.copy(addr_buf, rr.rdata, rdlen)
+		ffi.copy(addr_buf, prefix[3], chunks)
+		-- @todo: CIDR not supported
+		to_copy = to_copy - chunks * 8
+		rr.rdata = ffi.string(addr_buf, rdlen)
+		return rr
+	end
 	return nil
 end
 
 -- Renumber addresses based on config
 local function rule(prefixes)
+	local index = nil
 	return function (state, req)
 		if state == kres.FAIL then return state end
+		-- Rebuild index when rules were added
+		if index == nil or index.count ~= #prefixes then
+			index = build_index(prefixes)
+		end
 		req = kres.request_t(req)
 		pkt = kres.pkt_t(req.answer)
 		-- Only successful answers
@@ -79,7 +108,7 @@ local function rule(prefixes)
 		for i = 1, ancount do
 			local rr = records[i]
 			if rr.type == kres.type.A or rr.type == kres.type.AAAA then
-				local new_rr = renumber_record(prefixes, rr)
+				local new_rr = renumber_record(prefixes, index, rr)
 				if new_rr ~= nil then
 					records[i] = new_rr
 					changed = true
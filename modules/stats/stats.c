@@ -28,11 +28,13 @@
 #include <contrib/cleanup.h>
 #include <arpa/inet.h>
 
+#include "daemon/engine.h"
 #include "lib/layer/iterate.h"
 #include "lib/rplan.h"
 #include "lib/module.h"
 #include "lib/layer.h"
 #include "lib/resolve.h"
+#include "lib/dnssec/signature.h"
 
 /** @internal Compatibility wrapper for Lua < 5.2 */
 #if LUA_VERSION_NUM < 502
@@ -48,7 +50,7 @@
  #define FREQUENT_COUNT  5000 /* Size of frequent tables */ 
 #endif
 #ifndef UPSTREAMS_COUNT
- #define UPSTREAMS_COUNT  512 /* Size of recent upstreams */
+ #define UPSTREAMS_COUNT  512 /* Size of upstream counters table */
 #endif
 
 /** @cond internal Fixed-size map of predefined metrics. */
@@ -57,6 +59,7 @@
 	X(answer,cached) X(answer,1ms) X(answer,10ms) X(answer,50ms) X(answer,100ms) \
 	X(answer,250ms) X(answer,500ms) X(answer,1000ms) X(answer,1500ms) X(answer,slow) \
 	X(query,edns) X(query,dnssec) \
+	X(dnssec,sigcache_hit) X(dnssec,sigcache_miss) \
 	X(const,end)
 
 enum const_metric {
@@ -75,9 +78,91 @@ static struct const_metric_elm const_metrics[] = {
 };
 /** @endcond */
 
+/** @cond internal Log-linear (HDR-like) latency histogram, values are in microseconds.
+ * Values below HIST_SUB_COUNT have exact buckets, each following power of two is split
+ * into HIST_SUB_COUNT buckets, so the bucket width is below 1/16 of its values. */
+#define HIST_SUB_BITS   4
+#define HIST_SUB_COUNT  (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS   26 /* Values up to ~67s, larger values are clamped */
+#define HIST_BUCKETS    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+#define LATENCY_QTYPES(X) \
+	X(A) X(AAAA) X(NS) X(CNAME) X(SOA) X(PTR) X(MX) X(TXT) X(SRV) X(DS) X(DNSKEY) X(ANY)
+#define LATENCY_RCODES(X) \
+	X(noerror) X(nodata) X(nxdomain) X(servfail) X(refused)
+
+enum latency_qtype {
+	#define X(a) latency_qtype_ ## a,
+	LATENCY_QTYPES(X)
+	#undef X
+	latency_qtype_other,
+	latency_qtype_end
+};
+static const char *latency_qtype_names[] = {
+	#define X(a) [latency_qtype_ ## a] = #a,
+	LATENCY_QTYPES(X)
+	#undef X
+	[latency_qtype_other] = "other",
+};
+
+enum latency_rcode {
+	#define X(a) latency_rcode_ ## a,
+	LATENCY_RCODES(X)
+	#undef X
+	latency_rcode_other,
+	latency_rcode_end
+};
+static const char *latency_rcode_names[] = {
+	#define X(a) [latency_rcode_ ## a] = #a,
+	LATENCY_RCODES(X)
+	#undef X
+	[latency_rcode_other] = "other",
+};
+
+/** Upstream answers by rcode, referrals are split from the NOERROR answers without data. */
+enum upstream_rcode {
+	upstream_rcode_referral = latency_rcode_end,
+	upstream_rcode_end
+};
+
+static const char *latency_cache_names[] = { "miss", "hit" };
+static const char *latency_transport_names[] = { "udp", "tcp" };
+
+/** Latency histograms of all answers, and broken down by each dimension. */
+struct latency_data {
+	struct latency_hist total;
+	struct latency_hist qtype[latency_qtype_end];
+	struct latency_hist rcode[latency_rcode_end];
+	struct latency_hist cache[2];
+	struct latency_hist transport[2];
+};
+
+/** Upstream RTT histogram in milliseconds, coarser than the answer latency as it's kept per address. */
+#define RTT_SUB_BITS    2
+#define RTT_MAX_BITS    13 /* RTT up to ~8s, larger values are clamped */
+#define RTT_BUCKETS     ((RTT_MAX_BITS - RTT_SUB_BITS + 1) << RTT_SUB_BITS)
+
+/** Cumulative counters of a single upstream address. */
+struct upstream_stats {
+	uint32_t count;                     /**< Answers received */
+	uint32_t timeouts;                  /**< Queries left without an answer */
+	uint32_t tcp;                       /**< Answers received over TCP */
+	uint32_t rcode[upstream_rcode_end]; /**< Answers by rcode */
+	uint64_t rtt_sum;                   /**< Sum of RTTs in milliseconds */
+	uint32_t rtt[RTT_BUCKETS];          /**< RTT histogram */
+};
+/** @endcond */
+
 /** @internal LRU hash of most frequent names. */
 typedef lru_t(unsigned) namehash_t;
-typedef array_t(struct sockaddr_in6) addrlist_t;
+/** @internal LRU hash of upstream counters, keyed by the address bytes. */
+typedef lru_t(struct upstream_stats) upstream_hash_t;
 
 /** @internal Stats data structure. */
 struct stat_data {
@@ -86,21 +171,110 @@ struct stat_data {
 		namehash_t *frequent;
 		namehash_t *expiring;
 	} queries;
-	struct {
-		addrlist_t q;
-		size_t head;
-	} upstreams;
+	upstream_hash_t *upstreams;
+	struct latency_data latency;
 };
 
-/** @internal We don't store/publish port, repurpose it for RTT instead. */
-#define sin6_rtt sin6_port
-
 /** @internal Add to const map counter */
 static inline void stat_const_add(struct stat_data *data, enum const_metric key, ssize_t incr)
 {
 	const_metrics[key].val += incr;
 }
 
+/** @internal Return log-linear bucket index of the value, with 1 << sub_bits buckets per power of two. */
+static unsigned log_index(uint64_t val, unsigned sub_bits, unsigned max_bits)
+{
+	const uint64_t sub_count = 1ULL << sub_bits;
+	if (val < sub_count) {
+		return val;
+	}
+	if (val >= (1ULL << max_bits)) {
+		return ((max_bits - sub_bits + 1) << sub_bits) - 1;
+	}
+	unsigned shift = (63 - __builtin_clzll(val)) - sub_bits;
+	return ((shift + 1) << sub_bits) + (val >> shift) - sub_count;
+}
+
+/** @internal Return the largest value in the log-linear bucket. */
+static uint64_t log_bucket_max(unsigned i, unsigned sub_bits)
+{
+	const uint64_t sub_count = 1ULL << sub_bits;
+	if (i < sub_count) {
+		return i;
+	}
+	unsigned shift = (i >> sub_bits) - 1;
+	uint64_t sub = i & (sub_count - 1);
+	return ((sub_count + sub + 1) << shift) - 1;
+}
+
+static inline unsigned hist_index(uint64_t val)
+{
+	return log_index(val, HIST_SUB_BITS, HIST_MAX_BITS);
+}
+
+static inline uint64_t hist_bucket_max(unsigned i)
+{
+	return log_bucket_max(i, HIST_SUB_BITS);
+}
+
+static inline void hist_add(struct latency_hist *hist, uint64_t val)
+{
+	hist->count += 1;
+	hist->sum += val;
+	hist->buckets[hist_index(val)] += 1;
+}
+
+static enum latency_qtype latency_qtype(uint16_t type)
+{
+	switch (type) {
+	#define X(a) case KNOT_RRTYPE_ ## a: return latency_qtype_ ## a;
+	LATENCY_QTYPES(X)
+	#undef X
+	default: return latency_qtype_other;
+	}
+}
+
+static enum latency_rcode latency_rcode(const knot_pkt_t *pkt)
+{
+	switch (knot_wire_get_rcode(pkt->wire)) {
+	case KNOT_RCODE_NOERROR:
+		if (knot_wire_get_ancount(pkt->wire) > 0)
+			return latency_rcode_noerror;
+		return latency_rcode_nodata;
+	case KNOT_RCODE_NXDOMAIN: return latency_rcode_nxdomain;
+	case KNOT_RCODE_SERVFAIL: return latency_rcode_servfail;
+	case KNOT_RCODE_REFUSED:  return latency_rcode_refused;
+	default:                  return latency_rcode_other;
+	}
+}
+
+static unsigned upstream_rcode(const knot_pkt_t *pkt)
+{
+	/* Non-authoritative answer without data delegating to the zone cut */
+	if (knot_wire_get_rcode(pkt->wire) == KNOT_RCODE_NOERROR &&
+	    knot_wire_get_ancount(pkt->wire) == 0 && knot_wire_get_nscount(pkt->wire) > 0 &&
+	    !knot_wire_get_aa(pkt->wire)) {
+		return upstream_rcode_referral;
+	}
+	return latency_rcode(pkt);
+}
+
+static void collect_latency(struct stat_data *data, const struct kr_request *req, bool cached, uint64_t elapsed)
+{
+	/* Internal requests (e.g. prefetch) aren't answered to clients */
+	if (!req->qsource.addr) {
+		return;
+	}
+	struct latency_data *latency = &data->latency;
+	const knot_pkt_t *answer = req->answer;
+	const bool tcp = req->qsource.tcp;
+	hist_add(&latency->total, elapsed);
+	hist_add(&latency->qtype[latency_qtype(knot_pkt_qtype(answer))], elapsed);
+	hist_add(&latency->rcode[latency_rcode(answer)], elapsed);
+	hist_add(&latency->cache[cached], elapsed);
+	hist_add(&latency->transport[tcp], elapsed);
+}
+
 static int collect_answer(struct stat_data *data, knot_pkt_t *pkt)
 {
 	stat_const_add(data, metric_answer_total, 1);
@@ -154,6 +328,15 @@ static void collect_sample(struct stat_data *data, struct kr_rplan *rplan, knot_
 	}
 }
 
+/** @internal Return counters of the upstream address, or NULL if it can't be stored. */
+static struct upstream_stats *upstream_get(struct stat_data *data, const struct sockaddr *addr)
+{
+	if (!data->upstreams || (addr->sa_family != AF_INET && addr->sa_family != AF_INET6)) {
+		return NULL;
+	}
+	return lru_get_new(data->upstreams, kr_inaddr(addr), kr_inaddr_len(addr));
+}
+
 static int collect_rtt(kr_layer_t *ctx, knot_pkt_t *pkt)
 {
 	struct kr_request *req = ctx->req;
@@ -162,24 +345,36 @@ static int collect_rtt(kr_layer_t *ctx, knot_pkt_t *pkt)
 		return ctx->state;
 	}
 
-	/* Push address and RTT to the ring buffer head */
+	/* Update counters of the answering upstream */
 	struct kr_module *module = ctx->api->data;
 	struct stat_data *data = module->data;
+	struct upstream_stats *upstream = upstream_get(data, req->upstream.addr);
+	if (!upstream) {
+		return ctx->state;
+	}
+	upstream->count += 1;
+	if (qry->flags & QUERY_TCP) {
+		upstream->tcp += 1;
+	}
+	upstream->rcode[upstream_rcode(pkt)] += 1;
+	upstream->rtt_sum += req->upstream.rtt;
+	upstream->rtt[log_index(req->upstream.rtt, RTT_SUB_BITS, RTT_MAX_BITS)] += 1;
+	return ctx->state;
+}
 
-	/* Socket address is encoded into sockaddr_in6 struct that
-	 * unions with sockaddr_in and differ in sa_family */
-	struct sockaddr_in6 *e = &data->upstreams.q.at[data->upstreams.head];
-	const struct sockaddr *src = req->upstream.addr;
-	switch (src->sa_family) {
-	case AF_INET:  memcpy(e, src, sizeof(struct sockaddr_in)); break;
-	case AF_INET6: memcpy(e, src, sizeof(struct sockaddr_in6)); break;
-	default: return ctx->state;
+static void upstream_timeout(struct stat_data *data, const struct sockaddr *addr)
+{
+	struct upstream_stats *upstream = upstream_get(data, addr);
+	if (upstream) {
+		upstream->timeouts += 1;
 	}
-	/* Replace port number with the RTT information (cap is UINT16_MAX milliseconds) */
-	e->sin6_rtt = req->upstream.rtt;
+}
 
-	/* Advance ring buffer head */
-	data->upstreams.head = (data->upstreams.head + 1) % UPSTREAMS_COUNT;
+static int collect_timeout(kr_layer_t *ctx, const struct sockaddr *addr)
+{
+	/* Called for each address the query was sent to, see kr_resolve_timeout() */
+	struct kr_module *module = ctx->api->data;
+	upstream_timeout(module->data, addr);
 	return ctx->state;
 }
 
@@ -196,10 +391,11 @@ static int collect(kr_layer_t *ctx)
 	/* Count cached and unresolved */
 	if (rplan->resolved.len > 0) {
 		/* Histogram of answer latency. */
-		struct kr_query *first = rplan->resolved.at[0];
-		struct timeval now;
-		gettimeofday(&now, NULL);
-		long elapsed = time_diff(&first->timestamp, &now);
+		struct kr_query *last = array_tail(rplan->resolved);
+		const bool cached = last->flags & QUERY_CACHED;
+		const uint64_t elapsed_us = kr_now_usec() - param->begin_time;
+		collect_latency(data, param, cached, elapsed_us);
+		const uint64_t elapsed = elapsed_us / 1000;
 		if (elapsed <= 1) {
 			stat_const_add(data, metric_answer_1ms, 1);
 		} else if (elapsed <= 10) {
@@ -220,11 +416,16 @@ static int collect(kr_layer_t *ctx)
 			stat_const_add(data, metric_answer_slow, 1);
 		}
 		/* Observe the final query. */
-		struct kr_query *last = array_tail(rplan->resolved);
-		if (last->flags & QUERY_CACHED) {
+		if (cached) {
 			stat_const_add(data, metric_answer_cached, 1);
 		}
 	}
+	/* Signature verification cache counters are kept by the resolver context */
+	const struct kr_sigcache *sigcache = param->ctx->cache_sig;
+	if (sigcache) {
+		const_metrics[metric_dnssec_sigcache_hit].val = sigcache->stats.hit;
+		const_metrics[metric_dnssec_sigcache_miss].val = sigcache->stats.miss;
+	}
 	/* Query parameters and transport mode */
 	if (knot_pkt_has_edns(param->answer)) {
 		stat_const_add(data, metric_query_edns, 1);
@@ -385,38 +586,164 @@ static char* clear_expiring(void *env, struct kr_module *module, const char *arg
 	return NULL;
 }
 
-static char* dump_upstreams(void *env, struct kr_module *module, const char *args)
+static JsonNode *dump_hist(const struct latency_hist *hist)
 {
-	struct stat_data *data = module->data;
-	if (!data) {
-		return NULL;
+	JsonNode *root = json_mkobject();
+	json_append_member(root, "count", json_mknumber(hist->count));
+	json_append_member(root, "sum", json_mknumber(hist->sum));
+	/* Non-empty buckets as [max, count] pairs */
+	JsonNode *buckets = json_mkarray();
+	for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+		if (hist->buckets[i] > 0) {
+			JsonNode *bucket = json_mkarray();
+			json_append_element(bucket, json_mknumber(hist_bucket_max(i)));
+			json_append_element(bucket, json_mknumber(hist->buckets[i]));
+			json_append_element(buckets, bucket);
+		}
 	}
+	json_append_member(root, "buckets", buckets);
+	return root;
+}
 
-	/* Walk the ring backwards until AF_UNSPEC or we hit head. */
-	JsonNode *root = json_mkobject();
-	size_t head = data->upstreams.head;
-	for (size_t i = 1; i < UPSTREAMS_COUNT; ++i) {
-		size_t h = (UPSTREAMS_COUNT + head - i) % UPSTREAMS_COUNT;
-		struct sockaddr_in6 *e = &data->upstreams.q.at[h];
-		if (e->sin6_family == AF_UNSPEC) {
-			break;
+static void dump_hist_group(JsonNode *root, const char *group, const struct latency_hist *hist,
+                            const char **names, size_t count)
+{
+	JsonNode *node = json_mkobject();
+	for (size_t i = 0; i < count; ++i) {
+		if (hist[i].count > 0) {
+			json_append_member(node, names[i], dump_hist(&hist[i]));
 		}
-		/* Convert address to string */
-		char addr_str[INET6_ADDRSTRLEN];
-		const char *ret = inet_ntop(e->sin6_family, kr_inaddr((const struct sockaddr *)e), addr_str, sizeof(addr_str));
-		if (!ret) {
-			break;
+	}
+	json_append_member(root, group, node);
+}
+
+/**
+ * List latency histograms.
+ *
+ * Output: { total: <hist>, qtype: { <qtype>: <hist>, ... }, rcode: { ... }, cache: { ... }, transport: { ... } }
+ *         hist = { count: <answers>, sum: <usec>, buckets: [[<max usec>, <count>], ...] }
+ */
+static char* dump_latency(void *env, struct kr_module *module, const char *args)
+{
+	struct stat_data *data = module->data;
+	struct latency_data *latency = &data->latency;
+	JsonNode *root = json_mkobject();
+	json_append_member(root, "total", dump_hist(&latency->total));
+	dump_hist_group(root, "qtype", latency->qtype, latency_qtype_names, latency_qtype_end);
+	dump_hist_group(root, "rcode", latency->rcode, latency_rcode_names, latency_rcode_end);
+	dump_hist_group(root, "cache", latency->cache, latency_cache_names, 2);
+	dump_hist_group(root, "transport", latency->transport, latency_transport_names, 2);
+	char *ret = json_encode(root);
+	json_delete(root);
+	return ret;
+}
+
+/**
+ * List upper bounds of all histogram buckets, the last bucket is left out as it also holds the clamped values.
+ * The bounds are static, so the buckets can be exported with the same labels regardless of their counts.
+ *
+ * Output: { latency: [<max usec>, ...], rtt: [<max usec>, ...] }
+ */
+static char* dump_bounds(void *env, struct kr_module *module, const char *args)
+{
+	JsonNode *root = json_mkobject();
+	JsonNode *latency = json_mkarray();
+	for (unsigned i = 0; i + 1 < HIST_BUCKETS; ++i) {
+		json_append_element(latency, json_mknumber(hist_bucket_max(i)));
+	}
+	json_append_member(root, "latency", latency);
+	JsonNode *rtt = json_mkarray();
+	for (unsigned i = 0; i + 1 < RTT_BUCKETS; ++i) {
+		json_append_element(rtt, json_mknumber(log_bucket_max(i, RTT_SUB_BITS) * 1000));
+	}
+	json_append_member(root, "rtt", rtt);
+	char *ret = json_encode(root);
+	json_delete(root);
+	return ret;
+}
+
+/** @internal Add RTT estimate of the upstream address. */
+static void dump_upstream_rtt(JsonNode *json_val, kr_nsrep_rtt_lru_t *cache, const struct sockaddr *addr)
+{
+	struct kr_nsrep_rtt *rtt = cache ? lru_get_try(cache, kr_inaddr(addr), kr_inaddr_len(addr)) : NULL;
+	if (rtt && rtt->srtt > 0) {
+		json_append_member(json_val, "srtt", json_mknumber(rtt->srtt));
+		json_append_member(json_val, "rttvar", json_mknumber(rtt->rttvar));
+	}
+	json_append_member(json_val, "rto", json_mknumber(kr_nsrep_rto(cache, addr)));
+}
+
+/** @internal Helper for dump_upstreams: add counters of a single upstream to JSON. */
+static enum lru_apply_do dump_upstream(const char *key, uint len, struct upstream_stats *val, void *baton)
+{
+	struct engine *engine = ((void **)baton)[0];
+	JsonNode *root = ((void **)baton)[1];
+	/* Rebuild the socket address from the key */
+	struct sockaddr_storage ss;
+	struct sockaddr *addr = (struct sockaddr *)&ss;
+	memset(&ss, 0, sizeof(ss));
+	if (len == sizeof(struct in_addr)) {
+		addr->sa_family = AF_INET;
+		memcpy(&((struct sockaddr_in *)addr)->sin_addr, key, len);
+	} else if (len == sizeof(struct in6_addr)) {
+		addr->sa_family = AF_INET6;
+		memcpy(&((struct sockaddr_in6 *)addr)->sin6_addr, key, len);
+	} else {
+		return LRU_APPLY_DO_NOTHING;
+	}
+	char addr_str[INET6_ADDRSTRLEN];
+	if (!inet_ntop(addr->sa_family, key, addr_str, sizeof(addr_str))) {
+		return LRU_APPLY_DO_NOTHING;
+	}
+	JsonNode *json_val = json_mkobject();
+	json_append_member(json_val, "count", json_mknumber(val->count));
+	json_append_member(json_val, "timeouts", json_mknumber(val->timeouts));
+	json_append_member(json_val, "tcp", json_mknumber(val->tcp));
+	JsonNode *rcode = json_mkobject();
+	for (unsigned i = 0; i < latency_rcode_end; ++i) {
+		if (val->rcode[i] > 0) {
+			json_append_member(rcode, latency_rcode_names[i], json_mknumber(val->rcode[i]));
 		}
-		/* Append to map with an array encoding RTTs */
-		JsonNode *json_val = json_find_member(root, addr_str);
-		if (!json_val) {
-			json_val = json_mkarray();
-			json_append_member(root, addr_str, json_val);
+	}
+	if (val->rcode[upstream_rcode_referral] > 0) {
+		json_append_member(rcode, "referral", json_mknumber(val->rcode[upstream_rcode_referral]));
+	}
+	json_append_member(json_val, "rcode", rcode);
+	/* RTT histogram in the same format as latency histograms (microseconds) */
+	JsonNode *rtt = json_mkobject();
+	json_append_member(rtt, "count", json_mknumber(val->count));
+	json_append_member(rtt, "sum", json_mknumber(val->rtt_sum * 1000));
+	JsonNode *buckets = json_mkarray();
+	for (unsigned i = 0; i < RTT_BUCKETS; ++i) {
+		if (val->rtt[i] > 0) {
+			JsonNode *bucket = json_mkarray();
+			json_append_element(bucket, json_mknumber(log_bucket_max(i, RTT_SUB_BITS) * 1000));
+			json_append_element(bucket, json_mknumber(val->rtt[i]));
+			json_append_element(buckets, bucket);
 		}
-		json_append_element(json_val, json_mknumber(e->sin6_rtt));
 	}
+	json_append_member(rtt, "buckets", buckets);
+	json_append_member(json_val, "rtt", rtt);
+	dump_upstream_rtt(json_val, engine->resolver.cache_rtt, addr);
+	json_append_member(root, addr_str, json_val);
+	return LRU_APPLY_DO_NOTHING;
+}
 
-	/* Encode and return */
+/**
+ * List counters of recently seen upstreams.
+ *
+ * Output: { <addr>: { count: <answers>, timeouts: <unanswered>, tcp: <answers over TCP>,
+ *                     rcode: { <rcode>: <answers>, ... }, rtt: <hist>, srtt, rttvar, rto }, ... }
+ */
+static char* dump_upstreams(void *env, struct kr_module *module, const char *args)
+{
+	struct stat_data *data = module->data;
+	if (!data || !data->upstreams) {
+		return NULL;
+	}
+	JsonNode *root = json_mkobject();
+	void *baton[] = { env, root };
+	lru_apply(data->upstreams, dump_upstream, baton);
 	char *ret = json_encode(root);
 	json_delete(root);
 	return ret;
@@ -432,6 +759,7 @@ const kr_layer_api_t *stats_layer(struct kr_module *module)
 	static kr_layer_api_t _layer = {
 		.consume = &collect_rtt,
 		.finish = &collect,
+		.timeout = &collect_timeout,
 	};
 	/* Store module reference */
 	_layer.data = module;
@@ -450,15 +778,7 @@ int stats_init(struct kr_module *module)
 	module->data = data;
 	lru_create(&data->queries.frequent, FREQUENT_COUNT, NULL, NULL);
 	lru_create(&data->queries.expiring, FREQUENT_COUNT, NULL, NULL);
-	/* Initialize ring buffer of recently visited upstreams */
-	array_init(data->upstreams.q);
-	if (array_reserve(data->upstreams.q, UPSTREAMS_COUNT) != 0) {
-		return kr_error(ENOMEM);
-	}
-	for (size_t i = 0; i < UPSTREAMS_COUNT; ++i) {
-		struct sockaddr *sa = (struct sockaddr *)&data->upstreams.q.at[i];
-		sa->sa_family = AF_UNSPEC;
-	}
+	lru_create(&data->upstreams, UPSTREAMS_COUNT, NULL, NULL);
 	return kr_ok();
 }
 
@@ -470,7 +790,7 @@ int stats_deinit(struct kr_module *module)
 		map_clear(&data->map);
 		lru_free(data->queries.frequent);
 		lru_free(data->queries.expiring);
-		array_clear(data->upstreams.q);
+		lru_free(data->upstreams);
 		free(data);
 	}
 	return kr_ok();
@@ -487,7 +807,9 @@ struct kr_prop *stats_props(void)
 	    { &clear_frequent,"clear_frequent", "Clear frequent queries log.", },
 	    { &dump_expiring, "expiring", "List expiring records.", },
 	    { &clear_expiring,"clear_expiring", "Clear expiring records log.", },
-	    { &dump_upstreams,  "upstreams", "List recently seen authoritatives.", },
+	    { &dump_upstreams,  "upstreams", "List counters of recently seen authoritatives.", },
+	    { &dump_latency,  "latency", "List answer latency histograms.", },
+	    { &dump_bounds,   "bounds", "List upper bounds of histogram buckets.", },
 	    { NULL, NULL, NULL }
 	};
 	return prop_list;
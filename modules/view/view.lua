@@ -15,13 +15,35 @@ function view.tsig(view, tsig, policy)
 	view.key[tsig] = policy
 end
 
+-- Subnet trees for source and destination address, one for each family.
+-- Tree values are indexes into view.src and view.dst.
+local trees = { [view.src] = {}, [view.dst] = {} }
+
+-- @function Return subnet tree for given list and address family
+local function subnet_tree(list, family, create)
+	local tree = trees[list][family]
+	if tree == nil and create then
+		tree = ffi.gc(ffi.new('lpm_t'), C.lpm_clear)
+		trees[list][family] = tree
+	end
+	return tree
+end
+
 -- @function View based on source IP subnet.
 function view.addr(view, subnet, policy, dst)
 	local subnet_cd = ffi.new('char[16]')
 	local family = C.kr_straddr_family(subnet)
 	local bitlen = C.kr_straddr_subnet(subnet_cd, subnet)
 	local t = {family, subnet_cd, bitlen, policy}
-	table.insert(dst and view.dst or view.src, t)
+	local list = dst and view.dst or view.src
+	table.insert(list, t)
+	-- The first view added for a subnet takes precedence
+	local tree = subnet_tree(list, family, true)
+	local key = ffi.cast('const uint8_t *', subnet_cd)
+	local matched = ffi.new('unsigned[1]')
+	if C.lpm_match(tree, key, bitlen, matched) == nil or matched[0] ~= bitlen then
+		C.lpm_insert(tree, key, bitlen, ffi.cast('void *', #list))
+	end
 	return t
 end
 
@@ -30,6 +52,19 @@ local function match_subnet(family, subnet, bitlen, addr)
 	return (family == addr:family()) and (C.kr_bitcmp(subnet, addr:ip(), bitlen) == 0)
 end
 
+-- @function Find the most specific subnet in list containing the address
+local function match_list(list, addr)
+	local tree = subnet_tree(list, addr:family())
+	if tree == nil then
+		return nil
+	end
+	local idx = C.lpm_match(tree, ffi.cast('const uint8_t *', addr:ip()), addr:len() * 8, nil)
+	if idx == nil then
+		return nil
+	end
+	return list[tonumber(ffi.cast('intptr_t', idx))][4]
+end
+
 -- @function Find view for given request
 local function evaluate(view, req)
 	local client_key = req.qsource.key
@@ -37,21 +72,9 @@ local function evaluate(view, req)
 	-- Search subnets otherwise
 	if match_cb == nil then
 		if req.qsource.addr ~= nil then
-			for i = 1, #view.src do
-				local pair = view.src[i]
-				if match_subnet(pair[1], pair[2], pair[3], req.qsource.addr) then
-					match_cb = pair[4]
-					break
-				end
-			end
+			match_cb = match_list(view.src, req.qsource.addr)
 		elseif req.qsource.dst_addr ~= nil then
-			for i = 1, #view.dst do
-				local pair = view.dst[i]
-				if match_subnet(pair[1], pair[2], pair[3], req.qsource.dst_addr) then
-					match_cb = pair[4]
-					break
-				end
-			end
+			match_cb = match_list(view.dst, req.qsource.dst_addr)
 		end
 	end
 	return match_cb
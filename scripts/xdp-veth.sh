@@ -0,0 +1,53 @@
+#!/bin/bash
+# Smoke test of the AF_XDP fast path over a veth pair, requires root.
+# Usage: xdp-veth.sh [kresd binary]
+set -e
+
+KRESD=${1:-kresd}
+NS=kresd-xdp
+IF=kxdp0
+PEER=kxdp1
+WORKDIR=$(mktemp -d)
+
+function cleanup {
+	[ -n "${PID}" ] && kill ${PID} 2>/dev/null
+	ip link del ${IF} 2>/dev/null || true
+	ip netns del ${NS} 2>/dev/null || true
+	rm -rf ${WORKDIR}
+}
+trap cleanup EXIT
+
+# Client lives in a separate namespace on the other end of the veth pair.
+ip netns add ${NS}
+ip link add ${IF} type veth peer name ${PEER}
+ip link set ${PEER} netns ${NS}
+ip addr add 192.0.2.1/24 dev ${IF}
+ip -6 addr add 2001:db8::1/64 dev ${IF} nodad
+ip link set ${IF} up
+ip netns exec ${NS} ip addr add 192.0.2.2/24 dev ${PEER}
+ip netns exec ${NS} ip -6 addr add 2001:db8::2/64 dev ${PEER} nodad
+ip netns exec ${NS} ip link set ${PEER} up
+
+# Answer from hints, so the resolver doesn't need any upstream.
+cat > ${WORKDIR}/config <<EOF
+net.listen({'192.0.2.1', '2001:db8::1'})
+assert(net.xdp('${IF}', 53, {generic = true}), 'failed to open AF_XDP socket')
+modules = { 'hints' }
+hints['xdp.test'] = '192.0.2.53'
+EOF
+${KRESD} -f 1 -c ${WORKDIR}/config ${WORKDIR} > ${WORKDIR}/log 2>&1 &
+PID=$!
+sleep 1
+ip link show ${IF} | grep -q xdpgeneric || { cat ${WORKDIR}/log; echo "XDP program not attached"; exit 1; }
+
+for server in 192.0.2.1 2001:db8::1; do
+	for proto in +notcp +tcp; do
+		answer=$(ip netns exec ${NS} dig ${proto} +short +time=1 +tries=1 @${server} xdp.test A)
+		if [ "${answer}" != "192.0.2.53" ]; then
+			cat ${WORKDIR}/log
+			echo "FAIL: ${server} ${proto} got '${answer}'"
+			exit 1
+		fi
+		echo "OK: ${server} ${proto}"
+	done
+done
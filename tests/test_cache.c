@@ -159,11 +159,11 @@ static void test_fake_invalid (void **state)
 	struct kr_cache_entry *entry = NULL;
 	int ret = 0;
 
-	ret = kr_cache_peek(cache, KR_CACHE_USER, dname, KNOT_RRTYPE_TSIG, &entry, 0);
+	ret = kr_cache_peek(cache, KR_CACHE_USER, dname, KNOT_RRTYPE_TSIG, &entry, NULL, 0);
 	assert_int_equal(ret, 0);
 	api_saved = cache->api;
 	cache->api = NULL;
-	ret = kr_cache_peek(cache, KR_CACHE_USER, dname, KNOT_RRTYPE_TSIG, &entry, 0);
+	ret = kr_cache_peek(cache, KR_CACHE_USER, dname, KNOT_RRTYPE_TSIG, &entry, NULL, 0);
 	cache->api = api_saved;
 	assert_int_not_equal(ret, 0);
 }
@@ -201,8 +201,8 @@ static void test_invalid(void **state)
 	knot_rrset_init_empty(&global_rr);
 
 	assert_int_equal(kr_cache_open(NULL, NULL, &opts, &global_mm),KNOT_EINVAL);
-	assert_int_not_equal(kr_cache_peek(NULL, KR_CACHE_USER, dname, KNOT_RRTYPE_TSIG, NULL, &timestamp), 0);
-	assert_int_not_equal(kr_cache_peek(cache, KR_CACHE_USER, NULL, KNOT_RRTYPE_TSIG, &entry, &timestamp), 0);
+	assert_int_not_equal(kr_cache_peek(NULL, KR_CACHE_USER, dname, KNOT_RRTYPE_TSIG, NULL, NULL, &timestamp), 0);
+	assert_int_not_equal(kr_cache_peek(cache, KR_CACHE_USER, NULL, KNOT_RRTYPE_TSIG, &entry, NULL, &timestamp), 0);
 	assert_int_not_equal(kr_cache_peek_rr(NULL, NULL, NULL, NULL, NULL), 0);
 	assert_int_not_equal(kr_cache_peek_rr(cache, NULL, NULL, NULL, NULL), 0);
 	assert_int_not_equal(kr_cache_insert_rr(cache, NULL, 0, 0, 0), 0);
@@ -278,6 +278,43 @@ static void test_query(void **state)
 	}
 }
 
+/* Test lookup of the closest ancestor */
+static void test_query_closest(void **state)
+{
+	struct kr_cache *cache = (*state);
+	const knot_dname_t *apex = (const knot_dname_t *)"\x07example\x02cz";
+	const knot_dname_t *name = (const knot_dname_t *)"\x01a\x01b\x07example\x02cz";
+	uint8_t data[] = { 0xca, 0xfe };
+	struct kr_cache_entry header = { .timestamp = CACHE_TIME, .ttl = CACHE_TTL, .count = sizeof(data) };
+	knot_db_val_t val = { data, sizeof(data) };
+	int ret = kr_cache_insert(cache, KR_CACHE_USER, apex, KNOT_RRTYPE_TSIG, &header, val);
+	assert_int_equal(ret, 0);
+
+	/* Descendant finds the entry at the ancestor */
+	struct kr_cache_entry *entry = NULL;
+	const knot_dname_t *closest = NULL;
+	size_t size = 0;
+	uint32_t timestamp = CACHE_TIME + 1;
+	ret = kr_cache_peek_closest(cache, KR_CACHE_USER, name, KNOT_RRTYPE_TSIG, &entry, &size, &timestamp, &closest);
+	assert_int_equal(ret, 0);
+	assert_true(knot_dname_is_equal(closest, apex));
+	assert_int_equal(timestamp, 1);
+	assert_int_equal(size, sizeof(data));
+	assert_memory_equal(entry->data, data, sizeof(data));
+
+	/* Parent or other type doesn't match */
+	timestamp = CACHE_TIME;
+	ret = kr_cache_peek_closest(cache, KR_CACHE_USER, apex + 8, KNOT_RRTYPE_TSIG, &entry, NULL, &timestamp, &closest);
+	assert_int_equal(ret, kr_error(ENOENT));
+	ret = kr_cache_peek_closest(cache, KR_CACHE_USER, name, KNOT_RRTYPE_TKEY, &entry, NULL, &timestamp, &closest);
+	assert_int_equal(ret, kr_error(ENOENT));
+
+	/* Stale entry is skipped */
+	timestamp = CACHE_TIME + CACHE_TTL + 1;
+	ret = kr_cache_peek_closest(cache, KR_CACHE_USER, name, KNOT_RRTYPE_TSIG, &entry, NULL, &timestamp, &closest);
+	assert_int_equal(ret, kr_error(ENOENT));
+}
+
 /* Test cache read (simulate aged entry) */
 static void test_query_aged(void **state)
 {
@@ -361,6 +398,7 @@ int main(void)
 	        unit_test(test_insert_rr),
 	        unit_test(test_materialize),
 	        unit_test(test_query),
+	        unit_test(test_query_closest),
 	        /* Cache aging */
 	        unit_test(test_query_aged),
 	        /* Removal */
@@ -0,0 +1,111 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <arpa/inet.h>
+
+#include "tests/test.h"
+#include "lib/generic/lpm.h"
+
+/* Insert subnet in CIDR notation */
+static int insert(lpm_t *tree, const char *addr, unsigned bits, void *val)
+{
+	uint8_t key[16];
+	int family = strchr(addr, ':') ? AF_INET6 : AF_INET;
+	assert_int_equal(inet_pton(family, addr, key), 1);
+	return lpm_insert(tree, key, bits, val);
+}
+
+/* Match address and return matched prefix length */
+static void *match(lpm_t *tree, const char *addr, unsigned *match_bits)
+{
+	uint8_t key[16];
+	int family = strchr(addr, ':') ? AF_INET6 : AF_INET;
+	assert_int_equal(inet_pton(family, addr, key), 1);
+	return lpm_match(tree, key, family == AF_INET ? 32 : 128, match_bits);
+}
+
+static void test_lpm_ipv4(void **state)
+{
+	lpm_t tree;
+	lpm_init(&tree, NULL);
+	int vals[5];
+	unsigned bits = 0;
+
+	assert_null(match(&tree, "10.0.0.1", NULL));
+	assert_int_equal(insert(&tree, "10.1.0.0", 16, &vals[1]), 0);
+	assert_int_equal(insert(&tree, "10.0.0.0", 8, &vals[0]), 0);
+	assert_int_equal(insert(&tree, "10.1.2.0", 24, &vals[2]), 0);
+	assert_int_equal(insert(&tree, "192.168.0.0", 16, &vals[3]), 0);
+	assert_int_equal(insert(&tree, "10.1.2.3", LPM_MAXBITS + 1, &vals[4]), kr_error(EINVAL));
+
+	/* Most specific prefix wins */
+	assert_ptr_equal(match(&tree, "10.1.2.3", &bits), &vals[2]);
+	assert_int_equal(bits, 24);
+	assert_ptr_equal(match(&tree, "10.1.3.3", &bits), &vals[1]);
+	assert_int_equal(bits, 16);
+	assert_ptr_equal(match(&tree, "10.200.0.1", &bits), &vals[0]);
+	assert_int_equal(bits, 8);
+	assert_ptr_equal(match(&tree, "192.168.255.255", NULL), &vals[3]);
+	assert_null(match(&tree, "192.169.0.1", NULL));
+	assert_null(match(&tree, "11.0.0.1", NULL));
+
+	/* Replace value, add default route */
+	assert_int_equal(insert(&tree, "10.1.0.0", 16, &vals[4]), 0);
+	assert_ptr_equal(match(&tree, "10.1.3.3", NULL), &vals[4]);
+	assert_int_equal(insert(&tree, "0.0.0.0", 0, &vals[3]), 0);
+	assert_ptr_equal(match(&tree, "11.0.0.1", &bits), &vals[3]);
+	assert_int_equal(bits, 0);
+
+	/* All covering prefixes, the shortest first */
+	void *all[LPM_MAXBITS + 1];
+	uint8_t key[4] = { 10, 1, 2, 3 };
+	assert_int_equal(lpm_match_all(&tree, key, 32, all, LPM_MAXBITS + 1), 4);
+	assert_ptr_equal(all[0], &vals[3]);
+	assert_ptr_equal(all[1], &vals[0]);
+	assert_ptr_equal(all[2], &vals[4]);
+	assert_ptr_equal(all[3], &vals[2]);
+	assert_int_equal(lpm_match_all(&tree, key, 32, all, 2), 2);
+	assert_ptr_equal(all[1], &vals[0]);
+
+	lpm_clear(&tree);
+	assert_null(match(&tree, "10.1.2.3", NULL));
+}
+
+static void test_lpm_ipv6(void **state)
+{
+	lpm_t tree;
+	lpm_init(&tree, NULL);
+	int vals[3];
+
+	assert_int_equal(insert(&tree, "2001:db8::", 32, &vals[0]), 0);
+	assert_int_equal(insert(&tree, "2001:db8:1::", 48, &vals[1]), 0);
+	assert_int_equal(insert(&tree, "2001:db8:1::1", 128, &vals[2]), 0);
+	assert_ptr_equal(match(&tree, "2001:db8:1::1", NULL), &vals[2]);
+	assert_ptr_equal(match(&tree, "2001:db8:1::2", NULL), &vals[1]);
+	assert_ptr_equal(match(&tree, "2001:db8:2::1", NULL), &vals[0]);
+	assert_null(match(&tree, "2001:db9::1", NULL));
+	lpm_clear(&tree);
+}
+
+int main(void)
+{
+	const UnitTest tests[] = {
+		unit_test(test_lpm_ipv4),
+		unit_test(test_lpm_ipv6),
+	};
+
+	return run_tests(tests);
+}
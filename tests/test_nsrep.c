@@ -0,0 +1,158 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "tests/test.h"
+#include "lib/nsrep.h"
+#include "lib/resolve.h"
+
+#define SAVED_AT 1000
+#define NSREP_SAVE_REP 2 /* Saved reputation table, see nsrep.c */
+
+static const char addr_good[] = { 192, 0, 2, 1 };
+static const char addr_bad[] = { 192, 0, 2, 2 };
+static const char *env = NULL;
+static struct kr_context ctx;
+
+/* Open cache for the saved tables */
+static void test_open(void **state)
+{
+	memset(&ctx, 0, sizeof(ctx));
+	env = test_tmpdir_create();
+	assert_non_null(env);
+	struct kr_cdb_opts opts = { env, 10 * 4096 };
+	assert_int_equal(kr_cache_open(&ctx.cache, NULL, &opts, NULL), 0);
+}
+
+static void test_close(void **state)
+{
+	lru_free(ctx.cache_rtt);
+	lru_free(ctx.cache_rep);
+	kr_cache_close(&ctx.cache);
+	test_tmpdir_remove(env);
+}
+
+/** Replace RTT and reputation tables with empty ones, as after restart. */
+static void tables_reset(void)
+{
+	lru_free(ctx.cache_rtt);
+	lru_free(ctx.cache_rep);
+	lru_create(&ctx.cache_rtt, 16, NULL, NULL);
+	lru_create(&ctx.cache_rep, 16, NULL, NULL);
+	assert_non_null(ctx.cache_rtt);
+	assert_non_null(ctx.cache_rep);
+}
+
+static void test_nsrep_params(void **state)
+{
+	struct kr_context empty;
+	memset(&empty, 0, sizeof(empty));
+	assert_int_equal(kr_nsrep_save(NULL, 0), kr_error(EINVAL));
+	assert_int_equal(kr_nsrep_load(NULL, 0), kr_error(EINVAL));
+	/* Closed cache */
+	assert_int_equal(kr_nsrep_save(&empty, 0), kr_error(EINVAL));
+	assert_int_equal(kr_nsrep_load(&empty, 0), kr_error(EINVAL));
+}
+
+static void test_nsrep_save(void **state)
+{
+	tables_reset();
+	/* Nothing saved yet */
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT), 0);
+	struct kr_nsrep_rtt *rtt = lru_get_new(ctx.cache_rtt, addr_good, sizeof(addr_good));
+	assert_non_null(rtt);
+	*rtt = (struct kr_nsrep_rtt) { .score = 40, .srtt = 40, .rttvar = 5 };
+	/* Timeouted server isn't saved */
+	rtt = lru_get_new(ctx.cache_rtt, addr_bad, sizeof(addr_bad));
+	assert_non_null(rtt);
+	*rtt = (struct kr_nsrep_rtt) { .score = KR_NS_TIMEOUT, .srtt = KR_NS_TIMEOUT, .rttvar = 0 };
+	unsigned *rep = lru_get_new(ctx.cache_rep, addr_good, sizeof(addr_good));
+	assert_non_null(rep);
+	*rep = KR_NS_NOIP6;
+	assert_int_equal(kr_nsrep_save(&ctx, SAVED_AT), 0);
+}
+
+static void test_nsrep_load(void **state)
+{
+	/* Fresh snapshot is loaded as it was */
+	tables_reset();
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT + 10), 2);
+	struct kr_nsrep_rtt *rtt = lru_get_try(ctx.cache_rtt, addr_good, sizeof(addr_good));
+	assert_non_null(rtt);
+	assert_int_equal(rtt->score, 40);
+	assert_int_equal(rtt->srtt, 40);
+	assert_int_equal(rtt->rttvar, 5);
+	assert_null(lru_get_try(ctx.cache_rtt, addr_bad, sizeof(addr_bad)));
+	unsigned *rep = lru_get_try(ctx.cache_rep, addr_good, sizeof(addr_good));
+	assert_non_null(rep);
+	assert_int_equal(*rep, KR_NS_NOIP6);
+	/* Entries learned since the start are kept */
+	rtt->score = rtt->srtt = 100;
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT + 10), 0);
+	assert_int_equal(rtt->srtt, 100);
+}
+
+static void test_nsrep_aging(void **state)
+{
+	/* Aged snapshot has the RTT variation widened */
+	tables_reset();
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT + KR_NSREP_SAVE_AGED), 2);
+	struct kr_nsrep_rtt *rtt = lru_get_try(ctx.cache_rtt, addr_good, sizeof(addr_good));
+	assert_non_null(rtt);
+	assert_int_equal(rtt->srtt, 40);
+	assert_int_equal(rtt->rttvar, 40 / 2);
+	/* Expired snapshot is ignored */
+	tables_reset();
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT + KR_NSREP_SAVE_TTL + 1), 0);
+	assert_null(lru_get_try(ctx.cache_rtt, addr_good, sizeof(addr_good)));
+}
+
+static void test_nsrep_corrupt(void **state)
+{
+	/* Length prefix larger than the stored data */
+	uint8_t buf[sizeof(uint32_t) + 1 + sizeof(addr_good) + sizeof(unsigned)] = { 0 };
+	uint32_t len = UINT32_MAX;
+	memcpy(buf, &len, sizeof(len));
+	struct kr_cache_entry header = { .timestamp = SAVED_AT, .ttl = KR_NSREP_SAVE_TTL, .count = 1 };
+	knot_db_val_t data = { buf, sizeof(buf) };
+	assert_int_equal(kr_cache_insert(&ctx.cache, KR_CACHE_INFRA, (const knot_dname_t *)"", NSREP_SAVE_REP, &header, data), 0);
+	tables_reset();
+	lru_free(ctx.cache_rtt);
+	ctx.cache_rtt = NULL;
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT), 0);
+	/* Record with key running past the end of data */
+	len = sizeof(buf) - sizeof(len);
+	memcpy(buf, &len, sizeof(len));
+	buf[sizeof(len)] = 255;
+	assert_int_equal(kr_cache_insert(&ctx.cache, KR_CACHE_INFRA, (const knot_dname_t *)"", NSREP_SAVE_REP, &header, data), 0);
+	assert_int_equal(kr_nsrep_load(&ctx, SAVED_AT), 0);
+}
+
+int main(void)
+{
+	const UnitTest tests[] = {
+		unit_test(test_nsrep_params),
+		group_test_setup(test_open),
+		unit_test(test_nsrep_save),
+		unit_test(test_nsrep_load),
+		unit_test(test_nsrep_aging),
+		unit_test(test_nsrep_corrupt),
+		group_test_teardown(test_close)
+	};
+
+	return run_group_tests(tests);
+}
@@ -0,0 +1,138 @@
+/*  Copyright (C) 2017 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <arpa/inet.h>
+
+#include "tests/test.h"
+#include "lib/generic/suffix.h"
+#include "lib/generic/ruleset.h"
+
+static void test_suffix(void **state)
+{
+	map_t *set = kr_suffix_new();
+	assert_non_null(set);
+	assert_int_equal(kr_suffix_add(set, (const uint8_t *)"\6badboy\2cz"), 0);
+	assert_int_equal(kr_suffix_add(set, (const uint8_t *)"\4arpa"), 0);
+	/* Exact and enclosed names match, regardless of case */
+	const uint8_t *name = (const uint8_t *)"\3www\6BadBoy\2cz";
+	assert_ptr_equal(kr_suffix_match(set, name), name + 4);
+	assert_non_null(kr_suffix_match(set, (const uint8_t *)"\6badboy\2cz"));
+	assert_non_null(kr_suffix_match(set, (const uint8_t *)"\0010\00210\7in-addr\4arpa"));
+	/* Only whole labels match */
+	assert_null(kr_suffix_match(set, (const uint8_t *)"\7xbadboy\2cz"));
+	assert_null(kr_suffix_match(set, (const uint8_t *)"\6badboy\2cz\3com"));
+	assert_null(kr_suffix_match(set, (const uint8_t *)""));
+	/* Root encloses everything */
+	assert_int_equal(kr_suffix_add(set, (const uint8_t *)""), 0);
+	assert_non_null(kr_suffix_match(set, (const uint8_t *)"\3com"));
+	kr_suffix_free(set);
+}
+
+static void test_rpz(void **state)
+{
+	struct kr_rpz *rpz = kr_rpz_new();
+	assert_non_null(rpz);
+	assert_int_equal(kr_rpz_add(rpz, (const uint8_t *)"\3bad\2cz", 1), 0);
+	assert_int_equal(kr_rpz_add(rpz, (const uint8_t *)"\1*\3bad\2cz", 2), 0);
+	assert_int_equal(kr_rpz_add(rpz, (const uint8_t *)"\1*\2cz", 3), 0);
+	assert_true(kr_rpz_add(rpz, (const uint8_t *)"\2cz", 0) < 0);
+	/* Exact match first, then the closest wildcard */
+	assert_int_equal(kr_rpz_match(rpz, (const uint8_t *)"\3BAD\2cz"), 1);
+	assert_int_equal(kr_rpz_match(rpz, (const uint8_t *)"\3www\3bad\2cz"), 2);
+	assert_int_equal(kr_rpz_match(rpz, (const uint8_t *)"\1a\3www\3bad\2cz"), 2);
+	assert_int_equal(kr_rpz_match(rpz, (const uint8_t *)"\4good\2cz"), 3);
+	/* Wildcard doesn't cover its parent */
+	assert_int_equal(kr_rpz_match(rpz, (const uint8_t *)"\2cz"), 0);
+	assert_int_equal(kr_rpz_match(rpz, (const uint8_t *)"\3com"), 0);
+	kr_rpz_free(rpz);
+}
+
+static void test_ruleset(void **state)
+{
+	struct kr_ruleset *rs = kr_ruleset_new();
+	assert_non_null(rs);
+	assert_int_equal(kr_ruleset_add(rs, 1, (const uint8_t *)"\3bad\2cz", NULL, NULL), 0);
+	assert_int_equal(kr_ruleset_add(rs, 2, (const uint8_t *)"\2cz", "192.0.2.0/24", NULL), 0);
+	assert_int_equal(kr_ruleset_add(rs, 3, NULL, "192.0.2.0/25", NULL), 0);
+	assert_int_equal(kr_ruleset_add(rs, 4, NULL, "0.0.0.0/0", NULL), 0);
+	assert_int_equal(kr_ruleset_add(rs, 5, NULL, NULL, "2001:db8::1"), 0);
+	assert_int_equal(kr_ruleset_add(rs, 6, NULL, NULL, NULL), 0);
+	assert_true(kr_ruleset_add(rs, 7, NULL, "192.0.2.0/33", NULL) < 0);
+
+	struct sockaddr_in src = { .sin_family = AF_INET };
+	struct sockaddr_in6 dst = { .sin6_family = AF_INET6 };
+	assert_int_equal(inet_pton(AF_INET, "192.0.2.1", &src.sin_addr), 1);
+	assert_int_equal(inet_pton(AF_INET6, "2001:db8::1", &dst.sin6_addr), 1);
+	int ids[8];
+	/* All predicates match, clauses are ordered by identifier */
+	int n = kr_ruleset_match(rs, (const uint8_t *)"\3www\3BAD\2cz", (struct sockaddr *)&src,
+	                         (struct sockaddr *)&dst, ids, 8);
+	assert_int_equal(n, 6);
+	for (int i = 0; i < n; ++i) {
+		assert_int_equal(ids[i], i + 1);
+	}
+	/* Source outside of /25, no destination */
+	assert_int_equal(inet_pton(AF_INET, "192.0.2.200", &src.sin_addr), 1);
+	n = kr_ruleset_match(rs, (const uint8_t *)"\4good\2cz", (struct sockaddr *)&src, NULL, ids, 8);
+	assert_int_equal(n, 3);
+	assert_int_equal(ids[0], 2);
+	assert_int_equal(ids[1], 4);
+	assert_int_equal(ids[2], 6);
+	/* No address predicates match without source */
+	n = kr_ruleset_match(rs, (const uint8_t *)"\3bad\2cz", NULL, NULL, ids, 8);
+	assert_int_equal(n, 2);
+	assert_int_equal(ids[0], 1);
+	assert_int_equal(ids[1], 6);
+	/* Full count is returned when the output array is too small */
+	n = kr_ruleset_match(rs, (const uint8_t *)"\3bad\2cz", NULL, NULL, ids, 1);
+	assert_int_equal(n, 2);
+	kr_ruleset_free(rs);
+
+	/* Additional predicates are a conjunction */
+	rs = kr_ruleset_new();
+	assert_non_null(rs);
+	assert_int_equal(kr_ruleset_add(rs, 1, (const uint8_t *)"\2cz", "192.0.2.0/24", NULL), 0);
+	assert_int_equal(kr_ruleset_and(rs, 1, (const uint8_t *)"\3BAD\2cz", NULL, NULL), 0);
+	assert_int_equal(kr_ruleset_and(rs, 1, NULL, "192.0.2.128/25", NULL), 0);
+	assert_int_equal(kr_ruleset_add(rs, 2, NULL, NULL, NULL), 0);
+	assert_int_equal(kr_ruleset_and(rs, 2, NULL, NULL, "2001:db8::/32"), 0);
+	assert_true(kr_ruleset_and(rs, 1, NULL, NULL, "2001:db8::/32") < 0);
+	assert_true(kr_ruleset_and(rs, 2, NULL, NULL, NULL) < 0);
+	n = kr_ruleset_match(rs, (const uint8_t *)"\3www\3bad\2cz", (struct sockaddr *)&src,
+	                     (struct sockaddr *)&dst, ids, 8);
+	assert_int_equal(n, 2);
+	assert_int_equal(ids[0], 1);
+	assert_int_equal(ids[1], 2);
+	/* Second QNAME predicate doesn't match */
+	n = kr_ruleset_match(rs, (const uint8_t *)"\4good\2cz", (struct sockaddr *)&src, NULL, ids, 8);
+	assert_int_equal(n, 0);
+	/* Second source predicate doesn't match */
+	assert_int_equal(inet_pton(AF_INET, "192.0.2.1", &src.sin_addr), 1);
+	n = kr_ruleset_match(rs, (const uint8_t *)"\3bad\2cz", (struct sockaddr *)&src, NULL, ids, 8);
+	assert_int_equal(n, 0);
+	kr_ruleset_free(rs);
+}
+
+int main(void)
+{
+	const UnitTest tests[] = {
+		unit_test(test_suffix),
+		unit_test(test_rpz),
+		unit_test(test_ruleset),
+	};
+
+	return run_tests(tests);
+}
@@ -15,6 +15,7 @@
  */
 
 #include <sys/socket.h>
+#include <arpa/inet.h>
 #include <stdio.h>
 #include <contrib/cleanup.h>
 
@@ -15,9 +15,11 @@
  */
 
 #include <netinet/in.h>
+#include <string.h>
 
 #include "tests/test.h"
 #include "lib/zonecut.h"
+#include "lib/resolve.h"
 
 static void test_zonecut_params(void **state)
 {
@@ -54,11 +56,79 @@ static void test_zonecut_copy(void **state)
 	kr_zonecut_deinit(&cut2);
 }
 
+/** Insert RRSet with a single RR into cache. */
+static void insert_rr(struct kr_cache *cache, const knot_dname_t *owner, uint16_t type,
+                      const uint8_t *rdata, uint16_t rdlen)
+{
+	knot_rrset_t *rr = knot_rrset_new(owner, type, KNOT_CLASS_IN, NULL);
+	assert_non_null(rr);
+	assert_int_equal(knot_rrset_add_rdata(rr, rdata, rdlen, 3600, NULL), 0);
+	assert_int_equal(kr_cache_insert_rr(cache, rr, KR_RANK_AUTH, KR_CACHE_FLAG_NONE, 0), 0);
+	knot_rrset_free(&rr, NULL);
+}
+
+static void test_zonecut_cache(void **state)
+{
+	const knot_dname_t *name = (const uint8_t *)"\7example\3com";
+	const knot_dname_t *ns_name = (const uint8_t *)"\2ns\7example\3com";
+	const uint8_t ns_addr[] = { 192, 0, 2, 1 };
+	struct kr_context ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cache_cut = kr_zonecut_cache_create(16);
+	assert_non_null(ctx.cache_cut);
+	lru_create(&ctx.cache_rep, 16, NULL, NULL);
+	assert_non_null(ctx.cache_rep);
+	/* NULL args */
+	kr_zonecut_cache_del(NULL, name);
+	kr_zonecut_cache_del(ctx.cache_cut, NULL);
+	kr_zonecut_cache_clear(NULL);
+	kr_zonecut_cache_free(NULL);
+	/* Nothing to find without cache */
+	bool secured = false;
+	struct kr_zonecut cut;
+	kr_zonecut_init(&cut, (const uint8_t *)"", NULL);
+	assert_int_not_equal(kr_zonecut_find_cached(&ctx, &cut, name, 0, &secured), 0);
+	assert_null(cut.nsset.root);
+	/* Store the zone cut in cache and look it up */
+	const char *env = test_tmpdir_create();
+	struct kr_cdb_opts opts = { env, 10 * 4096 };
+	assert_int_equal(kr_cache_open(&ctx.cache, NULL, &opts, NULL), 0);
+	insert_rr(&ctx.cache, name, KNOT_RRTYPE_NS, ns_name, knot_dname_size(ns_name));
+	insert_rr(&ctx.cache, ns_name, KNOT_RRTYPE_A, ns_addr, sizeof(ns_addr));
+	assert_int_equal(kr_zonecut_find_cached(&ctx, &cut, name, 0, &secured), 0);
+	assert_true(knot_dname_is_equal(cut.name, name));
+	assert_non_null(kr_zonecut_find(&cut, ns_name));
+	/* Hit in zone cut cache, even if the records are gone from cache */
+	assert_int_equal(kr_cache_clear(&ctx.cache), 0);
+	kr_zonecut_set(&cut, (const uint8_t *)"");
+	assert_int_equal(kr_zonecut_find_cached(&ctx, &cut, name, 1, &secured), 0);
+	assert_true(knot_dname_is_equal(cut.name, name));
+	assert_non_null(kr_zonecut_find(&cut, ns_name));
+	/* Miss after removal */
+	kr_zonecut_cache_del(ctx.cache_cut, name);
+	assert_int_not_equal(kr_zonecut_find_cached(&ctx, &cut, name, 1, &secured), 0);
+	/* Miss after the capped lifetime, even if the records live longer */
+	insert_rr(&ctx.cache, name, KNOT_RRTYPE_NS, ns_name, knot_dname_size(ns_name));
+	insert_rr(&ctx.cache, ns_name, KNOT_RRTYPE_A, ns_addr, sizeof(ns_addr));
+	kr_zonecut_cache_clear(ctx.cache_cut);
+	assert_int_equal(kr_zonecut_find_cached(&ctx, &cut, name, 0, &secured), 0);
+	assert_int_equal(kr_cache_clear(&ctx.cache), 0);
+	assert_int_not_equal(kr_zonecut_find_cached(&ctx, &cut, name, 3600 / 2, &secured), 0);
+	kr_cache_close(&ctx.cache);
+	test_tmpdir_remove(env);
+	kr_zonecut_cache_del(ctx.cache_cut, name);
+	kr_zonecut_cache_clear(ctx.cache_cut);
+	kr_zonecut_deinit(&cut);
+	kr_zonecut_cache_free(ctx.cache_cut);
+	lru_free(ctx.cache_rep);
+}
+
 int main(void)
 {
 	const UnitTest tests[] = {
 	        unit_test(test_zonecut_params),
-	        unit_test(test_zonecut_copy)
+	        unit_test(test_zonecut_copy),
+	        unit_test(test_zonecut_cache)
 	};
 
 	return run_tests(tests);
@@ -8,10 +8,13 @@ tests_BIN := \
 	test_array \
 	test_pack \
 	test_lru \
+	test_lpm \
+	test_ruleset \
 	test_utils \
 	test_module \
 	test_cache \
 	test_zonecut \
+	test_nsrep \
 	test_rplan
 
 mock_cmodule_CFLAGS := -fPIC